@@ -2,8 +2,15 @@
 #ifndef TOKENIZER_SENTRY
 #define TOKENIZER_SENTRY
 
+#include "../src/c_tokenizer/linear_allocator.h"
 #include "../src/c_tokenizer/word.h"
 #include "../src/c_tokenizer/word_list.h"
+#include "../src/c_tokenizer/input_buffer.h"
+#include "../src/c_tokenizer/char_scan.h"
+#include "../src/c_tokenizer/token_line.h"
+#include "../src/c_tokenizer/tokenizer_dfa.h"
 #include "../src/c_tokenizer/line_tokenization.h"
+#include "../src/c_tokenizer/parallel_tokenization.h"
+#include "../src/c_tokenizer/token_dict.h"
 
 #endif
@@ -0,0 +1,784 @@
+/* art/art.c */
+#include "art.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Adaptive radix tree implementation, after Leis et al., "The Adaptive
+ * Radix Tree: ARTful Indexing for Main-Memory Databases".
+ *
+ * Keys are taken with their terminating '\0', so no key is a prefix of
+ * another one, and every key ends in its own leaf. As the '\0' sorts
+ * first, the byte order of the tree is the strcmp order.
+ *
+ * Leaves are told from the inner nodes by the lowest bit of the pointer.
+ *
+ * The inner nodes keep only the first art_max_prefix bytes of their
+ * compressed path. Lookups skip the rest optimistically and the leaf
+ * compare at the end catches the mismatches; updates that need the full
+ * prefix read it from any leaf below the node. */
+
+enum {
+    node4_type = 1, node16_type, node48_type, node256_type,
+    art_max_prefix = 10
+};
+
+struct tag_art_node {
+    uint8_t type;
+    uint16_t child_cnt;
+    uint32_t prefix_len;
+    unsigned char prefix[art_max_prefix];
+};
+
+/* the keys of node4 and node16 are sorted, with the children in the same
+ * order; node48 maps the key byte to the child slot + 1 (0 = no child) */
+typedef struct tag_art_node4 {
+    art_node n;
+    unsigned char keys[4];
+    art_node *children[4];
+} art_node4;
+
+typedef struct tag_art_node16 {
+    art_node n;
+    unsigned char keys[16];
+    art_node *children[16];
+} art_node16;
+
+typedef struct tag_art_node48 {
+    art_node n;
+    unsigned char child_index[256];
+    art_node *children[48];
+} art_node48;
+
+typedef struct tag_art_node256 {
+    art_node n;
+    art_node *children[256];
+} art_node256;
+
+typedef struct tag_art_leaf {
+    void *data;
+    size_t key_len; /* with the '\0' */
+    unsigned char key[];
+} art_leaf;
+
+#define is_leaf(p) (((uintptr_t)(p) & 1) != 0)
+#define to_leaf(p) ((art_leaf *)((uintptr_t)(p) & ~(uintptr_t)1))
+#define from_leaf(l) ((art_node *)((uintptr_t)(l) | 1))
+
+/* API Impl and forward declarations */
+
+static art_node **find_child(art_node *n, unsigned char c);
+static int leaf_matches(const art_leaf *l, const unsigned char *key,
+        size_t len);
+static size_t check_prefix(const art_node *n, const unsigned char *key,
+        size_t len, size_t depth);
+static art_leaf *make_leaf(const unsigned char *key, size_t len,
+        void *data);
+static int insert(art_node **ref, const unsigned char *key, size_t len,
+        void *data);
+static void remove_child(art_node **ref, art_node *n, unsigned char c,
+        art_node **child);
+static void destroy_node(art_node *n);
+static int visit_node(const art_node *n, size_t depth,
+        const unsigned char *from, int bounded, const char *to,
+        art_visitor visit, void *ctx, int *visited);
+
+void art_init(art_tree *t)
+{
+    t->root = NULL;
+    t->size = 0;
+}
+
+int art_get_element(const art_tree *t, const char *key, void **data)
+{
+    const unsigned char *k = (const unsigned char *)key;
+    art_node *n, **child;
+    art_leaf *l;
+    size_t len, depth = 0;
+
+    len = strlen(key) + 1;
+    n = t->root;
+
+    while (n) {
+        if (is_leaf(n)) {
+            l = to_leaf(n);
+            if (!leaf_matches(l, k, len))
+                return 0;
+
+            if (data)
+                *data = l->data;
+            return 1;
+        }
+
+        if (n->prefix_len) {
+            if (check_prefix(n, k, len, depth) !=
+                    (n->prefix_len < art_max_prefix ?
+                     n->prefix_len : art_max_prefix))
+                return 0;
+            depth += n->prefix_len;
+            if (depth >= len)
+                return 0;
+        }
+
+        child = find_child(n, k[depth]);
+        n = child ? *child : NULL;
+        depth++;
+    }
+
+    return 0;
+}
+
+int art_add_element(art_tree *t, const char *key, void *data)
+{
+    int added;
+
+    added = insert(&t->root, (const unsigned char *)key, strlen(key) + 1,
+            data);
+    t->size += added;
+
+    return added;
+}
+
+int art_remove_element(art_tree *t, const char *key)
+{
+    const unsigned char *k = (const unsigned char *)key;
+    art_node **ref = &t->root, *n, **child;
+    size_t len, depth = 0;
+
+    len = strlen(key) + 1;
+
+    while (*ref) {
+        n = *ref;
+
+        /* a leaf is only reached here as the root */
+        if (is_leaf(n)) {
+            if (!leaf_matches(to_leaf(n), k, len))
+                return 0;
+            free(to_leaf(n));
+            *ref = NULL;
+            t->size--;
+            return 1;
+        }
+
+        if (n->prefix_len) {
+            if (check_prefix(n, k, len, depth) !=
+                    (n->prefix_len < art_max_prefix ?
+                     n->prefix_len : art_max_prefix))
+                return 0;
+            depth += n->prefix_len;
+            if (depth >= len)
+                return 0;
+        }
+
+        child = find_child(n, k[depth]);
+        if (!child)
+            return 0;
+
+        if (is_leaf(*child)) {
+            if (!leaf_matches(to_leaf(*child), k, len))
+                return 0;
+            free(to_leaf(*child));
+            remove_child(ref, n, k[depth], child);
+            t->size--;
+            return 1;
+        }
+
+        ref = child;
+        depth++;
+    }
+
+    return 0;
+}
+
+void art_destroy(art_tree *t)
+{
+    destroy_node(t->root);
+    art_init(t);
+}
+
+int art_visit_range(const art_tree *t, const char *from, const char *to,
+        art_visitor visit, void *ctx)
+{
+    int visited = 0;
+
+    visit_node(t->root, 0, (const unsigned char *)from, from != NULL, to,
+            visit, ctx, &visited);
+
+    return visited;
+}
+
+/* Memory functions */
+
+static art_node *alloc_node(uint8_t type)
+{
+    art_node *n;
+    size_t size;
+
+    switch (type) {
+        case node4_type:
+            size = sizeof(art_node4);
+            break;
+        case node16_type:
+            size = sizeof(art_node16);
+            break;
+        case node48_type:
+            size = sizeof(art_node48);
+            break;
+        default:
+            size = sizeof(art_node256);
+    }
+
+    n = calloc(1, size);
+    n->type = type;
+
+    return n;
+}
+
+static art_leaf *make_leaf(const unsigned char *key, size_t len, void *data)
+{
+    art_leaf *l;
+
+    l = malloc(offsetof(art_leaf, key) + len);
+    l->data = data;
+    l->key_len = len;
+    memcpy(l->key, key, len);
+
+    return l;
+}
+
+static void destroy_node(art_node *n)
+{
+    int i;
+
+    if (!n)
+        return;
+
+    if (is_leaf(n)) {
+        free(to_leaf(n));
+        return;
+    }
+
+    switch (n->type) {
+        case node4_type:
+            for (i = 0; i < n->child_cnt; i++)
+                destroy_node(((art_node4 *)n)->children[i]);
+            break;
+        case node16_type:
+            for (i = 0; i < n->child_cnt; i++)
+                destroy_node(((art_node16 *)n)->children[i]);
+            break;
+        case node48_type:
+            for (i = 0; i < 48; i++)
+                destroy_node(((art_node48 *)n)->children[i]);
+            break;
+        default:
+            for (i = 0; i < 256; i++)
+                destroy_node(((art_node256 *)n)->children[i]);
+    }
+
+    free(n);
+}
+
+static void copy_header(art_node *dst, const art_node *src)
+{
+    dst->child_cnt = src->child_cnt;
+    dst->prefix_len = src->prefix_len;
+    memcpy(dst->prefix, src->prefix, art_max_prefix);
+}
+
+/* Keys and prefixes */
+
+static int leaf_matches(const art_leaf *l, const unsigned char *key,
+        size_t len)
+{
+    return l->key_len == len && memcmp(l->key, key, len) == 0;
+}
+
+static size_t min_size(size_t a, size_t b)
+{
+    return a < b ? a : b;
+}
+
+/* any leaf below n has the full prefix of n in it, the first is as good
+ * as any */
+static const art_leaf *minimum_leaf(const art_node *n)
+{
+    int i;
+
+    while (!is_leaf(n)) {
+        switch (n->type) {
+            case node4_type:
+                n = ((const art_node4 *)n)->children[0];
+                break;
+            case node16_type:
+                n = ((const art_node16 *)n)->children[0];
+                break;
+            case node48_type:
+                for (i = 0; !((const art_node48 *)n)->child_index[i]; i++)
+                    ;
+                i = ((const art_node48 *)n)->child_index[i] - 1;
+                n = ((const art_node48 *)n)->children[i];
+                break;
+            default:
+                for (i = 0; !((const art_node256 *)n)->children[i]; i++)
+                    ;
+                n = ((const art_node256 *)n)->children[i];
+        }
+    }
+
+    return to_leaf(n);
+}
+
+/* number of stored prefix bytes matching the key at depth */
+static size_t check_prefix(const art_node *n, const unsigned char *key,
+        size_t len, size_t depth)
+{
+    size_t max_cmp, i;
+
+    max_cmp = min_size(min_size(n->prefix_len, art_max_prefix),
+            len - depth);
+    for (i = 0; i < max_cmp; i++) {
+        if (n->prefix[i] != key[depth+i])
+            return i;
+    }
+
+    return i;
+}
+
+/* number of prefix bytes matching the key at depth, reading the part
+ * that is not stored in the node from a leaf */
+static size_t prefix_mismatch(const art_node *n, const unsigned char *key,
+        size_t len, size_t depth)
+{
+    const art_leaf *l;
+    size_t max_cmp, i;
+
+    i = check_prefix(n, key, len, depth);
+    if (i < art_max_prefix || n->prefix_len <= art_max_prefix)
+        return i;
+
+    l = minimum_leaf(n);
+    max_cmp = min_size(min_size(l->key_len, len) - depth, n->prefix_len);
+    for (; i < max_cmp; i++) {
+        if (l->key[depth+i] != key[depth+i])
+            return i;
+    }
+
+    return i;
+}
+
+/* Children */
+
+static art_node **find_child(art_node *n, unsigned char c)
+{
+    art_node4 *n4;
+    art_node16 *n16;
+    art_node48 *n48;
+    art_node256 *n256;
+    int i;
+#if defined(__SSE2__)
+    __m128i cmp;
+    unsigned int mask;
+#endif
+
+    switch (n->type) {
+        case node4_type:
+            n4 = (art_node4 *)n;
+            for (i = 0; i < n->child_cnt; i++) {
+                if (n4->keys[i] == c)
+                    return &n4->children[i];
+            }
+            return NULL;
+        case node16_type:
+            n16 = (art_node16 *)n;
+#if defined(__SSE2__)
+            /* all 16 keys compared at once, the unused ones masked off */
+            cmp = _mm_cmpeq_epi8(_mm_set1_epi8(c),
+                    _mm_loadu_si128((const __m128i *)n16->keys));
+            mask = _mm_movemask_epi8(cmp) & ((1u << n->child_cnt) - 1);
+            if (mask)
+                return &n16->children[__builtin_ctz(mask)];
+#else
+            for (i = 0; i < n->child_cnt; i++) {
+                if (n16->keys[i] == c)
+                    return &n16->children[i];
+            }
+#endif
+            return NULL;
+        case node48_type:
+            n48 = (art_node48 *)n;
+            i = n48->child_index[c];
+            return i ? &n48->children[i-1] : NULL;
+        default:
+            n256 = (art_node256 *)n;
+            return n256->children[c] ? &n256->children[c] : NULL;
+    }
+}
+
+/* inserts into a sorted keys/children pair of arrays with room left */
+static void insert_sorted(unsigned char *keys, art_node **children,
+        int cnt, unsigned char c, art_node *child)
+{
+    int i;
+
+    for (i = 0; i < cnt && keys[i] < c; i++)
+        ;
+
+    memmove(keys + i + 1, keys + i, cnt - i);
+    memmove(children + i + 1, children + i, (cnt - i) * sizeof(*children));
+    keys[i] = c;
+    children[i] = child;
+}
+
+/* Adds a child to n, which is at *ref. A full node is replaced with the
+ * next bigger one. */
+static void add_child(art_node **ref, art_node *n, unsigned char c,
+        art_node *child)
+{
+    art_node4 *n4;
+    art_node16 *n16;
+    art_node48 *n48;
+    art_node256 *n256;
+    art_node *bigger;
+    int i, slot;
+
+    switch (n->type) {
+        case node4_type:
+            n4 = (art_node4 *)n;
+            if (n->child_cnt < 4) {
+                insert_sorted(n4->keys, n4->children, n->child_cnt, c, child);
+                n->child_cnt++;
+                return;
+            }
+
+            bigger = alloc_node(node16_type);
+            copy_header(bigger, n);
+            memcpy(((art_node16 *)bigger)->keys, n4->keys, 4);
+            memcpy(((art_node16 *)bigger)->children, n4->children,
+                    4 * sizeof(*n4->children));
+            break;
+        case node16_type:
+            n16 = (art_node16 *)n;
+            if (n->child_cnt < 16) {
+                insert_sorted(n16->keys, n16->children, n->child_cnt, c,
+                        child);
+                n->child_cnt++;
+                return;
+            }
+
+            bigger = alloc_node(node48_type);
+            copy_header(bigger, n);
+            for (i = 0; i < 16; i++) {
+                ((art_node48 *)bigger)->children[i] = n16->children[i];
+                ((art_node48 *)bigger)->child_index[n16->keys[i]] = i + 1;
+            }
+            break;
+        case node48_type:
+            n48 = (art_node48 *)n;
+            if (n->child_cnt < 48) {
+                /* removals leave holes, so look for a free slot */
+                for (slot = 0; n48->children[slot]; slot++)
+                    ;
+                n48->children[slot] = child;
+                n48->child_index[c] = slot + 1;
+                n->child_cnt++;
+                return;
+            }
+
+            bigger = alloc_node(node256_type);
+            copy_header(bigger, n);
+            for (i = 0; i < 256; i++) {
+                if (n48->child_index[i]) {
+                    ((art_node256 *)bigger)->children[i] =
+                        n48->children[n48->child_index[i] - 1];
+                }
+            }
+            break;
+        default:
+            n256 = (art_node256 *)n;
+            n256->children[c] = child;
+            n->child_cnt++;
+            return;
+    }
+
+    *ref = bigger;
+    free(n);
+    add_child(ref, bigger, c, child);
+}
+
+/* Removes *child (under the byte c) from n, which is at *ref. Nodes shrink to the next
+ * smaller size with some slack, so that adding and removing around the
+ * limit does not resize every time. A node4 left with one child is
+ * merged into it. */
+static void remove_child(art_node **ref, art_node *n, unsigned char c,
+        art_node **child)
+{
+    art_node4 *n4;
+    art_node16 *n16;
+    art_node48 *n48;
+    art_node256 *n256;
+    art_node *smaller, *only;
+    size_t pos, stored;
+    int i, cnt;
+
+    switch (n->type) {
+        case node4_type:
+            n4 = (art_node4 *)n;
+            pos = child - n4->children;
+            memmove(n4->keys + pos, n4->keys + pos + 1,
+                    n->child_cnt - pos - 1);
+            memmove(n4->children + pos, n4->children + pos + 1,
+                    (n->child_cnt - pos - 1) * sizeof(*child));
+            n->child_cnt--;
+
+            if (n->child_cnt > 1)
+                return;
+
+            /* the path down to the only child becomes its prefix: ours,
+             * the key byte, then its own */
+            only = n4->children[0];
+            if (!is_leaf(only)) {
+                stored = min_size(n->prefix_len, art_max_prefix);
+                if (stored < art_max_prefix)
+                    n->prefix[stored++] = n4->keys[0];
+                if (stored < art_max_prefix) {
+                    memcpy(n->prefix + stored, only->prefix,
+                            min_size(only->prefix_len,
+                                art_max_prefix - stored));
+                }
+                only->prefix_len += n->prefix_len + 1;
+                memcpy(only->prefix, n->prefix,
+                        min_size(only->prefix_len, art_max_prefix));
+            }
+
+            *ref = only;
+            free(n);
+            return;
+        case node16_type:
+            n16 = (art_node16 *)n;
+            pos = child - n16->children;
+            memmove(n16->keys + pos, n16->keys + pos + 1,
+                    n->child_cnt - pos - 1);
+            memmove(n16->children + pos, n16->children + pos + 1,
+                    (n->child_cnt - pos - 1) * sizeof(*child));
+            n->child_cnt--;
+
+            if (n->child_cnt > 3)
+                return;
+
+            smaller = alloc_node(node4_type);
+            copy_header(smaller, n);
+            memcpy(((art_node4 *)smaller)->keys, n16->keys, n->child_cnt);
+            memcpy(((art_node4 *)smaller)->children, n16->children,
+                    n->child_cnt * sizeof(*child));
+            break;
+        case node48_type:
+            n48 = (art_node48 *)n;
+            n48->children[n48->child_index[c] - 1] = NULL;
+            n48->child_index[c] = 0;
+            n->child_cnt--;
+
+            if (n->child_cnt > 12)
+                return;
+
+            smaller = alloc_node(node16_type);
+            copy_header(smaller, n);
+            for (i = 0, cnt = 0; i < 256; i++) {
+                if (n48->child_index[i]) {
+                    ((art_node16 *)smaller)->keys[cnt] = i;
+                    ((art_node16 *)smaller)->children[cnt] =
+                        n48->children[n48->child_index[i] - 1];
+                    cnt++;
+                }
+            }
+            break;
+        default:
+            n256 = (art_node256 *)n;
+            n256->children[c] = NULL;
+            n->child_cnt--;
+
+            if (n->child_cnt > 37)
+                return;
+
+            smaller = alloc_node(node48_type);
+            copy_header(smaller, n);
+            for (i = 0, cnt = 0; i < 256; i++) {
+                if (n256->children[i]) {
+                    ((art_node48 *)smaller)->children[cnt] =
+                        n256->children[i];
+                    ((art_node48 *)smaller)->child_index[i] = cnt + 1;
+                    cnt++;
+                }
+            }
+    }
+
+    *ref = smaller;
+    free(n);
+}
+
+/* Insertion */
+
+static int insert(art_node **ref, const unsigned char *key, size_t len,
+        void *data)
+{
+    art_node *n, *split, **child;
+    const art_leaf *l;
+    art_leaf *new_leaf;
+    size_t depth = 0, diff;
+
+    for (;;) {
+        n = *ref;
+
+        if (!n) {
+            *ref = from_leaf(make_leaf(key, len, data));
+            return 1;
+        }
+
+        /* lazy expansion ends here: a node for the bytes both keys
+         * share, with the two leaves under it */
+        if (is_leaf(n)) {
+            l = to_leaf(n);
+            if (leaf_matches(l, key, len))
+                return 0;
+
+            for (diff = 0; l->key[depth+diff] == key[depth+diff]; diff++)
+                ;
+
+            split = alloc_node(node4_type);
+            split->prefix_len = diff;
+            memcpy(split->prefix, key + depth, min_size(diff, art_max_prefix));
+            new_leaf = make_leaf(key, len, data);
+            add_child(ref, split, l->key[depth+diff], n);
+            add_child(ref, split, key[depth+diff], from_leaf(new_leaf));
+            *ref = split;
+            return 1;
+        }
+
+        if (n->prefix_len) {
+            diff = prefix_mismatch(n, key, len, depth);
+
+            /* the key leaves the compressed path: split it at the
+             * mismatch, n keeps what is after it */
+            if (diff < n->prefix_len) {
+                split = alloc_node(node4_type);
+                split->prefix_len = diff;
+                memcpy(split->prefix, n->prefix,
+                        min_size(diff, art_max_prefix));
+
+                if (n->prefix_len <= art_max_prefix) {
+                    add_child(ref, split, n->prefix[diff], n);
+                    n->prefix_len -= diff + 1;
+                    memmove(n->prefix, n->prefix + diff + 1,
+                            min_size(n->prefix_len, art_max_prefix));
+                } else {
+                    l = minimum_leaf(n);
+                    add_child(ref, split, l->key[depth+diff], n);
+                    n->prefix_len -= diff + 1;
+                    memcpy(n->prefix, l->key + depth + diff + 1,
+                            min_size(n->prefix_len, art_max_prefix));
+                }
+
+                new_leaf = make_leaf(key, len, data);
+                add_child(ref, split, key[depth+diff], from_leaf(new_leaf));
+                *ref = split;
+                return 1;
+            }
+
+            depth += n->prefix_len;
+        }
+
+        child = find_child(n, key[depth]);
+        if (!child) {
+            add_child(ref, n, key[depth],
+                    from_leaf(make_leaf(key, len, data)));
+            return 1;
+        }
+
+        ref = child;
+        depth++;
+    }
+}
+
+/* Traversal */
+
+/* Visits the subtree in order. While bounded, everything so far equals
+ * from, so the subtree may still hold keys before it. Returns 1 when the
+ * traversal has to stop. */
+static int visit_node(const art_node *n, size_t depth,
+        const unsigned char *from, int bounded, const char *to,
+        art_visitor visit, void *ctx, int *visited)
+{
+    const unsigned char *prefix;
+    const art_leaf *l;
+    const art_node *c;
+    int i, idx;
+
+    if (!n)
+        return 0;
+
+    if (is_leaf(n)) {
+        l = to_leaf(n);
+        if (bounded && strcmp((const char *)l->key, (const char *)from) < 0)
+            return 0;
+        if (to && strcmp((const char *)l->key, to) >= 0)
+            return 1;
+
+        (*visited)++;
+        return visit((const char *)l->key, l->data, ctx) != 0;
+    }
+
+    if (bounded && n->prefix_len) {
+        prefix = n->prefix_len <= art_max_prefix ?
+            n->prefix : minimum_leaf(n)->key + depth;
+
+        /* the prefix has no '\0' in it, so the compare stops at the end
+         * of from at the latest */
+        for (i = 0; bounded && (size_t)i < n->prefix_len; i++) {
+            if (prefix[i] < from[depth+i])
+                return 0;
+            if (prefix[i] > from[depth+i])
+                bounded = 0;
+        }
+    }
+    depth += n->prefix_len;
+
+    for (i = 0; i < 256; i++) {
+        switch (n->type) {
+            case node4_type:
+                if (i >= n->child_cnt)
+                    return 0;
+                idx = ((const art_node4 *)n)->keys[i];
+                c = ((const art_node4 *)n)->children[i];
+                break;
+            case node16_type:
+                if (i >= n->child_cnt)
+                    return 0;
+                idx = ((const art_node16 *)n)->keys[i];
+                c = ((const art_node16 *)n)->children[i];
+                break;
+            case node48_type:
+                idx = i;
+                c = ((const art_node48 *)n)->child_index[i] ?
+                    ((const art_node48 *)n)->children[
+                        ((const art_node48 *)n)->child_index[i] - 1] :
+                    NULL;
+                break;
+            default:
+                idx = i;
+                c = ((const art_node256 *)n)->children[i];
+        }
+
+        if (!c || (bounded && idx < from[depth]))
+            continue;
+
+        if (visit_node(c, depth + 1, from, bounded && idx == from[depth],
+                    to, visit, ctx, visited))
+            return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+/* art/art.h */
+#ifndef ART_SENTRY
+#define ART_SENTRY
+
+#include <stddef.h>
+
+/* inteface for the adaptive radix tree dictionary with string keys and
+ * anything in data, ordered as rbtree.h (by strcmp).
+ *
+ * The tree branches on one key byte per level, so a lookup costs the key
+ * length, not log n string compares. The inner nodes come in four sizes
+ * (4, 16, 48 and 256 children) and grow and shrink with the number of
+ * children, so sparse levels do not waste 256 pointers.
+ *
+ * Path compression: a chain of nodes with a single child is stored as
+ * a prefix in the node below it. Lazy expansion: a key gets a leaf as
+ * soon as no other key shares its path, the rest of the key is only kept
+ * in the leaf. So keys sharing long prefixes store the shared bytes once
+ * in the inner nodes, and only the leaves hold full keys.
+ *
+ * The key strings are copied into the leaves when adding elements, the
+ * data is just passed by reference. */
+
+typedef struct tag_art_node art_node;
+
+typedef struct tag_art_tree {
+    art_node *root;
+    size_t size;
+} art_tree;
+
+void art_init(art_tree *t);
+
+/* returns 1 and puts the element data into *data (if not NULL) if the key
+ * is in the tree, 0 else */
+int art_get_element(const art_tree *t, const char *key, void **data);
+int art_add_element(art_tree *t, const char *key, void *data);
+int art_remove_element(art_tree *t, const char *key);
+void art_destroy(art_tree *t);
+
+/* Calls visit for all elements with from <= key < to in order, NULL from
+ * or to means no bound on that side. Stops early if visit returns non-0.
+ * Returns the number of elements visited. */
+typedef int (*art_visitor)(const char *key, void *data, void *ctx);
+int art_visit_range(const art_tree *t, const char *from, const char *to,
+        art_visitor visit, void *ctx);
+
+#endif
@@ -0,0 +1,314 @@
+/* art/tests/art_test.c */
+#include "../art.h"
+#include "../../c_rbtree/tests/test_rng.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This program checks the adaptive radix tree against a reference: a
+ * sorted array of the keys it must hold. Random adds, removes and lookups
+ * are checked answer by answer, and art_visit_range against a walk over
+ * the array, with random bounds (keys of the tree among them).
+ *
+ * The random keys are paths made of a few parts, some of them prefixes
+ * of others ("a", "ab", "abc", the empty key too), so keys that are
+ * prefixes of other keys, long shared prefixes and splits inside
+ * a compressed prefix come up all the time.
+ *
+ * Then the node sizes: 256 keys that differ only in one byte after
+ * a common prefix are added and removed in random order, so the node
+ * there grows through all four sizes and shrinks back, with the contents
+ * checked at every step.
+ *
+ * Build:
+ *   gcc -O2 art_test.c ../art.c -o art_test.out
+ *
+ * Usage: ./art_test.out [ops] [seed], returns 0 if all the answers were
+ * right, 1 else. */
+
+enum {
+    max_key_len = 256,
+    max_keys = 1 << 17,
+    check_every = 1000,
+    fanout_rounds = 20
+};
+
+struct ref_elem {
+    char *key;
+    void *data;
+};
+
+/* the reference, sorted by strcmp */
+static struct ref_elem ref[max_keys];
+static int ref_cnt;
+
+static void rand_key(char *key)
+{
+    static const char *const parts[] = {
+        "", "a", "ab", "abc", "usr", "local", "lib", "include",
+        "x86_64-linux-gnu-a-long-directory-name", "python3.11",
+        "site-packages", "\xff\xfe"
+    };
+    int cnt = 1 + rng_next() % 5, i;
+
+    key[0] = '\0';
+    for (i = 0; i < cnt; i++) {
+        if (i > 0 || rng_next() % 2)
+            strcat(key, "/");
+        strcat(key, parts[rng_next() % (sizeof(parts) / sizeof(parts[0]))]);
+    }
+    if (rng_next() % 4 == 0)
+        sprintf(key + strlen(key), "%d", (int)(rng_next() % 300));
+}
+
+/* Reference */
+
+/* the position of the key, or where it would go */
+static int ref_find(const char *key, int *found)
+{
+    int lo = 0, hi = ref_cnt, mid, comp_res;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        comp_res = strcmp(ref[mid].key, key);
+        if (comp_res == 0) {
+            *found = 1;
+            return mid;
+        }
+        if (comp_res < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    *found = 0;
+    return lo;
+}
+
+static int ref_add(const char *key, void *data)
+{
+    int found, pos = ref_find(key, &found);
+
+    if (found || ref_cnt == max_keys)
+        return 0;
+
+    memmove(ref + pos + 1, ref + pos, (ref_cnt - pos) * sizeof(*ref));
+    ref[pos].key = malloc(strlen(key) + 1);
+    strcpy(ref[pos].key, key);
+    ref[pos].data = data;
+    ref_cnt++;
+    return 1;
+}
+
+static int ref_remove(const char *key)
+{
+    int found, pos = ref_find(key, &found);
+
+    if (!found)
+        return 0;
+
+    free(ref[pos].key);
+    memmove(ref + pos, ref + pos + 1, (ref_cnt - pos - 1) * sizeof(*ref));
+    ref_cnt--;
+    return 1;
+}
+
+static void ref_clear(void)
+{
+    while (ref_cnt > 0)
+        free(ref[--ref_cnt].key);
+}
+
+/* Checks */
+
+struct range_check {
+    int pos, end, ok;
+};
+
+/* the visited elements must be ref[pos..end) in order */
+static int check_visited(const char *key, void *data, void *ctx)
+{
+    struct range_check *c = ctx;
+
+    if (c->pos >= c->end || strcmp(ref[c->pos].key, key) != 0 ||
+            ref[c->pos].data != data)
+        c->ok = 0;
+    c->pos++;
+    return 0;
+}
+
+static int check_range(const art_tree *t, const char *from, const char *to)
+{
+    struct range_check c;
+    int found, start, visited;
+
+    start = from ? ref_find(from, &found) : 0;
+    c.end = to ? ref_find(to, &found) : ref_cnt;
+    if (c.end < start)
+        c.end = start;
+    c.pos = start;
+    c.ok = 1;
+
+    visited = art_visit_range(t, from, to, check_visited, &c);
+    return c.ok && c.pos == c.end && visited == c.end - start;
+}
+
+static int check_all(const art_tree *t)
+{
+    struct range_check c;
+    void *data;
+    int i;
+
+    if (t->size != (size_t)ref_cnt)
+        return 0;
+
+    for (i = 0; i < ref_cnt; i++) {
+        if (!art_get_element(t, ref[i].key, &data) || data != ref[i].data)
+            return 0;
+    }
+
+    c.pos = 0;
+    c.end = ref_cnt;
+    c.ok = 1;
+    return art_visit_range(t, NULL, NULL, check_visited, &c) == ref_cnt &&
+        c.ok && c.pos == ref_cnt;
+}
+
+/* Random operations */
+
+static int random_op(art_tree *t, long i)
+{
+    char key[max_key_len], from[max_key_len], to[max_key_len];
+    const char *from_bound, *to_bound;
+    void *data = (void *)(long)(i + 1), *ref_data;
+    int found, pos, kind;
+
+    rand_key(key);
+
+    /* 3/8 adds, 1/4 removes, 5/16 lookups, 1/16 ranges */
+    kind = rng_next() % 16;
+    if (kind < 6)
+        return art_add_element(t, key, data) == ref_add(key, data);
+    if (kind < 10)
+        return art_remove_element(t, key) == ref_remove(key);
+
+    if (kind < 15) {
+        pos = ref_find(key, &found);
+        ref_data = found ? ref[pos].data : NULL;
+        return art_get_element(t, key, &data) == found &&
+            (!found || data == ref_data);
+    }
+
+    rand_key(from);
+    rand_key(to);
+    from_bound = rng_next() % 4 ? from : NULL;
+    to_bound = rng_next() % 4 ? to : NULL;
+    if (ref_cnt > 0 && rng_next() % 2)
+        from_bound = ref[rng_next() % ref_cnt].key;
+    return check_range(t, from_bound, to_bound);
+}
+
+static int run_random(art_tree *t, long ops)
+{
+    long i;
+
+    for (i = 0; i < ops; i++) {
+        if (!random_op(t, i))
+            return 0;
+        if (i % check_every == 0 && !check_all(t))
+            return 0;
+    }
+
+    return check_all(t);
+}
+
+/* 256 keys differing in the byte after the prefix, the prefix itself
+ * among them (b 0, the byte is then the terminating '\0') */
+static void fanout_key(int b, char *key)
+{
+    static const char prefix[] = "fanout/common/prefix/";
+
+    memcpy(key, prefix, sizeof(prefix));
+    key[sizeof(prefix) - 1] = (char)b;
+    key[sizeof(prefix)] = '\0';
+}
+
+static void shuffle(int *a, int n)
+{
+    int i, j, tmp;
+
+    for (i = n - 1; i > 0; i--) {
+        j = rng_next() % (i + 1);
+        tmp = a[i];
+        a[i] = a[j];
+        a[j] = tmp;
+    }
+}
+
+/* the fanout keys and the size, a full check_all at every step would
+ * take too long */
+static int check_fanout(const art_tree *t)
+{
+    return t->size == (size_t)ref_cnt &&
+        check_range(t, "fanout/", "fanout0");
+}
+
+static int run_fanout(art_tree *t)
+{
+    char key[max_key_len];
+    int order[256], round, i;
+
+    for (i = 0; i < 256; i++)
+        order[i] = i;
+
+    for (round = 0; round < fanout_rounds; round++) {
+        shuffle(order, 256);
+        for (i = 0; i < 256; i++) {
+            fanout_key(order[i], key);
+            if (art_add_element(t, key, (void *)(long)(i + 1)) !=
+                    ref_add(key, (void *)(long)(i + 1)) || !check_fanout(t))
+                return 0;
+        }
+
+        shuffle(order, 256);
+        for (i = 0; i < 256; i++) {
+            fanout_key(order[i], key);
+            if (art_remove_element(t, key) != ref_remove(key) ||
+                    !check_fanout(t))
+                return 0;
+        }
+    }
+
+    return check_all(t);
+}
+
+int main(int argc, char **argv)
+{
+    long ops = 100000;
+    art_tree t;
+    int ok;
+
+    if (argc > 1)
+        ops = atol(argv[1]);
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    if (!rng_state)
+        rng_state = 1;
+
+    art_init(&t);
+    ok = run_random(&t, ops);
+    if (!ok)
+        printf("failed: random operations\n");
+
+    /* the fanout keys go in beside the random ones */
+    if (ok && !run_fanout(&t)) {
+        ok = 0;
+        printf("failed: node growth and shrinking\n");
+    }
+
+    art_destroy(&t);
+    ref_clear();
+
+    if (ok)
+        printf("ok\n");
+    return !ok;
+}
@@ -0,0 +1,451 @@
+/* btree/btree.c */
+#include "btree.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/* B-tree implementation following Cormen et al., with top-down insertion
+ * and deletion: full nodes are split and minimal nodes are filled up on
+ * the way down, so no operation ever has to come back up the tree. */
+
+/* one element of a node, for moving it between nodes */
+struct btree_entry {
+    uint64_t prefix;
+    char *key;
+    void *data;
+};
+
+/* API Impl and forward declarations */
+
+static uint64_t key_prefix(const char *key);
+static int node_search(const btree_node *n, uint64_t prefix,
+        const char *key, int *found);
+
+int btree_get_element(const btree_node *root, const char *key, void **data)
+{
+    uint64_t prefix;
+    int i, found;
+
+    prefix = key_prefix(key);
+
+    while (root) {
+        i = node_search(root, prefix, key, &found);
+
+        if (found) {
+            if (data)
+                *data = root->data[i];
+            return 1;
+        }
+
+        root = root->is_leaf ? NULL : root->children[i];
+    }
+
+    return 0;
+}
+
+static btree_node *create_node(int is_leaf);
+static void split_child(btree_node *x, int i);
+static int insert_nonfull(btree_node *x, const struct btree_entry *e);
+
+int btree_add_element(btree_node **root, const char *key, void *data)
+{
+    struct btree_entry e;
+    btree_node *new_root;
+    size_t key_size;
+    int res;
+
+    if (!*root)
+        *root = create_node(1);
+
+    /* the root is the only node that can not be split by its parent */
+    if ((*root)->key_cnt == btree_max_keys) {
+        new_root = create_node(0);
+        new_root->children[0] = *root;
+        split_child(new_root, 0);
+        *root = new_root;
+    }
+
+    key_size = (strlen(key) + 1) * sizeof(char);
+    e.prefix = key_prefix(key);
+    e.key = malloc(key_size);
+    memcpy(e.key, key, key_size);
+    e.data = data;
+
+    res = insert_nonfull(*root, &e);
+    if (!res)
+        free(e.key);
+
+    return res;
+}
+
+static int remove_entry(btree_node *x, uint64_t prefix, const char *key,
+        struct btree_entry *out);
+
+int btree_remove_element(btree_node **root, const char *key)
+{
+    struct btree_entry e;
+    btree_node *old_root;
+    int res;
+
+    if (!*root)
+        return 0;
+
+    res = remove_entry(*root, key_prefix(key), key, &e);
+    if (res)
+        free(e.key);
+
+    /* the root may have been emptied by the last merge of its children */
+    if ((*root)->key_cnt == 0) {
+        old_root = *root;
+        *root = old_root->is_leaf ? NULL : old_root->children[0];
+        free(old_root);
+    }
+
+    return res;
+}
+
+void btree_print(const btree_node *root)
+{
+    int i;
+
+    if (!root)
+        return;
+
+    for (i = 0; i < root->key_cnt; i++) {
+        if (!root->is_leaf)
+            btree_print(root->children[i]);
+        printf("%s\n", root->keys[i]);
+    }
+
+    if (!root->is_leaf)
+        btree_print(root->children[root->key_cnt]);
+}
+
+/* the recursion is only as deep as the tree, that is a handful of levels */
+void btree_destroy(btree_node *root)
+{
+    int i;
+
+    if (!root)
+        return;
+
+    for (i = 0; i < root->key_cnt; i++)
+        free(root->keys[i]);
+
+    if (!root->is_leaf) {
+        for (i = 0; i <= root->key_cnt; i++)
+            btree_destroy(root->children[i]);
+    }
+
+    free(root);
+}
+
+/* Keys */
+
+/* First 8 bytes of the key, zero padded, as a big-endian number, so that
+ * comparing prefixes orders keys the same way strcmp does. */
+static uint64_t key_prefix(const char *key)
+{
+    uint64_t prefix = 0;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        prefix <<= 8;
+        if (*key)
+            prefix |= (unsigned char)*key++;
+    }
+
+    return prefix;
+}
+
+/* Equal prefixes with a zero last byte mean that both keys end within the
+ * prefix, so they are equal. Otherwise both are at least 8 chars long,
+ * and only the tails are left to compare. */
+static int compare_keys(uint64_t prefix_a, const char *a,
+        uint64_t prefix_b, const char *b)
+{
+    if (prefix_a != prefix_b)
+        return prefix_a < prefix_b ? -1 : 1;
+    if ((prefix_a & 0xff) == 0)
+        return 0;
+
+    return strcmp(a + 8, b + 8);
+}
+
+/* index of the first key that is >= key, *found is set if it is equal */
+static int node_search(const btree_node *n, uint64_t prefix,
+        const char *key, int *found)
+{
+    int i, comp_res;
+
+    *found = 0;
+
+    for (i = 0; i < n->key_cnt; i++) {
+        if (n->prefixes[i] < prefix)
+            continue;
+
+        comp_res = compare_keys(n->prefixes[i], n->keys[i], prefix, key);
+        if (comp_res >= 0) {
+            *found = comp_res == 0;
+            break;
+        }
+    }
+
+    return i;
+}
+
+/* Nodes */
+
+static btree_node *create_node(int is_leaf)
+{
+    btree_node *n;
+
+    n = malloc(sizeof(*n));
+    n->key_cnt = 0;
+    n->is_leaf = is_leaf;
+
+    return n;
+}
+
+static void get_entry(const btree_node *n, int i, struct btree_entry *e)
+{
+    e->prefix = n->prefixes[i];
+    e->key = n->keys[i];
+    e->data = n->data[i];
+}
+
+static void set_entry(btree_node *n, int i, const struct btree_entry *e)
+{
+    n->prefixes[i] = e->prefix;
+    n->keys[i] = e->key;
+    n->data[i] = e->data;
+}
+
+/* moves cnt entries (and cnt + 1 children around them for inner nodes)
+ * from src starting at src_i to dst starting at dst_i */
+static void move_entries(btree_node *dst, int dst_i,
+        const btree_node *src, int src_i, int cnt)
+{
+    memmove(dst->prefixes + dst_i, src->prefixes + src_i,
+            cnt * sizeof(*dst->prefixes));
+    memmove(dst->keys + dst_i, src->keys + src_i, cnt * sizeof(*dst->keys));
+    memmove(dst->data + dst_i, src->data + src_i, cnt * sizeof(*dst->data));
+
+    if (!src->is_leaf) {
+        memmove(dst->children + dst_i, src->children + src_i,
+                (cnt + 1) * sizeof(*dst->children));
+    }
+}
+
+/* makes a gap at index i, the child to the right of it is moved too */
+static void insert_gap(btree_node *n, int i)
+{
+    if (!n->is_leaf) {
+        memmove(n->children + i + 2, n->children + i + 1,
+                (n->key_cnt - i) * sizeof(*n->children));
+    }
+
+    memmove(n->prefixes + i + 1, n->prefixes + i,
+            (n->key_cnt - i) * sizeof(*n->prefixes));
+    memmove(n->keys + i + 1, n->keys + i, (n->key_cnt - i) * sizeof(*n->keys));
+    memmove(n->data + i + 1, n->data + i, (n->key_cnt - i) * sizeof(*n->data));
+    n->key_cnt++;
+}
+
+/* removes the entry at index i along with the child to the right of it */
+static void remove_at(btree_node *n, int i)
+{
+    n->key_cnt--;
+
+    memmove(n->prefixes + i, n->prefixes + i + 1,
+            (n->key_cnt - i) * sizeof(*n->prefixes));
+    memmove(n->keys + i, n->keys + i + 1, (n->key_cnt - i) * sizeof(*n->keys));
+    memmove(n->data + i, n->data + i + 1, (n->key_cnt - i) * sizeof(*n->data));
+
+    if (!n->is_leaf) {
+        memmove(n->children + i + 1, n->children + i + 2,
+                (n->key_cnt - i) * sizeof(*n->children));
+    }
+}
+
+/* Insertion */
+
+/* splits the full i-th child of x in halves around its median, which
+ * goes up into x */
+static void split_child(btree_node *x, int i)
+{
+    btree_node *y, *z;
+    struct btree_entry median;
+
+    y = x->children[i];
+    z = create_node(y->is_leaf);
+
+    z->key_cnt = btree_min_degree - 1;
+    move_entries(z, 0, y, btree_min_degree, z->key_cnt);
+    y->key_cnt = btree_min_degree - 1;
+
+    get_entry(y, btree_min_degree - 1, &median);
+    insert_gap(x, i);
+    set_entry(x, i, &median);
+    x->children[i+1] = z;
+}
+
+/* returns 0 if the key is already there */
+static int insert_nonfull(btree_node *x, const struct btree_entry *e)
+{
+    int i, found;
+
+    for (;;) {
+        i = node_search(x, e->prefix, e->key, &found);
+        if (found)
+            return 0;
+
+        if (x->is_leaf)
+            break;
+
+        if (x->children[i]->key_cnt == btree_max_keys) {
+            split_child(x, i);
+
+            /* the median that came up may be the key itself */
+            i = node_search(x, e->prefix, e->key, &found);
+            if (found)
+                return 0;
+        }
+
+        x = x->children[i];
+    }
+
+    insert_gap(x, i);
+    set_entry(x, i, e);
+    return 1;
+}
+
+/* Deletion */
+
+/* merges the i-th child of x, the i-th key and the (i+1)-th child */
+static void merge_children(btree_node *x, int i)
+{
+    btree_node *c, *s;
+    struct btree_entry e;
+
+    c = x->children[i];
+    s = x->children[i+1];
+
+    get_entry(x, i, &e);
+    set_entry(c, c->key_cnt, &e);
+    move_entries(c, c->key_cnt + 1, s, 0, s->key_cnt);
+    c->key_cnt += s->key_cnt + 1;
+
+    remove_at(x, i);
+    free(s);
+}
+
+/* the i-th child of x has the minimum amount of keys, borrow one from
+ * a sibling through x, or merge it with a sibling if they are minimal
+ * too. Returns the index of the child that now holds its keys. */
+static int fill_child(btree_node *x, int i)
+{
+    btree_node *c, *s;
+    struct btree_entry e;
+
+    c = x->children[i];
+
+    if (i > 0 && x->children[i-1]->key_cnt >= btree_min_degree) {
+        s = x->children[i-1];
+
+        insert_gap(c, 0);
+        if (!c->is_leaf) {
+            c->children[1] = c->children[0];
+            c->children[0] = s->children[s->key_cnt];
+        }
+        get_entry(x, i-1, &e);
+        set_entry(c, 0, &e);
+        get_entry(s, s->key_cnt - 1, &e);
+        set_entry(x, i-1, &e);
+        s->key_cnt--;
+
+        return i;
+    }
+
+    if (i < x->key_cnt && x->children[i+1]->key_cnt >= btree_min_degree) {
+        s = x->children[i+1];
+
+        get_entry(x, i, &e);
+        set_entry(c, c->key_cnt, &e);
+        c->key_cnt++;
+        if (!c->is_leaf)
+            c->children[c->key_cnt] = s->children[0];
+        get_entry(s, 0, &e);
+        set_entry(x, i, &e);
+
+        if (!s->is_leaf)
+            s->children[0] = s->children[1];
+        remove_at(s, 0);
+
+        return i;
+    }
+
+    /* merge with the right sibling, or the left one for the last child */
+    if (i == x->key_cnt)
+        i--;
+
+    merge_children(x, i);
+    return i;
+}
+
+/* Removes the key from the subtree of x, which has more than the minimum
+ * amount of keys (or is the root), and returns the removed entry in *out
+ * without freeing anything. */
+static int remove_entry(btree_node *x, uint64_t prefix, const char *key,
+        struct btree_entry *out)
+{
+    btree_node *y, *z;
+    struct btree_entry e;
+    int i, found;
+
+    i = node_search(x, prefix, key, &found);
+
+    if (found && x->is_leaf) {
+        get_entry(x, i, out);
+        remove_at(x, i);
+        return 1;
+    }
+
+    if (found) {
+        y = x->children[i];
+        z = x->children[i+1];
+
+        /* replace with the predecessor or the successor, whichever side
+         * can spare a key, and remove that from below */
+        if (y->key_cnt >= btree_min_degree || z->key_cnt >= btree_min_degree) {
+            get_entry(x, i, out);
+
+            if (y->key_cnt >= btree_min_degree) {
+                while (!y->is_leaf)
+                    y = y->children[y->key_cnt];
+                get_entry(y, y->key_cnt - 1, &e);
+                remove_entry(x->children[i], e.prefix, e.key, &e);
+            } else {
+                while (!z->is_leaf)
+                    z = z->children[0];
+                get_entry(z, 0, &e);
+                remove_entry(x->children[i+1], e.prefix, e.key, &e);
+            }
+
+            set_entry(x, i, &e);
+            return 1;
+        }
+
+        /* both minimal: the key goes down into the merged child */
+        merge_children(x, i);
+        return remove_entry(x->children[i], prefix, key, out);
+    }
+
+    if (x->is_leaf)
+        return 0;
+
+    if (x->children[i]->key_cnt < btree_min_degree)
+        i = fill_child(x, i);
+
+    return remove_entry(x->children[i], prefix, key, out);
+}
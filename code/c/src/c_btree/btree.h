@@ -0,0 +1,43 @@
+/* btree/btree.h */
+#ifndef BTREE_SENTRY
+#define BTREE_SENTRY
+
+#include <stdint.h>
+
+/* inteface for the B-tree-based dictionary with string keys and anything
+ * in data, for when lookups dominate. It has the operations of rbtree.h,
+ * but the elements are not nodes of their own, so btree_get_element tells
+ * whether the key is there and hands the data out, instead of returning
+ * the element as rbtree_get_element does.
+ *
+ * As in the rbtree, the key strings are copied when adding elements, and
+ * the data is just passed by reference.
+ *
+ * A node holds up to btree_max_keys keys, so a lookup in a million keys
+ * visits 6 nodes instead of 20+. For each key the node also stores its
+ * first 8 bytes as a big-endian integer in a separate array, so the
+ * search inside a node scans two cache lines of integers, and only goes
+ * to the key string when the prefixes are equal. */
+
+enum {
+    btree_min_degree = 8,
+    btree_max_keys = 2 * btree_min_degree - 1
+};
+
+typedef struct tag_btree_node {
+    uint64_t prefixes[btree_max_keys];
+    int key_cnt, is_leaf;
+    char *keys[btree_max_keys];
+    void *data[btree_max_keys];
+    struct tag_btree_node *children[btree_max_keys + 1];
+} btree_node;
+
+/* returns 1 and puts the element data into *data (if not NULL) if the key
+ * is in the tree, 0 else */
+int btree_get_element(const btree_node *root, const char *key, void **data);
+int btree_add_element(btree_node **root, const char *key, void *data);
+int btree_remove_element(btree_node **root, const char *key);
+void btree_print(const btree_node *root);
+void btree_destroy(btree_node *root);
+
+#endif
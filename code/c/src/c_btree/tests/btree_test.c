@@ -0,0 +1,220 @@
+/* btree/tests/btree_test.c */
+#include "../btree.c"
+#include "../../c_rbtree/tests/test_rng.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This program checks the B-tree against a reference: a fixed set of
+ * keys, each with a flag telling whether it must be in the tree, random
+ * adds, gets and removes are done on both, with every answer checked.
+ *
+ * Every so often the whole tree is checked: the key counts of the nodes
+ * (at least btree_min_degree - 1 but in the root), the leaves all at the
+ * same depth, the keys in order within their bounds, the prefixes of the
+ * keys, and every key of the set found with its data. The ops go in
+ * phases that fill the tree and empty it, so it grows and shrinks by
+ * levels again and again, and the removes go through all the paths of
+ * remove_entry and fill_child: borrowing from the left and the right
+ * sibling, merging, replacing an inner key with its predecessor or
+ * successor, and the root collapsing after the merge of its last two
+ * children. At the end the tree is drained in random order, checked
+ * after every remove.
+ *
+ * Some keys are shorter than the 8 byte prefix, some share it and only
+ * differ in the tail.
+ *
+ * Build:
+ *   gcc -O2 btree_test.c -o btree_test.out
+ *
+ * Usage: ./btree_test.out [ops] [seed], returns 0 if all the answers and
+ * checks were right, 1 else. */
+
+enum {
+    key_cnt = 3000,
+    key_size = 24,
+    phase_ops = 4 * key_cnt,
+    check_every = 500
+};
+
+static char keys[key_cnt][key_size];
+static unsigned char present[key_cnt];
+static int present_cnt;
+
+static void make_keys(void)
+{
+    int i;
+
+    for (i = 0; i < key_cnt; i++) {
+        switch (i % 3) {
+            case 0:
+                sprintf(keys[i], "%d", i);
+                break;
+            case 1:
+                sprintf(keys[i], "same8byt%d", i);
+                break;
+            default:
+                sprintf(keys[i], "k%07dlonger", i);
+                break;
+        }
+    }
+}
+
+/* Checks */
+
+/* the number of keys in the subtree of n, -1 if it breaks a property,
+ * lo and hi are the bounds of its keys (NULL if none) */
+static int check_node(const btree_node *n, const char *lo, const char *hi,
+        int depth, int *leaf_depth, int is_root)
+{
+    int cnt, sub, i;
+
+    if (n->key_cnt > btree_max_keys ||
+            n->key_cnt < (is_root ? 1 : btree_min_degree - 1))
+        return -1;
+
+    for (i = 0; i < n->key_cnt; i++) {
+        if (n->prefixes[i] != key_prefix(n->keys[i]))
+            return -1;
+        if ((i > 0 && strcmp(n->keys[i-1], n->keys[i]) >= 0) ||
+                (lo && strcmp(lo, n->keys[i]) >= 0) ||
+                (hi && strcmp(n->keys[i], hi) >= 0))
+            return -1;
+    }
+
+    if (n->is_leaf) {
+        if (*leaf_depth < 0)
+            *leaf_depth = depth;
+        return depth == *leaf_depth ? n->key_cnt : -1;
+    }
+
+    cnt = n->key_cnt;
+    for (i = 0; i <= n->key_cnt; i++) {
+        sub = check_node(n->children[i], i > 0 ? n->keys[i-1] : lo,
+                i < n->key_cnt ? n->keys[i] : hi, depth + 1, leaf_depth, 0);
+        if (sub < 0)
+            return -1;
+        cnt += sub;
+    }
+
+    return cnt;
+}
+
+static int check_all(const btree_node *root)
+{
+    void *data;
+    int leaf_depth = -1, k;
+
+    if (root && check_node(root, NULL, NULL, 0, &leaf_depth, 1) !=
+            present_cnt)
+        return 0;
+    if (!root && present_cnt)
+        return 0;
+
+    for (k = 0; k < key_cnt; k++) {
+        data = NULL;
+        if (btree_get_element(root, keys[k], &data) != present[k])
+            return 0;
+        if (present[k] && data != keys[k])
+            return 0;
+    }
+
+    return 1;
+}
+
+/* Random operations */
+
+/* the ops go in phases of mostly adds and mostly removes, long enough
+ * to fill the tree and to empty it about */
+static int random_op(btree_node **root, long op)
+{
+    void *data = NULL;
+    int k = rng_next() % key_cnt, kind, res;
+
+    kind = rng_next() % 4 == 0;
+    if (op / phase_ops % 2)
+        kind = !kind;
+    if (rng_next() % 4 == 0)
+        kind = 2;
+
+    if (kind == 0) {
+        res = btree_add_element(root, keys[k], keys[k]);
+        if (res != !present[k])
+            return 0;
+        present_cnt += res;
+        present[k] = 1;
+        return 1;
+    }
+
+    if (kind == 1) {
+        res = btree_remove_element(root, keys[k]);
+        if (res != present[k])
+            return 0;
+        present_cnt -= res;
+        present[k] = 0;
+        return 1;
+    }
+
+    res = btree_get_element(*root, keys[k], &data);
+    return res == present[k] && (!res || data == keys[k]);
+}
+
+static int drain(btree_node **root)
+{
+    static int order[key_cnt];
+    int i, j, tmp;
+
+    for (i = 0; i < key_cnt; i++)
+        order[i] = i;
+    for (i = key_cnt - 1; i > 0; i--) {
+        j = rng_next() % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    for (i = 0; i < key_cnt; i++) {
+        if (!present[order[i]])
+            continue;
+        if (!btree_remove_element(root, keys[order[i]]))
+            return 0;
+        present[order[i]] = 0;
+        present_cnt--;
+        if (!check_all(*root))
+            return 0;
+    }
+
+    return *root == NULL;
+}
+
+int main(int argc, char **argv)
+{
+    btree_node *root = NULL;
+    long ops = 1000000, i;
+
+    if (argc > 1)
+        ops = atol(argv[1]);
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    if (!rng_state)
+        rng_state = 1;
+
+    make_keys();
+
+    for (i = 0; i < ops; i++) {
+        if (!random_op(&root, i)) {
+            printf("failed: wrong answer at op %ld\n", i);
+            return 1;
+        }
+        if (i % check_every == 0 && !check_all(root)) {
+            printf("failed: check at op %ld\n", i);
+            return 1;
+        }
+    }
+
+    if (!drain(&root)) {
+        printf("failed: check while draining\n");
+        return 1;
+    }
+
+    printf("ok\n");
+    return 0;
+}
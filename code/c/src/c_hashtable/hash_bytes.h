@@ -0,0 +1,40 @@
+/* hashtable/hash_bytes.h */
+#ifndef HASH_BYTES_SENTRY
+#define HASH_BYTES_SENTRY
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* The hash of the hash table, also used by the token dict of the
+ * tokenizer (which takes the low 32 bits, for words that may hold '\0'):
+ * 8 bytes per step, finished with the murmur3 finalizer, so that both
+ * the low bits and the high ones are well mixed. */
+
+static uint64_t hash_bytes(const char *s, size_t n)
+{
+    uint64_t h, w;
+
+    h = n * 0x9e3779b97f4a7c15ULL;
+
+    for (; n >= 8; s += 8, n -= 8) {
+        memcpy(&w, s, 8);
+        h = (h ^ (w * 0x87c37b91114253d5ULL)) * 0x4cf5ad432745937fULL;
+        h = (h << 31) | (h >> 33);
+    }
+
+    if (n > 0) {
+        w = 0;
+        memcpy(&w, s, n);
+        h = (h ^ (w * 0x87c37b91114253d5ULL)) * 0x4cf5ad432745937fULL;
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+#endif
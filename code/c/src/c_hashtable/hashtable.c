@@ -0,0 +1,373 @@
+/* hashtable/hashtable.c */
+#include "hashtable.h"
+#include "hash_bytes.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Swiss table implementation, with the probing done over aligned groups
+ * of control bytes: the groups are visited in triangular order (pos +=
+ * 1, 2, 3... groups), which visits every group of a power of 2 table. A
+ * lookup stops at the first group with an empty slot, so the table is
+ * never filled over 7/8.
+ *
+ * Control bytes: 0xxxxxxx -- full, the low 7 bits of the hash
+ *                10000000 -- empty
+ *                11111110 -- deleted, a probe must go on past it
+ *
+ * A removed slot can be made empty (instead of deleted) when its group
+ * has another empty slot, as then no probe ever went past the group. */
+
+enum {
+    ctrl_empty = 0x80,
+    ctrl_deleted = 0xfe,
+#if defined(__AVX2__)
+    group_width = 32,
+#elif defined(__SSE2__)
+    group_width = 16,
+#else
+    group_width = 8,
+#endif
+    /* old slots moved per update while resizing, enough to be done with
+     * the old table long before the new one fills up */
+    move_batch = 2 * group_width
+};
+
+struct hashtable_slot {
+    uint64_t hash;
+    char *key;
+    void *data;
+};
+
+/* bit i set for every matching control byte i of a group */
+typedef uint32_t group_mask;
+
+/* API Impl and forward declarations */
+
+static struct hashtable_slot *find_slot(const hashtable_table *tab,
+        const char *key, uint64_t hash);
+static void insert_slot(hashtable_table *tab, uint64_t hash,
+        char *key, void *data);
+static void remove_slot(hashtable_table *tab, struct hashtable_slot *s);
+static void start_resize(hashtable *t);
+static void move_old_slots(hashtable *t, size_t cnt);
+static void free_table(hashtable_table *tab, int free_keys);
+
+void hashtable_init(hashtable *t)
+{
+    memset(t, 0, sizeof(*t));
+}
+
+int hashtable_get_element(const hashtable *t, const char *key, void **data)
+{
+    struct hashtable_slot *s;
+    uint64_t hash;
+
+    hash = hash_bytes(key, strlen(key));
+
+    s = find_slot(&t->cur, key, hash);
+    if (!s)
+        s = find_slot(&t->old, key, hash);
+
+    if (!s)
+        return 0;
+
+    if (data)
+        *data = s->data;
+    return 1;
+}
+
+int hashtable_add_element(hashtable *t, const char *key, void *data)
+{
+    uint64_t hash;
+    size_t len;
+    char *key_copy;
+
+    len = strlen(key);
+    hash = hash_bytes(key, len);
+
+    if (find_slot(&t->cur, key, hash) || find_slot(&t->old, key, hash))
+        return 0;
+
+    if (t->cur.used + 1 > t->cur.cap - t->cur.cap / 8)
+        start_resize(t);
+
+    key_copy = malloc(len + 1);
+    memcpy(key_copy, key, len + 1);
+
+    insert_slot(&t->cur, hash, key_copy, data);
+    t->size++;
+
+    move_old_slots(t, move_batch);
+    return 1;
+}
+
+int hashtable_remove_element(hashtable *t, const char *key)
+{
+    struct hashtable_slot *s;
+    uint64_t hash;
+
+    hash = hash_bytes(key, strlen(key));
+
+    if ((s = find_slot(&t->cur, key, hash)) != NULL)
+        remove_slot(&t->cur, s);
+    else if ((s = find_slot(&t->old, key, hash)) != NULL)
+        remove_slot(&t->old, s);
+    else
+        return 0;
+
+    t->size--;
+
+    move_old_slots(t, move_batch);
+    return 1;
+}
+
+void hashtable_destroy(hashtable *t)
+{
+    free_table(&t->cur, 1);
+    free_table(&t->old, 1);
+    hashtable_init(t);
+}
+
+/* Groups */
+
+#if defined(__AVX2__)
+
+static group_mask match_byte(const uint8_t *group, uint8_t b)
+{
+    __m256i ctrl = _mm256_loadu_si256((const __m256i *)group);
+    __m256i pattern = _mm256_set1_epi8(b);
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(ctrl, pattern));
+}
+
+/* empty and deleted are the only ones with the high bit set */
+static group_mask match_empty_or_deleted(const uint8_t *group)
+{
+    __m256i ctrl = _mm256_loadu_si256((const __m256i *)group);
+    return _mm256_movemask_epi8(ctrl);
+}
+
+#elif defined(__SSE2__)
+
+static group_mask match_byte(const uint8_t *group, uint8_t b)
+{
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(b)));
+}
+
+static group_mask match_empty_or_deleted(const uint8_t *group)
+{
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return _mm_movemask_epi8(ctrl);
+}
+
+#else
+
+static group_mask match_byte(const uint8_t *group, uint8_t b)
+{
+    group_mask m = 0;
+    int i;
+
+    for (i = 0; i < group_width; i++)
+        m |= (group_mask)(group[i] == b) << i;
+
+    return m;
+}
+
+static group_mask match_empty_or_deleted(const uint8_t *group)
+{
+    group_mask m = 0;
+    int i;
+
+    for (i = 0; i < group_width; i++)
+        m |= (group_mask)(group[i] >> 7) << i;
+
+    return m;
+}
+
+#endif
+
+static group_mask match_empty(const uint8_t *group)
+{
+    return match_byte(group, ctrl_empty);
+}
+
+static int lowest_bit(group_mask m)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(m);
+#else
+    int i = 0;
+
+    while (!(m & 1)) {
+        m >>= 1;
+        i++;
+    }
+
+    return i;
+#endif
+}
+
+/* Probing */
+
+static size_t probe_start(const hashtable_table *tab, uint64_t hash)
+{
+    size_t align_mask = ~(size_t)(group_width - 1);
+    return (size_t)(hash >> 7) & (tab->cap - 1) & align_mask;
+}
+
+static uint8_t hash_ctrl(uint64_t hash)
+{
+    return hash & 0x7f;
+}
+
+static struct hashtable_slot *find_slot(const hashtable_table *tab,
+        const char *key, uint64_t hash)
+{
+    struct hashtable_slot *s;
+    size_t pos, step = 0;
+    group_mask m;
+
+    if (!tab->cap)
+        return NULL;
+
+    pos = probe_start(tab, hash);
+
+    for (;;) {
+        for (m = match_byte(tab->ctrl + pos, hash_ctrl(hash)); m;
+                m &= m - 1)
+        {
+            s = &tab->slots[pos + lowest_bit(m)];
+            if (s->hash == hash && strcmp(s->key, key) == 0)
+                return s;
+        }
+
+        if (match_empty(tab->ctrl + pos))
+            return NULL;
+
+        step += group_width;
+        pos = (pos + step) & (tab->cap - 1);
+    }
+}
+
+/* puts a key known not to be in the table into the first free slot */
+static void insert_slot(hashtable_table *tab, uint64_t hash,
+        char *key, void *data)
+{
+    size_t pos, step = 0, i;
+    group_mask m;
+
+    pos = probe_start(tab, hash);
+
+    while (!(m = match_empty_or_deleted(tab->ctrl + pos))) {
+        step += group_width;
+        pos = (pos + step) & (tab->cap - 1);
+    }
+
+    i = pos + lowest_bit(m);
+    if (tab->ctrl[i] == ctrl_empty)
+        tab->used++;
+
+    tab->ctrl[i] = hash_ctrl(hash);
+    tab->slots[i].hash = hash;
+    tab->slots[i].key = key;
+    tab->slots[i].data = data;
+}
+
+static void remove_slot(hashtable_table *tab, struct hashtable_slot *s)
+{
+    size_t i, group;
+
+    i = s - tab->slots;
+    group = i & ~(size_t)(group_width - 1);
+
+    free(s->key);
+    s->key = NULL;
+
+    if (match_empty(tab->ctrl + group)) {
+        tab->ctrl[i] = ctrl_empty;
+        tab->used--;
+    } else
+        tab->ctrl[i] = ctrl_deleted;
+}
+
+/* Resizing */
+
+static void alloc_table(hashtable_table *tab, size_t cap)
+{
+    /* one block: the slots, then the control bytes */
+    tab->slots = malloc(cap * (sizeof(*tab->slots) + 1));
+    tab->ctrl = (uint8_t *)(tab->slots + cap);
+    memset(tab->ctrl, ctrl_empty, cap);
+    tab->cap = cap;
+    tab->used = 0;
+}
+
+static void free_table(hashtable_table *tab, int free_keys)
+{
+    size_t i;
+
+    if (free_keys) {
+        for (i = 0; i < tab->cap; i++) {
+            if (!(tab->ctrl[i] & 0x80))
+                free(tab->slots[i].key);
+        }
+    }
+
+    free(tab->slots);
+    memset(tab, 0, sizeof(*tab));
+}
+
+/* Makes a new current table and starts moving the elements into it. It
+ * doubles when the elements take more than half of the table, else the
+ * table is full of deleted slots and just gets cleaned at the same
+ * size. */
+static void start_resize(hashtable *t)
+{
+    size_t cap, live;
+
+    /* a resize still going on: finish it first */
+    if (t->old.cap)
+        move_old_slots(t, t->old.cap);
+
+    cap = t->cur.cap ? t->cur.cap : group_width;
+    live = t->size;
+    while (live + 1 > cap / 2)
+        cap *= 2;
+
+    t->old = t->cur;
+    t->move_pos = 0;
+    alloc_table(&t->cur, cap);
+}
+
+/* moves the next cnt old slots into the current table, the moved ones
+ * are marked deleted so the probes for the others still go past them */
+static void move_old_slots(hashtable *t, size_t cnt)
+{
+    struct hashtable_slot *s;
+    size_t end;
+
+    if (!t->old.cap)
+        return;
+
+    end = t->move_pos + cnt;
+    if (end > t->old.cap)
+        end = t->old.cap;
+
+    for (; t->move_pos < end; t->move_pos++) {
+        if (t->old.ctrl[t->move_pos] & 0x80)
+            continue;
+
+        s = &t->old.slots[t->move_pos];
+        insert_slot(&t->cur, s->hash, s->key, s->data);
+        t->old.ctrl[t->move_pos] = ctrl_deleted;
+    }
+
+    if (t->move_pos == t->old.cap)
+        free_table(&t->old, 0);
+}
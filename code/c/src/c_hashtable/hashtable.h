@@ -0,0 +1,56 @@
+/* hashtable/hashtable.h */
+#ifndef HASHTABLE_SENTRY
+#define HASHTABLE_SENTRY
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* inteface for the hash table dictionary with string keys and anything in
+ * data, for when nothing needs the key order. As in btree.h, the lookup
+ * tells whether the key is there and hands the data out, instead of
+ * returning the element as rbtree_get_element does.
+ *
+ * As in the rbtree, the key strings are copied when adding elements, and
+ * the data is just passed by reference.
+ *
+ * Open addressing, the way Swiss tables do it: next to the slots there is
+ * one control byte per slot, holding 7 bits of the key hash (or marking
+ * the slot empty/deleted), and a lookup matches a whole group of control
+ * bytes against the hash at once with SSE2 (16 slots) or AVX2 (32 slots)
+ * compares, depending on what the compiler targets. The group width is
+ * fixed when building, since the probes are aligned to it: unlike the
+ * scanning in c_tokenizer/char_scan.c, nothing is picked at run time by
+ * what the cpu has, so the AVX2 groups need -mavx2 (or a -march with it).
+ * Every slot also keeps the full hash, so the key strings are only
+ * compared when the whole hash matches.
+ *
+ * Growing does not rehash everything at once: the new table is filled
+ * from the old one a few groups per update, lookups look into both
+ * meanwhile. So no single add pays for the whole resize. */
+
+struct hashtable_slot;
+
+typedef struct tag_hashtable_table {
+    struct hashtable_slot *slots;
+    uint8_t *ctrl;
+    size_t cap;  /* slots, a power of 2, 0 when not allocated */
+    size_t used; /* full and deleted slots */
+} hashtable_table;
+
+typedef struct tag_hashtable {
+    hashtable_table cur;
+    hashtable_table old; /* being moved into cur, while resizing */
+    size_t move_pos;     /* in old, everything before is moved */
+    size_t size;
+} hashtable;
+
+void hashtable_init(hashtable *t);
+
+/* returns 1 and puts the element data into *data (if not NULL) if the key
+ * is in the table, 0 else */
+int hashtable_get_element(const hashtable *t, const char *key, void **data);
+int hashtable_add_element(hashtable *t, const char *key, void *data);
+int hashtable_remove_element(hashtable *t, const char *key);
+void hashtable_destroy(hashtable *t);
+
+#endif
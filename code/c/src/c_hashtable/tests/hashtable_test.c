@@ -0,0 +1,335 @@
+/* hashtable/tests/hashtable_test.c */
+#include "../hashtable.c"
+#include "../../c_rbtree/tests/test_rng.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This program checks the hash table against a reference: a fixed set of
+ * keys, each with a flag telling whether it must be in the table, random
+ * adds, gets and removes are done on both, with every answer checked.
+ *
+ * Every so often, and after every op while a resize is going on, the
+ * whole table is checked: every key of the set found with its data (in
+ * the current or the old table, the counts of lookups answered by the old
+ * one are reported), the number of full slots of both tables, their used
+ * counts, the control bytes against the hashes, the load limit, and the
+ * rule of remove_slot: a group with a deleted slot has no empty one, or
+ * a removal there would have emptied the slot.
+ *
+ * Every eighth key shares the control byte and the probe start with the
+ * others of its kind for tables of up to 256 slots, so they pile up in
+ * the same groups, fill them and leave deleted slots behind. The ops go
+ * in phases that fill the table and empty it, with the table growing
+ * (and lookups going to the old one while it does). At the end the table
+ * is drained in random order.
+ *
+ * Then the cleaning at the same size: a new table of 256 slots is filled
+ * with those keys up to its load limit, most of them are removed, which
+ * leaves their slots deleted, and other keys are added until the table
+ * has to be rebuilt. With less than half of it live it must be rebuilt at
+ * the same size, the contents checked after every step.
+ *
+ * Build:
+ *   gcc -O2 hashtable_test.c -o hashtable_test.out
+ *
+ * Usage: ./hashtable_test.out [ops] [seed], returns 0 if all the answers
+ * and checks were right, 1 else. */
+
+enum {
+    key_cnt = 3000,
+    key_size = 32,
+    phase_ops = 4 * key_cnt,
+    check_every = 500,
+    /* the hash bits the clustered keys share: the control byte and the
+     * probe start up to 256 slots */
+    cluster_every = 8,
+    cluster_mask = 0x7fff,
+    clean_cap = 256
+};
+
+static char keys[key_cnt][key_size];
+static unsigned char present[key_cnt];
+static long present_cnt;
+
+static long grow_cnt, clean_cnt, old_hits;
+
+/* the clustered keys get the suffix that puts their hash there */
+static void make_keys(void)
+{
+    uint64_t target = 0;
+    long i, suffix;
+    size_t len;
+
+    for (i = 0; i < key_cnt; i++) {
+        len = sprintf(keys[i], "key%ld", i);
+        if (i % cluster_every)
+            continue;
+
+        for (suffix = 0;; suffix++) {
+            sprintf(keys[i] + len, "-%ld", suffix);
+            if (i == 0)
+                target = hash_bytes(keys[i], strlen(keys[i])) & cluster_mask;
+            if ((hash_bytes(keys[i], strlen(keys[i])) & cluster_mask) ==
+                    target)
+                break;
+        }
+    }
+}
+
+/* Checks */
+
+/* the full slots of the table, -1 if its control bytes break a rule */
+static long check_ctrl(const hashtable_table *tab, int is_cur)
+{
+    size_t i, g, used = 0;
+    long full = 0;
+    int has_empty, has_deleted;
+
+    for (g = 0; g < tab->cap; g += group_width) {
+        has_empty = has_deleted = 0;
+        for (i = g; i < g + group_width; i++) {
+            if (tab->ctrl[i] == ctrl_empty) {
+                has_empty = 1;
+                continue;
+            }
+            used++;
+            if (tab->ctrl[i] == ctrl_deleted) {
+                has_deleted = 1;
+                continue;
+            }
+            if (tab->ctrl[i] & 0x80 ||
+                    tab->ctrl[i] != hash_ctrl(tab->slots[i].hash) ||
+                    tab->slots[i].hash != hash_bytes(tab->slots[i].key,
+                        strlen(tab->slots[i].key)))
+                return -1;
+            full++;
+        }
+
+        /* the old table marks the slots it moved deleted */
+        if (is_cur && has_empty && has_deleted)
+            return -1;
+    }
+
+    if (used != tab->used)
+        return -1;
+    if (is_cur && tab->cap && used > tab->cap - tab->cap / 8)
+        return -1;
+
+    return full;
+}
+
+static int check_all(const hashtable *t)
+{
+    void *data;
+    long cur_full, old_full, k;
+    uint64_t hash;
+
+    cur_full = check_ctrl(&t->cur, 1);
+    old_full = check_ctrl(&t->old, 0);
+    if (cur_full < 0 || old_full < 0 || cur_full + old_full != present_cnt ||
+            t->size != (size_t)present_cnt)
+        return 0;
+
+    for (k = 0; k < key_cnt; k++) {
+        data = NULL;
+        if (hashtable_get_element(t, keys[k], &data) != present[k])
+            return 0;
+        if (!present[k])
+            continue;
+        if (data != keys[k])
+            return 0;
+
+        /* in just one of the tables */
+        hash = hash_bytes(keys[k], strlen(keys[k]));
+        if (find_slot(&t->old, keys[k], hash)) {
+            if (find_slot(&t->cur, keys[k], hash))
+                return 0;
+            old_hits++;
+        }
+    }
+
+    return 1;
+}
+
+/* Random operations */
+
+/* the ops go in phases of mostly adds and mostly removes, long enough
+ * to fill the table and to empty it about */
+static int random_op(hashtable *t, long op)
+{
+    void *data = NULL;
+    long k = rng_next() % key_cnt;
+    int kind, res;
+
+    kind = rng_next() % 4 == 0;
+    if (op / phase_ops % 2)
+        kind = !kind;
+    if (rng_next() % 4 == 0)
+        kind = 2;
+
+    if (kind == 0) {
+        res = hashtable_add_element(t, keys[k], keys[k]);
+        if (res != !present[k])
+            return 0;
+        present_cnt += res;
+        present[k] = 1;
+        return 1;
+    }
+
+    if (kind == 1) {
+        res = hashtable_remove_element(t, keys[k]);
+        if (res != present[k])
+            return 0;
+        present_cnt -= res;
+        present[k] = 0;
+        return 1;
+    }
+
+    res = hashtable_get_element(t, keys[k], &data);
+    return res == present[k] && (!res || data == keys[k]);
+}
+
+/* a new current table is a resize, at the same size a cleaning */
+static void count_resize(const hashtable *t,
+        const struct hashtable_slot *slots, size_t cap)
+{
+    if (t->cur.slots == slots || !cap)
+        return;
+
+    if (t->cur.cap == cap)
+        clean_cnt++;
+    else
+        grow_cnt++;
+}
+
+static int drain(hashtable *t)
+{
+    static long order[key_cnt];
+    long i, j, tmp;
+
+    for (i = 0; i < key_cnt; i++)
+        order[i] = i;
+    for (i = key_cnt - 1; i > 0; i--) {
+        j = rng_next() % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    for (i = 0; i < key_cnt; i++) {
+        if (!present[order[i]])
+            continue;
+        if (!hashtable_remove_element(t, keys[order[i]]))
+            return 0;
+        present[order[i]] = 0;
+        present_cnt--;
+        if (i % 16 == 0 && !check_all(t))
+            return 0;
+    }
+
+    return t->size == 0 && check_all(t);
+}
+
+static int add_key(hashtable *t, long k)
+{
+    struct hashtable_slot *slots = t->cur.slots;
+    size_t cap = t->cur.cap;
+
+    if (!hashtable_add_element(t, keys[k], keys[k]))
+        return 0;
+
+    present[k] = 1;
+    present_cnt++;
+    count_resize(t, slots, cap);
+    return check_all(t);
+}
+
+static int run_cleaning(hashtable *t)
+{
+    long k, cleaned = clean_cnt;
+
+    /* up to the load limit: the next add needs a new table */
+    for (k = 0; k < key_cnt; k += cluster_every) {
+        if (t->cur.cap == clean_cap && !t->old.cap &&
+                t->cur.used + 1 > t->cur.cap - t->cur.cap / 8)
+            break;
+        if (!add_key(t, k))
+            return 0;
+    }
+    if (t->cur.cap != clean_cap || k >= key_cnt)
+        return 0;
+
+    /* the groups they filled keep their slots deleted */
+    while (t->size > clean_cap * 3 / 8) {
+        k = rng_next() % (key_cnt / cluster_every) * cluster_every;
+        if (!present[k])
+            continue;
+        if (!hashtable_remove_element(t, keys[k]))
+            return 0;
+        present[k] = 0;
+        present_cnt--;
+        if (!check_all(t))
+            return 0;
+    }
+
+    /* till the rebuild is over */
+    for (k = 1; clean_cnt == cleaned || t->old.cap; k++) {
+        if (k % cluster_every == 0)
+            continue;
+        if (k >= key_cnt || !add_key(t, k))
+            return 0;
+    }
+
+    return t->cur.cap == clean_cap;
+}
+
+int main(int argc, char **argv)
+{
+    struct hashtable_slot *slots;
+    hashtable t;
+    long ops = 300000, i;
+    size_t cap;
+
+    if (argc > 1)
+        ops = atol(argv[1]);
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    if (!rng_state)
+        rng_state = 1;
+
+    make_keys();
+    hashtable_init(&t);
+
+    for (i = 0; i < ops; i++) {
+        slots = t.cur.slots;
+        cap = t.cur.cap;
+
+        if (!random_op(&t, i)) {
+            printf("failed: wrong answer at op %ld\n", i);
+            return 1;
+        }
+        count_resize(&t, slots, cap);
+
+        if ((t.old.cap || i % check_every == 0) && !check_all(&t)) {
+            printf("failed: check at op %ld\n", i);
+            return 1;
+        }
+    }
+
+    if (!drain(&t)) {
+        printf("failed: check while draining\n");
+        return 1;
+    }
+
+    hashtable_destroy(&t);
+    hashtable_init(&t);
+    if (!run_cleaning(&t)) {
+        printf("failed: cleaning at the same size\n");
+        return 1;
+    }
+
+    hashtable_destroy(&t);
+
+    printf("%ld resizes growing, %ld at the same size, %ld lookups in the "
+            "old table\nok\n", grow_cnt, clean_cnt, old_hits);
+    return 0;
+}
@@ -0,0 +1,173 @@
+/* rbtree/intrusive_rbtree.c */
+#include "intrusive_rbtree.h"
+
+/* The balancing cases are those of rbtree.c, the same rbtree_balance.h
+ * on links instead of nodes. The only real difference is removal:
+ * elements are not ours to move keys between, so the predecessor is
+ * relinked into the place of the removed element instead. */
+
+/* API Impl and forward declarations */
+
+irb_link *irb_find(irb_link *root, const void *key, irb_key_compare cmp)
+{
+    int comp_res;
+
+    while (root) {
+        comp_res = cmp(key, root);
+
+        if (comp_res == 0)
+            return root;
+
+        root = comp_res < 0 ? root->left : root->right;
+    }
+
+    return NULL;
+}
+
+irb_link *irb_insert(irb_link **root, irb_link *n, irb_compare cmp)
+{
+    irb_link **where = root, *parent = NULL;
+    int comp_res;
+
+    while (*where) {
+        comp_res = cmp(*where, n);
+
+        if (comp_res == 0)
+            return *where;
+
+        parent = *where;
+        where = comp_res > 0 ? &parent->left : &parent->right;
+    }
+
+    irb_link_node(n, parent, where);
+    irb_insert_fixup(n, root);
+
+    return NULL;
+}
+
+static void insert_case_1(irb_link *n, irb_link **root);
+
+void irb_link_node(irb_link *n, irb_link *parent, irb_link **where)
+{
+    n->left = n->right = NULL;
+    n->parent = parent;
+    n->color = red;
+    *where = n;
+}
+
+void irb_insert_fixup(irb_link *n, irb_link **root)
+{
+    insert_case_1(n, root);
+}
+
+static void replace_in_parent(irb_link *n, irb_link *repl, irb_link **root);
+static void delete_case_1(irb_link *n, irb_link* parent, irb_link **root);
+
+void irb_remove(irb_link **root, irb_link *n)
+{
+    irb_link *repl, *c, *parent;
+    node_color old_color;
+
+    if (n->left && n->right) {
+        repl = irb_last(n->left);
+
+        /* the predecessor has no right child, its left one takes its
+         * place, and it takes the place (and color) of n */
+        c = repl->left;
+        parent = repl->parent;
+        old_color = repl->color;
+
+        if (parent == n)
+            parent = repl;
+        else {
+            parent->right = c;
+            if (c)
+                c->parent = parent;
+
+            repl->left = n->left;
+            repl->left->parent = repl;
+        }
+
+        repl->right = n->right;
+        repl->right->parent = repl;
+        replace_in_parent(n, repl, root);
+        repl->color = n->color;
+    } else {
+        c = n->left ? n->left : n->right;
+        parent = n->parent;
+        old_color = n->color;
+
+        replace_in_parent(n, c, root);
+    }
+
+    if (old_color == black)
+        delete_case_1(c, parent, root);
+}
+
+irb_link *irb_first(irb_link *root)
+{
+    if (root) {
+        while (root->left)
+            root = root->left;
+    }
+
+    return root;
+}
+
+irb_link *irb_last(irb_link *root)
+{
+    if (root) {
+        while (root->right)
+            root = root->right;
+    }
+
+    return root;
+}
+
+irb_link *irb_next(irb_link *n)
+{
+    if (!n)
+        return NULL;
+
+    if (n->right)
+        return irb_first(n->right);
+
+    while (n->parent && n == n->parent->right)
+        n = n->parent;
+
+    return n->parent;
+}
+
+irb_link *irb_prev(irb_link *n)
+{
+    if (!n)
+        return NULL;
+
+    if (n->left)
+        return irb_last(n->left);
+
+    while (n->parent && n == n->parent->left)
+        n = n->parent;
+
+    return n->parent;
+}
+
+/* General data structure utility functions */
+
+/* puts repl (possibly null) where n hangs */
+static void replace_in_parent(irb_link *n, irb_link *repl, irb_link **root)
+{
+    if (repl)
+        repl->parent = n->parent;
+
+    if (!n->parent)
+        *root = repl;
+    else if (n == n->parent->left)
+        n->parent->left = repl;
+    else
+        n->parent->right = repl;
+}
+
+#define RB_NODE irb_link
+#define RB_ROTATED(n)
+#include "rbtree_balance.h"
@@ -0,0 +1,92 @@
+/* rbtree/intrusive_rbtree.h */
+#ifndef INTRUSIVE_RBTREE_SENTRY
+#define INTRUSIVE_RBTREE_SENTRY
+
+#include "rbtree.h"
+
+#include <stddef.h>
+
+/* inteface for the intrusive red-black tree, for any key type.
+ *
+ * The tree does not own or allocate anything: the user embeds an irb_link
+ * into their own struct, and gets the struct back from a link with
+ * irb_entry. So inserting is just linking, and the keys and the data live
+ * wherever the user keeps them.
+ *
+ * Either use the functions below with a compare callback, or generate
+ * a version specialized for one type with IRB_GENERATE, in which the
+ * compare is inlined into the descents. The balancing is shared.
+ *
+ * Compare functions return the sign of (a - b). */
+
+typedef struct tag_irb_link {
+    struct tag_irb_link *left, *right, *parent;
+    unsigned char color; /* node_color */
+} irb_link;
+
+#define irb_entry(link, type, member) \
+    ((type *)((char *)(link) - offsetof(type, member)))
+
+typedef int (*irb_compare)(const irb_link *a, const irb_link *b);
+/* compares a search key with a key in the tree */
+typedef int (*irb_key_compare)(const void *key, const irb_link *n);
+
+irb_link *irb_find(irb_link *root, const void *key, irb_key_compare cmp);
+/* returns NULL if n was linked in, or the link with an equal key */
+irb_link *irb_insert(irb_link **root, irb_link *n, irb_compare cmp);
+/* unlinks n, which must be in the tree */
+void irb_remove(irb_link **root, irb_link *n);
+
+irb_link *irb_first(irb_link *root);
+irb_link *irb_last(irb_link *root);
+irb_link *irb_next(irb_link *n);
+irb_link *irb_prev(irb_link *n);
+
+/* The building blocks for custom descents: attach n as a leaf at *where
+ * under parent, then rebalance. */
+void irb_link_node(irb_link *n, irb_link *parent, irb_link **where);
+void irb_insert_fixup(irb_link *n, irb_link **root);
+
+/* Generates name_find(root, key), name_insert(root, elem) and
+ * name_remove(root, elem) for structs of type with the link in member,
+ * compared with cmp(const type *a, const type *b), a function or macro.
+ * find takes a struct with just the key filled in. */
+#define IRB_GENERATE(name, type, member, cmp)                               \
+static inline type *name##_find(irb_link *root, const type *key)            \
+{                                                                           \
+    int comp_res;                                                           \
+                                                                            \
+    while (root) {                                                          \
+        comp_res = cmp(irb_entry(root, type, member), key);                 \
+        if (comp_res == 0)                                                  \
+            return irb_entry(root, type, member);                           \
+        root = comp_res > 0 ? root->left : root->right;                     \
+    }                                                                       \
+                                                                            \
+    return NULL;                                                            \
+}                                                                           \
+                                                                            \
+static inline type *name##_insert(irb_link **root, type *elem)              \
+{                                                                           \
+    irb_link **where = root, *parent = NULL;                                \
+    int comp_res;                                                           \
+                                                                            \
+    while (*where) {                                                        \
+        comp_res = cmp(irb_entry(*where, type, member), elem);              \
+        if (comp_res == 0)                                                  \
+            return irb_entry(*where, type, member);                         \
+        parent = *where;                                                    \
+        where = comp_res > 0 ? &parent->left : &parent->right;              \
+    }                                                                       \
+                                                                            \
+    irb_link_node(&elem->member, parent, where);                            \
+    irb_insert_fixup(&elem->member, root);                                  \
+    return NULL;                                                            \
+}                                                                           \
+                                                                            \
+static inline void name##_remove(irb_link **root, type *elem)               \
+{                                                                           \
+    irb_remove(root, &elem->member);                                        \
+}
+
+#endif
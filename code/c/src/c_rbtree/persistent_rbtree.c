@@ -0,0 +1,515 @@
+/* rbtree/persistent_rbtree.c */
+#include "persistent_rbtree.h"
+#include "rbtree.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The balancing is the same as in rbtree.c, done the way rcu_rbtree.c
+ * does it: no parent pointers, the path from the root is kept on a stack,
+ * and only the nodes made by the current update are changed in place,
+ * anything else is copied first, see own().
+ *
+ * The reference count of a node is the number of nodes pointing to it
+ * plus the number of version handles. All child pointer changes go
+ * through relink(), which keeps the counts. Within an update counts only
+ * drop to zero transiently (during rotations), so nothing is freed until
+ * prbtree_release. */
+
+struct tag_prbtree_node {
+    struct tag_prbtree_node *left, *right;
+    void *data;
+    atomic_int refs;
+    node_color color;
+    unsigned char fresh;
+    char key[];
+};
+
+/* enough for 2^64 elements, as the height is at most 2 * log2(n + 1) */
+enum { max_path_len = 130, max_fresh = 3 * max_path_len };
+
+/* state of one update in progress */
+struct update_op {
+    prbtree_node *root;
+    prbtree_node *path[max_path_len];
+    int path_len;
+    prbtree_node *fresh[max_fresh];
+    int fresh_cnt;
+};
+
+/* API Impl and forward declarations */
+
+int prbtree_get_element(const prbtree_node *root, const char *key,
+        void **data)
+{
+    int comp_res;
+
+    while (root) {
+        comp_res = strcmp(root->key, key);
+
+        if (comp_res == 0) {
+            if (data)
+                *data = root->data;
+            return 1;
+        }
+
+        root = comp_res > 0 ? root->left : root->right;
+    }
+
+    return 0;
+}
+
+static void begin_update(struct update_op *op, prbtree_node *root);
+static prbtree_node *commit_update(struct update_op *op);
+static int find_path(struct update_op *op, const char *key);
+static void copy_path(struct update_op *op, int len);
+static prbtree_node *create_node(struct update_op *op,
+        const char *key, void *data);
+static void relink(prbtree_node **field, prbtree_node *n);
+static void insert_fixup(struct update_op *op);
+static void remove_at_path_end(struct update_op *op);
+
+prbtree_node *prbtree_add_element(prbtree_node *root, const char *key,
+        void *data, int *added)
+{
+    struct update_op op;
+    prbtree_node *n, *parent;
+    int found;
+
+    begin_update(&op, root);
+
+    found = find_path(&op, key);
+    if (added)
+        *added = !found;
+    if (found)
+        return prbtree_snapshot(root);
+
+    copy_path(&op, op.path_len);
+
+    n = create_node(&op, key, data);
+    parent = op.path_len > 0 ? op.path[op.path_len - 1] : NULL;
+    if (!parent)
+        op.root = n;
+    else if (strcmp(parent->key, key) > 0)
+        relink(&parent->left, n);
+    else
+        relink(&parent->right, n);
+    op.path[op.path_len++] = n;
+
+    insert_fixup(&op);
+
+    return commit_update(&op);
+}
+
+prbtree_node *prbtree_remove_element(prbtree_node *root, const char *key,
+        int *removed)
+{
+    struct update_op op;
+    int found;
+
+    begin_update(&op, root);
+
+    found = find_path(&op, key);
+    if (removed)
+        *removed = found;
+    if (!found)
+        return prbtree_snapshot(root);
+
+    remove_at_path_end(&op);
+
+    return commit_update(&op);
+}
+
+prbtree_node *prbtree_snapshot(prbtree_node *root)
+{
+    if (root)
+        atomic_fetch_add(&root->refs, 1);
+
+    return root;
+}
+
+/* nodes have no parent pointers, so the walk keeps its own stack */
+void prbtree_release(prbtree_node *root)
+{
+    prbtree_node *stack[max_path_len], *n;
+    int top = 0;
+
+    if (root)
+        stack[top++] = root;
+
+    while (top > 0) {
+        n = stack[--top];
+
+        if (atomic_fetch_sub(&n->refs, 1) != 1)
+            continue;
+
+        if (n->left)
+            stack[top++] = n->left;
+        if (n->right)
+            stack[top++] = n->right;
+        free(n);
+    }
+}
+
+/* Memory functions */
+
+static prbtree_node *alloc_node(struct update_op *op, const char *key)
+{
+    prbtree_node *n;
+    size_t key_size;
+
+    key_size = (strlen(key) + 1) * sizeof(char);
+
+    n = malloc(sizeof(*n) + key_size);
+    memcpy(n->key, key, key_size);
+    atomic_init(&n->refs, 0);
+    n->fresh = 1;
+
+    op->fresh[op->fresh_cnt++] = n;
+
+    return n;
+}
+
+static prbtree_node *create_node(struct update_op *op,
+        const char *key, void *data)
+{
+    prbtree_node *n;
+
+    n = alloc_node(op, key);
+    n->data = data;
+    n->left = n->right = NULL;
+    n->color = red;
+
+    return n;
+}
+
+/* Pointer changes */
+
+static void relink(prbtree_node **field, prbtree_node *n)
+{
+    if (n)
+        atomic_fetch_add(&n->refs, 1);
+    if (*field)
+        atomic_fetch_sub(&(*field)->refs, 1);
+
+    *field = n;
+}
+
+/* the root of the update is not counted until it is returned */
+static void set_child(struct update_op *op, prbtree_node *parent,
+        prbtree_node *old, prbtree_node *new)
+{
+    if (!parent)
+        op->root = new;
+    else if (parent->left == old)
+        relink(&parent->left, new);
+    else
+        relink(&parent->right, new);
+}
+
+/* a copy of n under another key, holding references to the children */
+static prbtree_node *copy_node_with_key(struct update_op *op,
+        const prbtree_node *n, const char *key, void *data)
+{
+    prbtree_node *copy;
+
+    copy = alloc_node(op, key);
+    copy->data = data;
+    copy->left = copy->right = NULL;
+    copy->color = n->color;
+
+    relink(&copy->left, n->left);
+    relink(&copy->right, n->right);
+
+    return copy;
+}
+
+/* Makes n changeable by this update: returns n itself if this update
+ * created it, or else a copy put in place of n under the (already owned)
+ * parent. */
+static prbtree_node *own(struct update_op *op, prbtree_node *parent,
+        prbtree_node *n)
+{
+    prbtree_node *copy;
+
+    if (!n || n->fresh)
+        return n;
+
+    copy = copy_node_with_key(op, n, n->key, n->data);
+    set_child(op, parent, n, copy);
+
+    return copy;
+}
+
+/* Updates */
+
+static void begin_update(struct update_op *op, prbtree_node *root)
+{
+    op->root = root;
+    op->path_len = 0;
+    op->fresh_cnt = 0;
+}
+
+static prbtree_node *commit_update(struct update_op *op)
+{
+    int i;
+
+    for (i = 0; i < op->fresh_cnt; i++)
+        op->fresh[i]->fresh = 0;
+
+    return prbtree_snapshot(op->root);
+}
+
+/* Fills the path from the root to the node with the key (returns 1), or
+ * to the node under which it would be inserted (returns 0). */
+static int find_path(struct update_op *op, const char *key)
+{
+    prbtree_node *n;
+    int comp_res;
+
+    for (n = op->root; n; n = comp_res > 0 ? n->left : n->right) {
+        op->path[op->path_len++] = n;
+
+        comp_res = strcmp(n->key, key);
+        if (comp_res == 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+static void copy_path(struct update_op *op, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+        op->path[i] = own(op, i > 0 ? op->path[i-1] : NULL, op->path[i]);
+}
+
+/* General data structure utility functions */
+
+static int is_black(const prbtree_node *n)
+{
+    return !n || n->color == black;
+}
+
+static int is_red(const prbtree_node *n)
+{
+    return !is_black(n);
+}
+
+/* n, its right child and the parent of n must be owned */
+static void rotate_left(struct update_op *op, prbtree_node *n,
+        prbtree_node *parent)
+{
+    prbtree_node *pivot;
+
+    pivot = n->right;
+    set_child(op, parent, n, pivot);
+    relink(&n->right, pivot->left);
+    relink(&pivot->left, n);
+}
+
+/* n, its left child and the parent of n must be owned */
+static void rotate_right(struct update_op *op, prbtree_node *n,
+        prbtree_node *parent)
+{
+    prbtree_node *pivot;
+
+    pivot = n->left;
+    set_child(op, parent, n, pivot);
+    relink(&n->left, pivot->right);
+    relink(&pivot->right, n);
+}
+
+/* Insertion */
+
+/* The cases of rbtree.c as one loop, the new node is at the end of the
+ * (owned) path, parents and grandparents are taken from the path. */
+static void insert_fixup(struct update_op *op)
+{
+    prbtree_node *n, *p, *gp, *un, *ggp;
+    int i;
+
+    i = op->path_len - 1;
+
+    for (;;) {
+        n = op->path[i];
+
+        /* case 1 */
+        if (i == 0) {
+            n->color = black;
+            return;
+        }
+
+        p = op->path[i-1];
+        if (is_black(p))
+            return;
+
+        /* a red parent is never the root */
+        gp = op->path[i-2];
+
+        /* case 2 */
+        un = p == gp->left ? gp->right : gp->left;
+        if (is_red(un)) {
+            un = own(op, gp, un);
+            p->color = black;
+            un->color = black;
+            gp->color = red;
+            i -= 2;
+            continue;
+        }
+
+        /* case 3 */
+        if (p == gp->left && n == p->right) {
+            rotate_left(op, p, gp);
+            op->path[i-1] = n;
+            op->path[i] = p;
+        } else if (p == gp->right && n == p->left) {
+            rotate_right(op, p, gp);
+            op->path[i-1] = n;
+            op->path[i] = p;
+        }
+
+        /* case 4 */
+        n = op->path[i];
+        p = op->path[i-1];
+        ggp = i >= 3 ? op->path[i-3] : NULL;
+
+        p->color = black;
+        gp->color = red;
+        if (n == p->left && p == gp->left)
+            rotate_right(op, gp, ggp);
+        else
+            rotate_left(op, gp, ggp);
+
+        return;
+    }
+}
+
+/* Deletion */
+
+static void delete_fixup(struct update_op *op, prbtree_node *n,
+        int n_is_left, int parent_i);
+
+/* removes the node at the end of the path */
+static void remove_at_path_end(struct update_op *op)
+{
+    prbtree_node *n, *repl, *parent, *c, *copy;
+    int n_i, parent_i, is_left, i;
+
+    n_i = op->path_len - 1;
+    n = op->path[n_i];
+
+    /* with two children, the predecessor takes the place of the element
+     * and is removed instead */
+    if (n->left && n->right) {
+        for (repl = n->left; repl; repl = repl->right)
+            op->path[op->path_len++] = repl;
+    }
+
+    /* the node to unlink is left as is, only copy down to its parent, and
+     * the copy of the element gets the key of the predecessor right away,
+     * as the keys live in the nodes */
+    repl = op->path[op->path_len - 1];
+    for (i = 0; i < op->path_len - 1; i++) {
+        parent = i > 0 ? op->path[i-1] : NULL;
+
+        if (i == n_i) {
+            copy = copy_node_with_key(op, n, repl->key, repl->data);
+            set_child(op, parent, n, copy);
+            op->path[i] = copy;
+        } else
+            op->path[i] = own(op, parent, op->path[i]);
+    }
+
+    op->path_len--;
+    parent_i = op->path_len - 1;
+    parent = parent_i >= 0 ? op->path[parent_i] : NULL;
+
+    c = repl->left ? repl->left : repl->right;
+    is_left = parent && parent->left == repl;
+    set_child(op, parent, repl, c);
+
+    if (repl->color == black)
+        delete_fixup(op, c, is_left, parent_i);
+}
+
+/* The cases of rbtree.c as one loop, n (possibly null) is the child of
+ * the path node at parent_i, which is one black short on its side. */
+static void delete_fixup(struct update_op *op, prbtree_node *n,
+        int n_is_left, int parent_i)
+{
+    prbtree_node *parent, *gp, *s;
+
+    for (;;) {
+        parent = parent_i >= 0 ? op->path[parent_i] : NULL;
+
+        /* case 1 */
+        if (is_red(n)) {
+            n = own(op, parent, n);
+            n->color = black;
+            return;
+        }
+        if (!parent)
+            return;
+
+        gp = parent_i > 0 ? op->path[parent_i - 1] : NULL;
+
+        /* case 2 */
+        s = n_is_left ? parent->right : parent->left;
+        if (is_red(s)) {
+            s = own(op, parent, s);
+            s->color = black;
+            parent->color = red;
+            if (n_is_left)
+                rotate_left(op, parent, gp);
+            else
+                rotate_right(op, parent, gp);
+            gp = s;
+        }
+
+        /* case 3 */
+        s = n_is_left ? parent->right : parent->left;
+        if (is_black(s->left) && is_black(s->right)) {
+            s = own(op, parent, s);
+            s->color = red;
+            if (parent->color == red) {
+                parent->color = black;
+                return;
+            }
+
+            /* only when nothing was rotated, so the path is still valid */
+            n = parent;
+            n_is_left = gp && gp->left == parent;
+            parent_i--;
+            continue;
+        }
+
+        /* case 4 */
+        s = own(op, parent, s);
+        if (n_is_left && is_red(s->left) && is_black(s->right)) {
+            own(op, s, s->left)->color = black;
+            s->color = red;
+            rotate_right(op, s, parent);
+        } else if (!n_is_left && is_red(s->right) && is_black(s->left)) {
+            own(op, s, s->right)->color = black;
+            s->color = red;
+            rotate_left(op, s, parent);
+        }
+
+        /* case 5 */
+        s = n_is_left ? parent->right : parent->left;
+        s->color = parent->color;
+        parent->color = black;
+        if (n_is_left) {
+            own(op, s, s->right)->color = black;
+            rotate_left(op, parent, gp);
+        } else {
+            own(op, s, s->left)->color = black;
+            rotate_right(op, parent, gp);
+        }
+
+        return;
+    }
+}
@@ -0,0 +1,41 @@
+/* rbtree/persistent_rbtree.h */
+#ifndef PERSISTENT_RBTREE_SENTRY
+#define PERSISTENT_RBTREE_SENTRY
+
+/* inteface for the persistent version of the rbtree dictionary: every
+ * update makes a new version of the tree and leaves the old one intact.
+ *
+ * The new version shares all the untouched nodes with the old one, an
+ * update only copies the path it touches and the few siblings the
+ * balancing changes, so it allocates O(log n) nodes. A snapshot is just
+ * one more reference to the root, so it costs O(1).
+ *
+ * Nodes are reference counted. A version (root pointer) returned by any
+ * function here is a reference the caller owns, and must be given back
+ * with prbtree_release, which frees the nodes no other version uses.
+ * The empty tree is NULL.
+ *
+ * The counters are atomic, so versions may be read, updated and released
+ * on different threads, as long as every thread holds a reference to the
+ * version it works with. Keys are copied, data passed by reference, as in
+ * rbtree.h. */
+
+typedef struct tag_prbtree_node prbtree_node;
+
+/* returns 1 and puts the element data into *data (if not NULL) if the key
+ * is in the version, 0 else */
+int prbtree_get_element(const prbtree_node *root, const char *key,
+        void **data);
+
+/* Return the new version, added and removed (if not NULL) are set to
+ * tell if the key was added/removed. If nothing changed, the new version
+ * is the same root with one more reference. */
+prbtree_node *prbtree_add_element(prbtree_node *root, const char *key,
+        void *data, int *added);
+prbtree_node *prbtree_remove_element(prbtree_node *root, const char *key,
+        int *removed);
+
+prbtree_node *prbtree_snapshot(prbtree_node *root);
+void prbtree_release(prbtree_node *root);
+
+#endif
@@ -1,41 +1,116 @@
 /* rbtree/rbtree.c */
 #include "rbtree.h"
+#include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-/* Red-black tree implementation with recursion,
- * closely following the wiki page, but with no deletion. 
- * I might add it one day, but right now it is not essential. */
+/* Red-black tree implementation, closely following the wiki page.
+ * The descents and traversals are loops, only the balancing cases call
+ * each other, and those are bounded by the tree height. The rotations
+ * and cases are in rbtree_balance.h, shared with intrusive_rbtree.c. */
+
+/* a key to look for, with its prefix computed once for the descent */
+struct search_key {
+    uint64_t prefix;
+    const char *bytes;
+    size_t len;
+};
+
+/* a tree cut off for the set operations, with its black height: the
+ * number of black nodes on any path from the root down, the root
+ * included */
+struct subtree {
+    tree_node *root;
+    int bh;
+};
+
+/* nodes left out by a set operation, chained through left */
+struct drop_list {
+    tree_node *head, *tail;
+};
+
+enum set_op { set_union, set_intersection, set_difference };
+
+/* one call of the set operation recursion, a thread argument when forked */
+struct set_task {
+    enum set_op op;
+    struct subtree a, b, res;
+    struct drop_list dropped;
+    int threads;
+};
 
 /* API Impl and forward declarations */
 
-const tree_node *rbtree_get_element(const tree_node *root, const char *key) {
+static void make_search_key(struct search_key *sk,
+        const char *key, size_t len);
+static int compare_key(const tree_node *n, const struct search_key *sk);
+static void update_size(tree_node *n);
+static void adjust_path_sizes(tree_node *n, int delta);
+
+const tree_node *rbtree_get_element(const tree_node *root, const char *key)
+{
+    return rbtree_get_element_len(root, key, strlen(key));
+}
+
+const tree_node *rbtree_get_element_len(const tree_node *root,
+        const char *key, size_t len)
+{
+    struct search_key sk;
     int comp_res;
 
-    if (!root)
+    /* never stored, see add below */
+    if (len > UINT_MAX)
         return NULL;
 
-    comp_res = strcmp(root->key, key);
+    make_search_key(&sk, key, len);
 
-    if (comp_res == 0)
-        return root;
-    else
-        return rbtree_get_element(comp_res > 0 ? root->left : root->right, key);
+    while (root) {
+        comp_res = compare_key(root, &sk);
+
+        if (comp_res == 0)
+            return root;
+
+        root = comp_res > 0 ? root->left : root->right;
+    }
+
+    return NULL;
 }
 
-static tree_node *add_element_simple(tree_node **root, tree_node *parent,
-        const char *key, void *data);
+static tree_node *add_element_simple(rbtree_pool *pool, tree_node **root,
+        tree_node *parent, const struct search_key *sk, void *data);
 static void insert_case_1(tree_node *n, tree_node **root);
-static void insert_case_2(tree_node *n, tree_node **root);
-static void insert_case_3(tree_node *n, tree_node **root);
-static void insert_case_4(tree_node *n, tree_node **root);
 
 int rbtree_add_element(tree_node **root, const char *key, void *data)
 {
+    return rbtree_pool_add_element_len(NULL, root, key, strlen(key), data);
+}
+
+int rbtree_add_element_len(tree_node **root,
+        const char *key, size_t len, void *data)
+{
+    return rbtree_pool_add_element_len(NULL, root, key, len, data);
+}
+
+int rbtree_pool_add_element(rbtree_pool *pool, tree_node **root,
+        const char *key, void *data)
+{
+    return rbtree_pool_add_element_len(pool, root, key, strlen(key), data);
+}
+
+int rbtree_pool_add_element_len(rbtree_pool *pool, tree_node **root,
+        const char *key, size_t len, void *data)
+{
+    struct search_key sk;
     tree_node *n;
 
-    n = add_element_simple(root, NULL, key, data);
+    /* the length would not fit into key_len */
+    if (len > UINT_MAX)
+        return 0;
+
+    make_search_key(&sk, key, len);
+    n = add_element_simple(pool, root, NULL, &sk, data);
 
     if (n)
         insert_case_1(n, root);
@@ -43,171 +118,746 @@ int rbtree_add_element(tree_node **root, const char *key, void *data)
     return n != NULL;
 }
 
-static void substitute_and_remove_element(tree_node *n, tree_node **root);
-static tree_node *rightmost_element_in_subtree(tree_node *root);
-static tree_node *replace_with_child_and_get_parent(
+static tree_node *hinted_subtree(tree_node *hint,
+        const struct search_key *sk);
+static tree_node *create_node(rbtree_pool *pool,
+        tree_node *parent, const struct search_key *sk, void *data);
+
+const tree_node *rbtree_add_element_hint(tree_node **root,
+        const tree_node *hint, const char *key, void *data, int *added)
+{
+    return rbtree_pool_add_element_hint(NULL, root, hint, key, data, added);
+}
+
+const tree_node *rbtree_pool_add_element_hint(rbtree_pool *pool,
+        tree_node **root, const tree_node *hint, const char *key,
+        void *data, int *added)
+{
+    struct search_key sk;
+    tree_node *n, *parent, **where;
+    size_t len;
+    int comp_res;
+
+    len = strlen(key);
+    if (len > UINT_MAX) {
+        if (added)
+            *added = 0;
+        return NULL;
+    }
+
+    make_search_key(&sk, key, len);
+
+    n = hint ? hinted_subtree((tree_node *)hint, &sk) : *root;
+    parent = n ? n->parent : NULL;
+    if (!parent)
+        where = root;
+    else
+        where = n == parent->left ? &parent->left : &parent->right;
+
+    /* same as add_element_simple, but keeping the node with the key */
+    while (*where) {
+        comp_res = compare_key(*where, &sk);
+
+        if (comp_res == 0) {
+            if (added)
+                *added = 0;
+            return *where;
+        }
+
+        parent = *where;
+        where = comp_res > 0 ? &parent->left : &parent->right;
+    }
+
+    n = create_node(pool, parent, &sk, data);
+    *where = n;
+    adjust_path_sizes(parent, 1);
+    insert_case_1(n, root);
+
+    if (added)
+        *added = 1;
+    return n;
+}
+
+static void substitute_and_remove_element(rbtree_pool *pool,
+        tree_node *n, tree_node **root);
+static tree_node *replace_with_child_and_get_parent(rbtree_pool *pool,
         tree_node **n, tree_node **root);
-static void delete_case_1(tree_node *n, tree_node* parent, tree_node **root);
-static void delete_case_2(tree_node *n, tree_node* parent, tree_node **root);
-static void delete_case_3(tree_node *n, tree_node* parent, tree_node **root);
-static void delete_case_4(tree_node *n, tree_node* parent, tree_node **root);
-static void delete_case_5(tree_node *n, tree_node* parent, tree_node **root);
 
 int rbtree_remove_element(tree_node **root, const char *key)
+{
+    return rbtree_pool_remove_element_len(NULL, root, key, strlen(key));
+}
+
+int rbtree_remove_element_len(tree_node **root, const char *key, size_t len)
+{
+    return rbtree_pool_remove_element_len(NULL, root, key, len);
+}
+
+int rbtree_pool_remove_element(rbtree_pool *pool, tree_node **root,
+        const char *key)
+{
+    return rbtree_pool_remove_element_len(pool, root, key, strlen(key));
+}
+
+int rbtree_pool_remove_element_len(rbtree_pool *pool, tree_node **root,
+        const char *key, size_t len)
 {
     tree_node *n;
 
-    n = (tree_node *)rbtree_get_element(*root, key);
+    n = (tree_node *)rbtree_get_element_len(*root, key, len);
 
     if (!n)
         return 0;
 
-    substitute_and_remove_element(n, root);
+    substitute_and_remove_element(pool, n, root);
     return 1;
 }
 
 void rbtree_print(const tree_node *root)
 {
-    if (!root)
-        return;
+    const tree_node *n;
 
-    rbtree_print(root->left);
-    printf("%s\n", root->key);
-    rbtree_print(root->right);
+    for (n = rbtree_first(root); n; n = rbtree_next(n))
+        printf("%s\n", n->key);
 }
 
-static void destroy_node(tree_node* n);
+static void destroy_node(rbtree_pool *pool, tree_node* n);
 
 void rbtree_destroy(tree_node *root)
 {
+    tree_node *n, *parent, *top;
+
     if (!root)
         return;
 
-    rbtree_destroy(root->left);
-    rbtree_destroy(root->right);
-    destroy_node(root);
+    /* post-order walk, cutting off each leaf before freeing it */
+    top = root->parent;
+    n = root;
+    while (n != top) {
+        if (n->left)
+            n = n->left;
+        else if (n->right)
+            n = n->right;
+        else {
+            parent = n->parent;
+            if (parent && parent != top) {
+                if (n == parent->left)
+                    parent->left = NULL;
+                else
+                    parent->right = NULL;
+            }
+
+            destroy_node(NULL, n);
+            n = parent;
+        }
+    }
+}
+
+static const tree_node *leftmost_element_in_subtree(const tree_node *root);
+static tree_node *rightmost_element_in_subtree(tree_node *root);
+
+const tree_node *rbtree_first(const tree_node *root)
+{
+    return leftmost_element_in_subtree(root);
+}
+
+const tree_node *rbtree_last(const tree_node *root)
+{
+    return rightmost_element_in_subtree((tree_node *)root);
+}
+
+const tree_node *rbtree_next(const tree_node *n)
+{
+    if (!n)
+        return NULL;
+
+    if (n->right)
+        return leftmost_element_in_subtree(n->right);
+
+    while (n->parent && n == n->parent->right)
+        n = n->parent;
+
+    return n->parent;
+}
+
+const tree_node *rbtree_prev(const tree_node *n)
+{
+    if (!n)
+        return NULL;
+
+    if (n->left)
+        return rightmost_element_in_subtree((tree_node *)n->left);
+
+    while (n->parent && n == n->parent->left)
+        n = n->parent;
+
+    return n->parent;
+}
+
+/* the common descent for the bounds: the last node where we went left is
+ * the first one with key > (or >= when including equal) the given one */
+static const tree_node *bound(const tree_node *root, const char *key,
+        int include_equal)
+{
+    const tree_node *res = NULL;
+    struct search_key sk;
+    int comp_res;
+
+    make_search_key(&sk, key, strlen(key));
+
+    while (root) {
+        comp_res = compare_key(root, &sk);
+
+        if (comp_res > 0 || (include_equal && comp_res == 0)) {
+            res = root;
+            root = root->left;
+        } else
+            root = root->right;
+    }
+
+    return res;
+}
+
+const tree_node *rbtree_lower_bound(const tree_node *root, const char *key)
+{
+    return bound(root, key, 1);
+}
+
+const tree_node *rbtree_upper_bound(const tree_node *root, const char *key)
+{
+    return bound(root, key, 0);
+}
+
+int rbtree_visit_range(const tree_node *root, const char *from,
+        const char *to, rbtree_visitor visit, void *ctx)
+{
+    const tree_node *n;
+    struct search_key to_sk;
+    int visited = 0;
+
+    n = from ? rbtree_lower_bound(root, from) : rbtree_first(root);
+    if (to)
+        make_search_key(&to_sk, to, strlen(to));
+
+    for (; n && (!to || compare_key(n, &to_sk) < 0); n = rbtree_next(n)) {
+        visited++;
+        if (visit(n, ctx))
+            break;
+    }
+
+    return visited;
+}
+
+#if defined(__GNUC__)
+#define prefetch_node(n) __builtin_prefetch(n)
+#else
+#define prefetch_node(n) ((void)0)
+#endif
+
+/* searches in flight at once, enough to cover the memory latency with
+ * the work of one step of all the others */
+enum { get_many_group = 8 };
+
+void rbtree_get_many(const tree_node *root, const char *const *keys,
+        int n, const tree_node **out)
+{
+    struct search_key sk[get_many_group];
+    const tree_node *cur[get_many_group];
+    int base, cnt, active, i, comp_res;
+
+    for (base = 0; base < n; base += cnt) {
+        cnt = n - base < get_many_group ? n - base : get_many_group;
+
+        for (i = 0; i < cnt; i++) {
+            make_search_key(&sk[i], keys[base+i], strlen(keys[base+i]));
+            cur[i] = root;
+            out[base+i] = NULL;
+        }
+
+        /* one step of every unfinished search per round, the next node
+         * of each is prefetched and only touched in the next round */
+        active = root ? cnt : 0;
+        while (active) {
+            for (i = 0; i < cnt; i++) {
+                if (!cur[i])
+                    continue;
+
+                comp_res = compare_key(cur[i], &sk[i]);
+
+                if (comp_res == 0) {
+                    out[base+i] = cur[i];
+                    cur[i] = NULL;
+                } else
+                    cur[i] = comp_res > 0 ? cur[i]->left : cur[i]->right;
+
+                if (cur[i])
+                    prefetch_node(cur[i]);
+                else
+                    active--;
+            }
+        }
+    }
+}
+
+#ifdef RBTREE_ORDER_STATISTICS
+
+static size_t subtree_size(const tree_node *n);
+
+size_t rbtree_size(const tree_node *root)
+{
+    return subtree_size(root);
+}
+
+static size_t rank(const tree_node *root, const struct search_key *sk)
+{
+    size_t res = 0;
+    int comp_res;
+
+    while (root) {
+        comp_res = compare_key(root, sk);
+
+        if (comp_res == 0)
+            return res + subtree_size(root->left);
+
+        if (comp_res < 0) {
+            res += subtree_size(root->left) + 1;
+            root = root->right;
+        } else
+            root = root->left;
+    }
+
+    return res;
+}
+
+size_t rbtree_rank(const tree_node *root, const char *key)
+{
+    struct search_key sk;
+
+    make_search_key(&sk, key, strlen(key));
+    return rank(root, &sk);
+}
+
+const tree_node *rbtree_select(const tree_node *root, size_t i)
+{
+    size_t left_size;
+
+    while (root) {
+        left_size = subtree_size(root->left);
+
+        if (i == left_size)
+            return root;
+
+        if (i < left_size)
+            root = root->left;
+        else {
+            i -= left_size + 1;
+            root = root->right;
+        }
+    }
+
+    return NULL;
+}
+
+size_t rbtree_count_range(const tree_node *root, const char *from,
+        const char *to)
+{
+    struct search_key sk;
+    size_t lo = 0, hi;
+
+    if (from) {
+        make_search_key(&sk, from, strlen(from));
+        lo = rank(root, &sk);
+    }
+
+    if (to) {
+        make_search_key(&sk, to, strlen(to));
+        hi = rank(root, &sk);
+    } else
+        hi = subtree_size(root);
+
+    return hi > lo ? hi - lo : 0;
+}
+
+#endif
+
+static int keys_are_sorted(const char *const *keys, int n);
+static int keys_fit(const char *const *keys, int n);
+static tree_node *pool_alloc_nodes(rbtree_pool *pool, int count);
+static void init_node(rbtree_pool *pool, tree_node *n,
+        tree_node *parent, const struct search_key *sk, void *data);
+static tree_node *link_balanced(tree_node **nodes, int count);
+static int black_height(const tree_node *root);
+static int merge_sorted_and_relink(rbtree_pool *pool, tree_node **root,
+        const char *const *keys, void *const *data, int n);
+
+int rbtree_build_sorted(rbtree_pool *pool, tree_node **root,
+        const char *const *keys, void *const *data, int n)
+{
+    tree_node **nodes, *slab;
+    struct search_key sk;
+    int i;
+
+    if (!pool || *root || !keys_are_sorted(keys, n) || !keys_fit(keys, n))
+        return 0;
+    if (n <= 0)
+        return 1;
+
+    nodes = malloc(n * sizeof(*nodes));
+    slab = pool_alloc_nodes(pool, n);
+
+    for (i = 0; i < n; i++) {
+        make_search_key(&sk, keys[i], strlen(keys[i]));
+        nodes[i] = slab + i;
+        init_node(pool, nodes[i], NULL, &sk, data ? data[i] : NULL);
+    }
+
+    *root = link_balanced(nodes, n);
+
+    free(nodes);
+    return 1;
+}
+
+int rbtree_merge_sorted(rbtree_pool *pool, tree_node **root,
+        const char *const *keys, void *const *data, int n)
+{
+    const tree_node *hint = NULL;
+    int bh, sorted, added = 0, was_added, i;
+
+    /* The tree holds at least 2^bh - 1 elements, and one-by-one insertion
+     * costs about n * bh, so relinking only pays off when that is more
+     * than the size of the tree. */
+    bh = black_height(*root);
+    if (bh > 30)
+        bh = 30;
+
+    sorted = keys_are_sorted(keys, n);
+    if (sorted && (double)n * (bh + 1) >= (1L << bh) - 1 &&
+            keys_fit(keys, n))
+        return merge_sorted_and_relink(pool, root, keys, data, n);
+
+    /* sorted small batches still go in order, so each key lands next to
+     * the previous one, and keys too long to store are refused here */
+    for (i = 0; i < n; i++) {
+        hint = rbtree_pool_add_element_hint(pool, root, sorted ? hint : NULL,
+                keys[i], data ? data[i] : NULL, &was_added);
+        added += was_added;
+    }
+
+    return added;
+}
+
+static void run_set_task(struct set_task *t);
+static void destroy_dropped(rbtree_pool *pool, struct drop_list *dl);
+static void blacken_root(struct subtree *t);
+
+static tree_node *set_operation(rbtree_pool *pool, enum set_op op,
+        tree_node *a, tree_node *b, int threads)
+{
+    struct set_task t;
+
+    t.op = op;
+    t.a.root = a;
+    t.a.bh = black_height(a);
+    t.b.root = b;
+    t.b.bh = black_height(b);
+    t.dropped.head = t.dropped.tail = NULL;
+    t.threads = threads;
+
+    run_set_task(&t);
+    destroy_dropped(pool, &t.dropped);
+
+    /* a piece of a split may come out as it is, with a red root */
+    blacken_root(&t.res);
+    return t.res.root;
+}
+
+tree_node *rbtree_union(rbtree_pool *pool, tree_node *a, tree_node *b,
+        int threads)
+{
+    return set_operation(pool, set_union, a, b, threads);
+}
+
+tree_node *rbtree_intersection(rbtree_pool *pool, tree_node *a,
+        tree_node *b, int threads)
+{
+    return set_operation(pool, set_intersection, a, b, threads);
+}
+
+tree_node *rbtree_difference(rbtree_pool *pool, tree_node *a, tree_node *b,
+        int threads)
+{
+    return set_operation(pool, set_difference, a, b, threads);
+}
+
+static void free_slabs(struct rbtree_slab *s);
+
+void rbtree_pool_init(rbtree_pool *pool)
+{
+    pool->slabs = NULL;
+    pool->free_nodes = NULL;
+    pool->node_cur = pool->node_end = NULL;
+    pool->key_cur = pool->key_end = NULL;
+}
+
+void rbtree_pool_destroy(rbtree_pool *pool)
+{
+    free_slabs(pool->slabs);
+    rbtree_pool_init(pool);
 }
 
 /* Memory functions */
 
-static tree_node *create_node(tree_node *parent, const char *key, void *data)
+/* Slabs are raw chunks of memory chained into a list, the payload is
+ * aligned to the cache line, so that pooled nodes never straddle two. */
+
+enum {
+    cache_line_size = 64,
+    slab_nodes = 1024,
+    key_slab_size = 64 * 1024,
+    max_pooled_key_size = key_slab_size / 4
+};
+
+struct rbtree_slab {
+    struct rbtree_slab *next;
+};
+
+static void *alloc_slab(rbtree_pool *pool, size_t size)
 {
-    tree_node *n;
+    struct rbtree_slab *s;
+    size_t addr;
 
-    n = malloc(sizeof(*n));
-    n->key = malloc((strlen(key) + 1) * sizeof(char));
-    strcpy(n->key, key);
-    n->data = data;
-    n->left = n->right = NULL;
-    n->parent = parent;
-    n->color = red;
+    s = malloc(sizeof(*s) + cache_line_size + size);
+    s->next = pool->slabs;
+    pool->slabs = s;
 
-    return n;
+    addr = (size_t)(s + 1);
+    addr = (addr + cache_line_size - 1) & ~(size_t)(cache_line_size - 1);
+    return (void *)addr;
 }
 
-static void destroy_node(tree_node* n)
+static void free_slabs(struct rbtree_slab *s)
 {
-    if (n) {
-        if (n->key)
-            free(n->key);
-        free(n);
+    struct rbtree_slab *next;
+
+    for (; s; s = next) {
+        next = s->next;
+        free(s);
     }
 }
 
-/* General data structure utility functions */
+static tree_node *pool_alloc_node(rbtree_pool *pool)
+{
+    tree_node *n;
+
+    if (pool->free_nodes) {
+        n = pool->free_nodes;
+        pool->free_nodes = n->left;
+        return n;
+    }
 
-static int is_black(tree_node *n) 
-{ 
-    return !n || n->color == black; 
+    if (pool->node_cur == pool->node_end) {
+        pool->node_cur = alloc_slab(pool, slab_nodes * sizeof(tree_node));
+        pool->node_end = pool->node_cur + slab_nodes;
+    }
+
+    return pool->node_cur++;
 }
 
-static int is_red(tree_node *n) 
-{ 
-    return !is_black(n);
+static char *pool_alloc_key(rbtree_pool *pool, size_t size)
+{
+    char *k;
+
+    /* huge keys get slabs of their own, not to waste the current one */
+    if (size > max_pooled_key_size)
+        return alloc_slab(pool, size);
+
+    if ((size_t)(pool->key_end - pool->key_cur) < size) {
+        pool->key_cur = alloc_slab(pool, key_slab_size);
+        pool->key_end = pool->key_cur + key_slab_size;
+    }
+
+    k = pool->key_cur;
+    pool->key_cur += size;
+    return k;
 }
 
-static tree_node *grandparent(const tree_node *n)
+/* count nodes lying next to each other, bypassing the free list */
+static tree_node *pool_alloc_nodes(rbtree_pool *pool, int count)
 {
-    return (n && n->parent) ? n->parent->parent : NULL;
+    tree_node *n;
+
+    if (pool->node_end - pool->node_cur < count)
+        return alloc_slab(pool, count * sizeof(tree_node));
+
+    n = pool->node_cur;
+    pool->node_cur += count;
+    return n;
 }
 
-static tree_node *uncle(const tree_node *n)
+static tree_node *create_node(rbtree_pool *pool,
+        tree_node *parent, const struct search_key *sk, void *data)
 {
-    const tree_node *gp;
-    gp = grandparent(n);
+    tree_node *n;
 
-    if (gp)
-        return n->parent == gp->left ? gp->right : gp->left;
-    else
-        return NULL;
+    n = pool ? pool_alloc_node(pool) : malloc(sizeof(*n));
+    init_node(pool, n, parent, sk, data);
+
+    return n;
 }
 
-static tree_node *sibling(const tree_node *n, const tree_node *parent)
+static void init_node(rbtree_pool *pool, tree_node *n,
+        tree_node *parent, const struct search_key *sk, void *data)
 {
-    if (!parent)
-        return NULL;
+    size_t key_size;
+
+    key_size = (sk->len + 1) * sizeof(char);
+    if (key_size <= sizeof(n->key_buf))
+        n->key = n->key_buf;
+    else
+        n->key = pool ? pool_alloc_key(pool, key_size) : malloc(key_size);
+    memcpy(n->key, sk->bytes, sk->len);
+    n->key[sk->len] = '\0';
+    n->key_prefix = sk->prefix;
+    n->key_len = sk->len;
+
+    n->data = data;
+    n->left = n->right = NULL;
+    n->parent = parent;
+    n->color = red;
+    update_size(n);
+}
 
-    return n == parent->left ? parent->right : parent->left;
+static int key_is_heap_allocated(const tree_node *n)
+{
+    return n->key && n->key != n->key_buf;
 }
 
-static tree_node *child(const tree_node *n)
+static void destroy_node(rbtree_pool *pool, tree_node* n)
 {
     if (!n)
-        return NULL;
+        return;
 
-    return n->left ? n->left : n->right;
+    if (pool) {
+        n->left = pool->free_nodes;
+        pool->free_nodes = n;
+    } else {
+        if (key_is_heap_allocated(n))
+            free(n->key);
+        free(n);
+    }
 }
 
-static void rotate_left(tree_node *n, tree_node **root)
+/* moves the key of src into dst, dropping the old key of dst */
+static void move_key(rbtree_pool *pool, tree_node *dst, tree_node *src)
 {
-    tree_node *pivot;
+    if (!pool && key_is_heap_allocated(dst))
+        free(dst->key);
 
-    if (!n || !(n->right))
-        return;
+    if (key_is_heap_allocated(src))
+        dst->key = src->key;
+    else {
+        memcpy(dst->key_buf, src->key_buf, sizeof(dst->key_buf));
+        dst->key = dst->key_buf;
+    }
+    dst->key_prefix = src->key_prefix;
+    dst->key_len = src->key_len;
 
-    pivot = n->right;
-    pivot->parent = n->parent;
+    src->key = NULL;
+}
 
-    if (n->parent) {
-        if (n == n->parent->left)
-            n->parent->left = pivot;
-        else
-            n->parent->right = pivot;
-    } else 
-        *root = pivot;
+/* Keys */
+
+/* First 8 bytes of the key, zero padded, as a big-endian number, so that
+ * comparing prefixes orders keys the same way memcmp does. */
+static void make_search_key(struct search_key *sk,
+        const char *key, size_t len)
+{
+    size_t i;
 
-    n->right = pivot->left;
-    if (pivot->left)
-        pivot->left->parent = n;
-    n->parent = pivot;
-    pivot->left = n;
+    sk->prefix = 0;
+    for (i = 0; i < 8; i++) {
+        sk->prefix <<= 8;
+        if (i < len)
+            sk->prefix |= (unsigned char)key[i];
+    }
+
+    sk->bytes = key;
+    sk->len = len;
 }
 
-static void rotate_right(tree_node *n, tree_node **root)
+/* Sign of (node key - searched key). With equal prefixes, the first
+ * min(8, lengths) bytes are equal, so only the tails past 8 bytes are
+ * left to compare, and then the lengths. */
+static int compare_key(const tree_node *n, const struct search_key *sk)
 {
-    tree_node *pivot;
+    size_t min_len;
+    int comp_res;
 
-    if (!n || !(n->left))
-        return;
+    if (n->key_prefix != sk->prefix)
+        return n->key_prefix < sk->prefix ? -1 : 1;
 
-    pivot = n->left;
-    pivot->parent = n->parent;
+    if (n->key_len > 8 && sk->len > 8) {
+        min_len = n->key_len < sk->len ? n->key_len : sk->len;
+        comp_res = memcmp(n->key + 8, sk->bytes + 8, min_len - 8);
+        if (comp_res != 0)
+            return comp_res;
+    }
 
-    if (n->parent) {
-        if (n == n->parent->left)
-            n->parent->left = pivot;
-        else
-            n->parent->right = pivot;
-    } else 
-        *root = pivot;
+    if (n->key_len == sk->len)
+        return 0;
+
+    return n->key_len < sk->len ? -1 : 1;
+}
+
+/* General data structure utility functions */
+
+#ifdef RBTREE_ORDER_STATISTICS
+
+static size_t subtree_size(const tree_node *n)
+{
+    return n ? n->size : 0;
+}
+
+/* recomputes the size of n from its children */
+static void update_size(tree_node *n)
+{
+    n->size = subtree_size(n->left) + subtree_size(n->right) + 1;
+}
+
+/* n and all its ancestors gained/lost delta elements */
+static void adjust_path_sizes(tree_node *n, int delta)
+{
+    for (; n; n = n->parent)
+        n->size += delta;
+}
+
+#else
+
+static void update_size(tree_node *n)
+{
+    (void)n;
+}
+
+static void adjust_path_sizes(tree_node *n, int delta)
+{
+    (void)n;
+    (void)delta;
+}
+
+#endif
+
+static tree_node *child(const tree_node *n)
+{
+    if (!n)
+        return NULL;
 
-    n->left = pivot->right;
-    if (pivot->right)
-        pivot->right->parent = n;
-    n->parent = pivot;
-    pivot->right = n;
+    return n->left ? n->left : n->right;
 }
 
+#define RB_NODE tree_node
+#define RB_ROTATED(n) update_size(n)
+#include "rbtree_balance.h"
+
 /* Debug */
 
 #ifdef DEBUG
@@ -242,95 +892,84 @@ static void debug_print_tree(tree_node *root, int depth)
 
 /* Insertion */
 
-static tree_node *add_element_simple(tree_node **root, tree_node *parent,
-        const char *key, void *data)
+static tree_node *add_element_simple(rbtree_pool *pool, tree_node **root,
+        tree_node *parent, const struct search_key *sk, void *data)
 {
     int comp_res;
 
-    if (!(*root)) {
-        *root = create_node(parent, key, data);
-        return *root;
-    }
-
-    comp_res = strcmp((*root)->key, key);
-
-    if (comp_res == 0)
-        return NULL;
-
-    if (comp_res > 0)
-        return add_element_simple(&((*root)->left), *root, key, data);
-    else
-        return add_element_simple(&((*root)->right), *root, key, data);
-}
-
-static void insert_case_1(tree_node *n, tree_node **root)
-{
-    if (!(n->parent))
-        n->color = black;
-    else if (is_red(n->parent))
-        insert_case_2(n, root);
-}
+    while (*root) {
+        comp_res = compare_key(*root, sk);
 
-static void insert_case_2(tree_node *n, tree_node **root)
-{
-    tree_node *gp, *un;
+        if (comp_res == 0)
+            return NULL;
 
-    un = uncle(n);
-    if (is_red(un)) {
-        n->parent->color = black;
-        un->color = black;
+        parent = *root;
+        root = comp_res > 0 ? &parent->left : &parent->right;
+    }
 
-        gp = grandparent(n);
-        gp->color = red;
-        insert_case_1(gp, root);
-    } else 
-        insert_case_3(n, root);
+    *root = create_node(pool, parent, sk, data);
+    adjust_path_sizes(parent, 1);
+    return *root;
 }
 
-static void insert_case_3(tree_node *n, tree_node **root)
+/* The subtree of a node holds the keys between its nearest ancestors on
+ * either side (the ones it is a left/right descendant of), so climbing
+ * from the hint only needs compares with those bounds: the key goes into
+ * the subtree of the first node whose bound on the side of the key is
+ * past it. The climb over the nodes in between compares nothing.
+ *
+ * It still follows the parent pointers up to that bound, and a key past
+ * the last one (a sorted append) has none: the climb goes up the whole
+ * right spine to the root. Whether there is a bound above can only be
+ * told by getting there, so the saving is in compares (which walk the
+ * keys), not in the O(log n) steps. */
+static tree_node *hinted_subtree(tree_node *hint,
+        const struct search_key *sk)
 {
-    tree_node *gp;
+    tree_node *n = hint, *bound;
+    int comp_res, bound_res;
 
-    gp = grandparent(n);
-    if (n->parent == gp->left && n == n->parent->right) {
-        rotate_left(n->parent, root);
-        n = n->left;
-    } else if (n->parent == gp->right && n == n->parent->left) {
-        rotate_right(n->parent, root);
-        n = n->right;
+    comp_res = compare_key(n, sk);
+    if (comp_res == 0)
+        return n;
+
+    for (;;) {
+        bound = n;
+        if (comp_res < 0) {
+            while (bound->parent && bound == bound->parent->right)
+                bound = bound->parent;
+        } else {
+            while (bound->parent && bound == bound->parent->left)
+                bound = bound->parent;
+        }
+        bound = bound->parent;
+
+        if (!bound)
+            return n;
+
+        bound_res = compare_key(bound, sk);
+        if (bound_res == 0)
+            return bound;
+        if ((bound_res > 0) == (comp_res < 0))
+            return n;
+
+        n = bound;
+        comp_res = bound_res;
     }
-
-    insert_case_4(n, root);
-}
-    
-static void insert_case_4(tree_node *n, tree_node **root)
-{
-    tree_node *gp;
-
-    gp = grandparent(n);
-    n->parent->color = black;
-    gp->color = red;
-    
-    if (n == n->parent->left && n->parent == gp->left)
-        rotate_right(gp, root);
-    else
-        rotate_left(gp, root);
 }
 
 /* Deletion */
 
-static void substitute_and_remove_element(tree_node *n, tree_node **root)
+static void substitute_and_remove_element(rbtree_pool *pool,
+        tree_node *n, tree_node **root)
 {
     tree_node *repl = NULL, *parent;
-    char *key_tmp;
     node_color old_color;
 
     if (n->left && n->right) {
         repl = rightmost_element_in_subtree(n->left);
 
-        key_tmp = repl->key;
-        repl->key = n->key;
-        n->key = key_tmp;
+        move_key(pool, n, repl);
 
         n->data = repl->data;
         n = repl;
@@ -338,20 +977,32 @@ static void substitute_and_remove_element(tree_node *n, tree_node **root)
 
     old_color = n->color;
     
-    parent = replace_with_child_and_get_parent(&n, root);
+    parent = replace_with_child_and_get_parent(pool, &n, root);
     if (old_color == black)
         delete_case_1(n, parent, root);
 }
 
+static const tree_node *leftmost_element_in_subtree(const tree_node *root)
+{
+    if (root) {
+        while (root->left)
+            root = root->left;
+    }
+
+    return root;
+}
+
 static tree_node *rightmost_element_in_subtree(tree_node *root)
 {
-    if (!root || !(root->right))
-        return root;
+    if (root) {
+        while (root->right)
+            root = root->right;
+    }
 
-    return rightmost_element_in_subtree(root->right);
+    return root;
 }
 
-static tree_node *replace_with_child_and_get_parent(
+static tree_node *replace_with_child_and_get_parent(rbtree_pool *pool,
         tree_node **np, tree_node **root)
 {
     tree_node *c, *parent;
@@ -368,84 +1019,461 @@ static tree_node *replace_with_child_and_get_parent(
         (*np)->parent->right = c;
 
     parent = (*np)->parent;
-    destroy_node(*np);
+    destroy_node(pool, *np);
     *np = c;
 
+    /* before the rebalancing, whose rotations count on correct sizes */
+    adjust_path_sizes(parent, -1);
+
     return parent;
 }
 
-static void delete_case_1(tree_node *n, tree_node* parent, tree_node **root)
+/* Bulk construction */
+
+static int keys_are_sorted(const char *const *keys, int n)
+{
+    int i;
+
+    for (i = 1; i < n; i++) {
+        if (strcmp(keys[i-1], keys[i]) >= 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+/* the lengths would fit into key_len */
+static int keys_fit(const char *const *keys, int n)
 {
-    if (is_red(n))
-        n->color = black;
-    else if (parent)
-        delete_case_2(n, parent, root);
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (strlen(keys[i]) > UINT_MAX)
+            return 0;
+    }
+
+    return 1;
 }
 
-static void delete_case_2(tree_node *n, tree_node* parent, tree_node **root)
+static int black_height(const tree_node *root)
 {
-    tree_node *s;
-    s = sibling(n, parent);
+    int bh = 0;
 
-    if (is_red(s)) {
-        s->color = black;
-        parent->color = red;
-        if (n == parent->left)
-            rotate_left(parent, root);
-        else
-            rotate_right(parent, root);
+    for (; root; root = root->left) {
+        if (root->color == black)
+            bh++;
+    }
+
+    return bh;
+}
+
+static tree_node *link_balanced_subtree(tree_node **nodes, int count,
+        tree_node *parent, int depth, int red_depth)
+{
+    tree_node *n;
+    int mid;
+
+    if (count <= 0)
+        return NULL;
+
+    mid = count / 2;
+    n = nodes[mid];
+
+    n->parent = parent;
+    n->color = depth == red_depth ? red : black;
+    n->left = link_balanced_subtree(nodes, mid, n, depth+1, red_depth);
+    n->right = link_balanced_subtree(nodes + mid + 1, count - mid - 1,
+            n, depth+1, red_depth);
+    update_size(n);
+
+    return n;
+}
+
+/* Links the nodes (in key order) into a tree by always taking the middle
+ * as the root, so the halves differ in size by one at most, and all the
+ * null leaves end up on the two lowest levels. Coloring the deepest level
+ * red and everything else black then gives equal black heights. */
+static tree_node *link_balanced(tree_node **nodes, int count)
+{
+    int max_depth = 0;
+
+    while ((count >> (max_depth + 1)) > 0)
+        max_depth++;
+
+    return link_balanced_subtree(nodes, count, NULL, 0,
+            max_depth > 0 ? max_depth : -1);
+}
+
+static int merge_sorted_and_relink(rbtree_pool *pool, tree_node **root,
+        const char *const *keys, void *const *data, int n)
+{
+    tree_node **nodes, *tn;
+    struct search_key sk;
+    int tree_size = 0, count = 0, i = 0, comp_res;
+
+    for (tn = (tree_node *)rbtree_first(*root); tn;
+            tn = (tree_node *)rbtree_next(tn))
+    {
+        tree_size++;
     }
+    tn = (tree_node *)rbtree_first(*root);
+
+    if (tree_size + n <= 0)
+        return 0;
+    nodes = malloc((tree_size + n) * sizeof(*nodes));
+
+    /* everything is collected before relinking, rbtree_next walks the old
+     * links */
+    if (n > 0)
+        make_search_key(&sk, keys[0], strlen(keys[0]));
+
+    while (tn || i < n) {
+        comp_res = !tn ? 1 : (i >= n ? -1 : compare_key(tn, &sk));
+
+        if (comp_res <= 0) {
+            nodes[count++] = tn;
+            tn = (tree_node *)rbtree_next(tn);
+        } else {
+            nodes[count++] = create_node(pool, NULL, &sk,
+                    data ? data[i] : NULL);
+        }
+
+        if (comp_res >= 0 && ++i < n)
+            make_search_key(&sk, keys[i], strlen(keys[i]));
+    }
+
+    *root = link_balanced(nodes, count);
+
+    free(nodes);
+    return count - tree_size;
+}
 
-    delete_case_3(n, parent, root);
+/* Set operations
+ *
+ * After Blelloch, Ferizovic and Sun, "Just Join for Parallel Ordered
+ * Sets": everything is built on join, which links two trees and a middle
+ * node in O(difference of black heights), and split, which cuts a tree
+ * by a key with O(log n) joins. The operations split a by the root of b
+ * and recurse on the two halves, which share nothing, so they can run on
+ * different threads. */
+
+/* below that the halves are not worth a thread */
+enum { parallel_min_black_height = 6 };
+
+/* cuts n off from its children, which become subtrees of their own */
+static void expose(tree_node *n, int bh, struct subtree *l,
+        struct subtree *r)
+{
+    l->root = n->left;
+    r->root = n->right;
+    l->bh = r->bh = bh - (n->color == black);
+
+    if (n->left)
+        n->left->parent = NULL;
+    if (n->right)
+        n->right->parent = NULL;
+    n->left = n->right = n->parent = NULL;
 }
 
-static void delete_case_3(tree_node *n, tree_node* parent, tree_node **root)
+static void blacken_root(struct subtree *t)
 {
-    tree_node *s;
-    s = sibling(n, parent);
+    if (t->root && t->root->color == red) {
+        t->root->color = black;
+        t->bh++;
+    }
+}
 
-    if (s && is_black(s->left) && is_black(s->right)) {
-        s->color = red;
-        if (parent->color == black)
-            delete_case_1(parent, parent->parent, root);
+/* the insertion rebalancing (as in insert_case_1..4) for a red x linked
+ * into t, as a loop, the root is blackened at the end */
+static void join_fixup(struct subtree *t, tree_node *x)
+{
+    tree_node *gp, *un;
+
+    /* the root is black, so a red parent always has a parent */
+    while (x->parent && is_red(x->parent)) {
+        gp = grandparent(x);
+        un = uncle(x);
+
+        if (is_red(un)) {
+            x->parent->color = black;
+            un->color = black;
+            gp->color = red;
+            x = gp;
+            continue;
+        }
+
+        if (x->parent == gp->left && x == x->parent->right) {
+            rotate_left(x->parent, &t->root);
+            x = x->left;
+        } else if (x->parent == gp->right && x == x->parent->left) {
+            rotate_right(x->parent, &t->root);
+            x = x->right;
+        }
+
+        x->parent->color = black;
+        gp->color = red;
+        if (x == x->parent->left)
+            rotate_right(gp, &t->root);
         else
-            parent->color = black;
-    } else 
-        delete_case_4(n, parent, root);
+            rotate_left(gp, &t->root);
+        break;
+    }
+
+    blacken_root(t);
 }
 
-static void delete_case_4(tree_node *n, tree_node* parent, tree_node **root)
+/* Links l, x and r (keys in this order) into one tree. x goes down the
+ * facing spine of the taller tree to the first black node as high as the
+ * other tree, takes its place with it and the other tree as children,
+ * and the red x is rebalanced from there. */
+static struct subtree join(struct subtree l, tree_node *x, struct subtree r)
 {
-    tree_node *s;
-    s = sibling(n, parent);
+    struct subtree res;
+    tree_node *y, *p = NULL, *n;
+    int h, other_bh, go_right;
+
+    blacken_root(&l);
+    blacken_root(&r);
+
+    if (l.bh == r.bh) {
+        x->left = l.root;
+        x->right = r.root;
+        if (l.root)
+            l.root->parent = x;
+        if (r.root)
+            r.root->parent = x;
+        x->parent = NULL;
+        x->color = black;
+        update_size(x);
+
+        res.root = x;
+        res.bh = l.bh + 1;
+        return res;
+    }
 
-    if (s && n == parent->left && is_red(s->left) && is_black(s->right)) {
-        s->color = red;
-        s->left->color = black;
-        rotate_right(s, root);
-    } 
-    else if (s && n == parent->right && is_red(s->right) && is_black(s->left)) {
-        s->color = red;
-        s->right->color = black;
-        rotate_left(s, root);
+    go_right = l.bh > r.bh;
+    res = go_right ? l : r;
+    other_bh = go_right ? r.bh : l.bh;
+
+    y = res.root;
+    h = res.bh;
+    while (y && (y->color == red || h > other_bh)) {
+        if (y->color == black)
+            h--;
+        p = y;
+        y = go_right ? y->right : y->left;
     }
 
-    delete_case_5(n, parent, root);
+    if (go_right) {
+        x->left = y;
+        x->right = r.root;
+        p->right = x;
+    } else {
+        x->left = l.root;
+        x->right = y;
+        p->left = x;
+    }
+    if (x->left)
+        x->left->parent = x;
+    if (x->right)
+        x->right->parent = x;
+    x->parent = p;
+    x->color = red;
+
+    for (n = x; n; n = n->parent)
+        update_size(n);
+
+    join_fixup(&res, x);
+    return res;
 }
 
-static void delete_case_5(tree_node *n, tree_node* parent, tree_node **root)
+/* Cuts t into the elements before and after the key, *found gets the
+ * node with the key itself, if there is one. */
+static void split(struct subtree t, const struct search_key *sk,
+        struct subtree *l, tree_node **found, struct subtree *r)
 {
-    tree_node *s;
-    s = sibling(n, parent);
+    struct subtree tl, tr, mid;
+    tree_node *n = t.root;
+    int comp_res;
 
-    s->color = parent->color;
-    parent->color = black;
+    if (!n) {
+        l->root = r->root = NULL;
+        l->bh = r->bh = 0;
+        *found = NULL;
+        return;
+    }
 
-    if (n == parent->left) {
-        s->right->color = black;
-        rotate_left(parent, root);
+    comp_res = compare_key(n, sk);
+    expose(n, t.bh, &tl, &tr);
+
+    if (comp_res == 0) {
+        *l = tl;
+        *r = tr;
+        *found = n;
+    } else if (comp_res > 0) {
+        split(tl, sk, l, found, &mid);
+        *r = join(mid, n, tr);
     } else {
-        s->left->color = black;
-        rotate_right(parent, root);
+        split(tr, sk, &mid, found, r);
+        *l = join(tl, n, mid);
+    }
+}
+
+/* takes the last element out of t, the rest goes to *rest */
+static tree_node *split_last(struct subtree t, struct subtree *rest)
+{
+    struct subtree tl, tr, mid;
+    tree_node *n = t.root, *last;
+
+    expose(n, t.bh, &tl, &tr);
+
+    if (!tr.root) {
+        *rest = tl;
+        return n;
+    }
+
+    last = split_last(tr, &mid);
+    *rest = join(tl, n, mid);
+    return last;
+}
+
+/* join without a middle node */
+static struct subtree join_two(struct subtree l, struct subtree r)
+{
+    struct subtree rest;
+    tree_node *last;
+
+    if (!l.root)
+        return r;
+    if (!r.root)
+        return l;
+
+    last = split_last(l, &rest);
+    return join(rest, last, r);
+}
+
+static void drop_node(struct drop_list *dl, tree_node *n)
+{
+    n->left = dl->head;
+    dl->head = n;
+    if (!dl->tail)
+        dl->tail = n;
+}
+
+static void drop_tree(struct drop_list *dl, tree_node *n)
+{
+    tree_node *left, *right;
+
+    if (!n)
+        return;
+
+    left = n->left;
+    right = n->right;
+    drop_node(dl, n);
+    drop_tree(dl, left);
+    drop_tree(dl, right);
+}
+
+static void append_dropped(struct drop_list *dl, struct drop_list *more)
+{
+    if (!more->head)
+        return;
+
+    if (dl->tail)
+        dl->tail->left = more->head;
+    else
+        dl->head = more->head;
+    dl->tail = more->tail;
+}
+
+/* freed at the end, by one thread, as the pool is not thread safe */
+static void destroy_dropped(rbtree_pool *pool, struct drop_list *dl)
+{
+    tree_node *n, *next;
+
+    for (n = dl->head; n; n = next) {
+        next = n->left;
+        destroy_node(pool, n);
+    }
+}
+
+static void *run_set_task_thread(void *arg)
+{
+    run_set_task(arg);
+    return NULL;
+}
+
+static void run_set_task(struct set_task *t)
+{
+    struct set_task left, right;
+    struct search_key sk;
+    tree_node *pivot, *found;
+    pthread_t thread;
+    int forked = 0;
+
+    if (!t->a.root || !t->b.root) {
+        t->res.root = NULL;
+        t->res.bh = 0;
+
+        if (t->op == set_union)
+            t->res = t->a.root ? t->a : t->b;
+        else if (t->op == set_difference)
+            t->res = t->a;
+        else
+            drop_tree(&t->dropped, t->a.root);
+        if (t->op != set_union)
+            drop_tree(&t->dropped, t->b.root);
+
+        if (t->res.root)
+            t->res.root->parent = NULL;
+        return;
+    }
+
+    pivot = t->b.root;
+    make_search_key(&sk, pivot->key, pivot->key_len);
+
+    left.op = right.op = t->op;
+    left.dropped.head = left.dropped.tail = NULL;
+    right.dropped = left.dropped;
+    expose(pivot, t->b.bh, &left.b, &right.b);
+    split(t->a, &sk, &left.a, &found, &right.a);
+
+    left.threads = t->threads / 2;
+    right.threads = t->threads - left.threads;
+
+    if (left.threads >= 1 && t->a.bh + t->b.bh >= parallel_min_black_height)
+        forked = pthread_create(&thread, NULL, run_set_task_thread, &left) == 0;
+    if (!forked) {
+        left.threads = right.threads = t->threads;
+        run_set_task(&left);
+    }
+    run_set_task(&right);
+    if (forked)
+        pthread_join(thread, NULL);
+
+    t->dropped = left.dropped;
+    append_dropped(&t->dropped, &right.dropped);
+
+    switch (t->op) {
+        case set_union:
+            if (found) {
+                drop_node(&t->dropped, pivot);
+                pivot = found;
+            }
+            t->res = join(left.res, pivot, right.res);
+            break;
+        case set_intersection:
+            drop_node(&t->dropped, pivot);
+            if (found)
+                t->res = join(left.res, found, right.res);
+            else
+                t->res = join_two(left.res, right.res);
+            break;
+        case set_difference:
+            drop_node(&t->dropped, pivot);
+            if (found)
+                drop_node(&t->dropped, found);
+            t->res = join_two(left.res, right.res);
+            break;
     }
 }
@@ -2,27 +2,193 @@
 #ifndef RBTREE_SENTRY
 #define RBTREE_SENTRY
 
+#include <stddef.h>
+#include <stdint.h>
+
 /* inteface for the red-black tree-based dictionary with string keys and
  * anything in data. 
  *
  * When adding elements, the key strings will be copied, but the data
- * will just be passed by reference.
+ * will just be passed by reference. Short keys are copied right into the
+ * node (key then points to key_buf), so the node and the key share
+ * a cache line and no separate allocation is made for them.
+ *
+ * Each node also keeps the key length and the first 8 key bytes as
+ * a big-endian number, so most comparisons are one integer compare
+ * inside the node, and the key bytes are only read on equal prefixes.
+ * Keys are ordered as by memcmp, with a shorter key before all the longer
+ * ones it is a prefix of, which for strings is the strcmp order.
+ *
+ * The _len functions take binary keys (which may contain '\0'), the key
+ * in the node is still followed by a '\0' for convenience. Keys longer
+ * than UINT_MAX bytes are not supported, by any of the functions: adding
+ * one fails (returns 0, or NULL for the hint ones, and a bulk build with
+ * one fails as a whole), looking one up or removing it finds nothing.
  *
  * Manual control over the tree nodes is possible, but not advisable. */
 
 typedef enum tag_node_color { red, black } node_color;
 
+/* Compiling with RBTREE_ORDER_STATISTICS (the library and everything that
+ * includes this header alike) adds the subtree size to every node, which
+ * gives the rank/select functions below. The inline key room shrinks to
+ * pay for it, so a node stays 64 bytes. */
+
+/* chosen so that a node takes exactly 64 bytes on LP64 */
+#ifdef RBTREE_ORDER_STATISTICS
+enum { rbtree_inline_key_size = 7 };
+#else
+enum { rbtree_inline_key_size = 11 };
+#endif
+
 typedef struct tag_tree_node {
+    uint64_t key_prefix;
     char *key;
     void *data;
-    node_color color;
     struct tag_tree_node *left, *right, *parent;
+    unsigned int key_len;
+#ifdef RBTREE_ORDER_STATISTICS
+    unsigned int size; /* of the subtree, this node included */
+#endif
+    unsigned char color; /* node_color, packed */
+    char key_buf[rbtree_inline_key_size];
 } tree_node;
 
 const tree_node *rbtree_get_element(const tree_node *root, const char *key);
 int rbtree_add_element(tree_node **root, const char *key, void *data);
 int rbtree_remove_element(tree_node **root, const char *key);
+
+const tree_node *rbtree_get_element_len(const tree_node *root,
+        const char *key, size_t len);
+int rbtree_add_element_len(tree_node **root,
+        const char *key, size_t len, void *data);
+int rbtree_remove_element_len(tree_node **root, const char *key, size_t len);
 void rbtree_print(const tree_node *root);
 void rbtree_destroy(tree_node *root);
 
+/* In-order traversal, via the parent pointers. All of these return NULL
+ * when there is no such element. */
+const tree_node *rbtree_first(const tree_node *root);
+const tree_node *rbtree_last(const tree_node *root);
+const tree_node *rbtree_next(const tree_node *n);
+const tree_node *rbtree_prev(const tree_node *n);
+/* first element with key >= key, and with key > key respectively */
+const tree_node *rbtree_lower_bound(const tree_node *root, const char *key);
+const tree_node *rbtree_upper_bound(const tree_node *root, const char *key);
+
+/* Calls visit for all elements with from <= key < to in order, NULL from
+ * or to means no bound on that side. Stops early if visit returns non-0.
+ * Returns the number of elements visited. */
+typedef int (*rbtree_visitor)(const tree_node *n, void *ctx);
+int rbtree_visit_range(const tree_node *root, const char *from,
+        const char *to, rbtree_visitor visit, void *ctx);
+
+/* Looks up n keys at once, out[i] gets what rbtree_get_element would
+ * return for keys[i]. The searches are advanced in groups in lockstep,
+ * prefetching the next node of each, so the cache misses of different
+ * keys overlap instead of being waited for one after another. Pays off
+ * for trees that do not fit into the cache. */
+void rbtree_get_many(const tree_node *root, const char *const *keys,
+        int n, const tree_node **out);
+
+#ifdef RBTREE_ORDER_STATISTICS
+/* Order statistics, all O(log n). rank is the number of elements with
+ * key < key, select returns the element with rank i (NULL if i >= size),
+ * count_range counts the elements with from <= key < to, NULL from or to
+ * meaning no bound, as in rbtree_visit_range. */
+size_t rbtree_size(const tree_node *root);
+size_t rbtree_rank(const tree_node *root, const char *key);
+const tree_node *rbtree_select(const tree_node *root, size_t i);
+size_t rbtree_count_range(const tree_node *root, const char *from,
+        const char *to);
+#endif
+
+/* Pool mode: nodes and long keys are carved out of big slabs owned by the
+ * pool, so an insert mostly does no allocation at all, and the whole tree
+ * is freed by releasing the slabs, without walking it.
+ *
+ * A tree built with a pool must only be modified with the rbtree_pool_*
+ * functions and the same pool (the read-only functions work as usual).
+ * Nodes of removed elements are reused, long key bytes are only given
+ * back on rbtree_pool_destroy. One pool may hold several trees.
+ *
+ * Passing NULL for the pool falls back to the regular malloc mode. */
+
+struct rbtree_slab;
+
+typedef struct tag_rbtree_pool {
+    struct rbtree_slab *slabs;
+    tree_node *free_nodes;
+    tree_node *node_cur, *node_end;
+    char *key_cur, *key_end;
+} rbtree_pool;
+
+void rbtree_pool_init(rbtree_pool *pool);
+int rbtree_pool_add_element(rbtree_pool *pool, tree_node **root,
+        const char *key, void *data);
+int rbtree_pool_remove_element(rbtree_pool *pool, tree_node **root,
+        const char *key);
+int rbtree_pool_add_element_len(rbtree_pool *pool, tree_node **root,
+        const char *key, size_t len, void *data);
+int rbtree_pool_remove_element_len(rbtree_pool *pool, tree_node **root,
+        const char *key, size_t len);
+/* Insertion with a hint, for keys coming in (nearly) sorted order: the
+ * search starts from the hint node instead of the root, climbing only as
+ * far as the key is out of the hint's subtree, so a key next to the hint
+ * costs O(1) compares instead of O(log n) (the climb still takes up to
+ * O(log n) steps along parent pointers, the whole right spine for keys
+ * past the last one, but no compares). Any node of the tree works as
+ * the hint (NULL means the root), the best one is the element inserted
+ * last, which is what these return: the new node, or the one that already
+ * had the key. added (if not NULL) tells which one it is.
+ *
+ * Removals may free or reuse any node, so hints must not be kept across
+ * them. */
+const tree_node *rbtree_add_element_hint(tree_node **root,
+        const tree_node *hint, const char *key, void *data, int *added);
+const tree_node *rbtree_pool_add_element_hint(rbtree_pool *pool,
+        tree_node **root, const tree_node *hint, const char *key,
+        void *data, int *added);
+
+/* frees all the trees in the pool, the roots become dangling */
+void rbtree_pool_destroy(rbtree_pool *pool);
+
+/* Bulk loading, keys must be in strictly increasing order, data may be
+ * NULL (then all the elements get NULL data).
+ *
+ * rbtree_build_sorted builds a balanced tree in *root (must be empty) in
+ * linear time, without rotations. It needs a pool: all the nodes are
+ * taken from one contiguous slab of it. Returns 0 if there is no pool or
+ * the keys are not sorted. In the malloc mode rbtree_merge_sorted into an
+ * empty tree builds the same tree, with one allocation per node.
+ *
+ * rbtree_merge_sorted adds a batch to an existing tree, skipping keys
+ * already in it. Big batches are merged with the in-order sequence of the
+ * tree and the nodes are relinked into a new balanced tree in
+ * O(n + m), small ones are added one by one. Returns the number of
+ * elements added. Unsorted batches are also accepted, but get added one
+ * by one. */
+int rbtree_build_sorted(rbtree_pool *pool, tree_node **root,
+        const char *const *keys, void *const *data, int n);
+int rbtree_merge_sorted(rbtree_pool *pool, tree_node **root,
+        const char *const *keys, void *const *data, int n);
+
+/* Set operations, done by splitting and joining whole subtrees instead of
+ * adding the elements one by one, in O(m log(n/m + 1)) for trees of
+ * m <= n elements.
+ *
+ * They consume both trees: the result is made of their nodes, and the
+ * nodes left out are freed (into the pool, if given, both trees must then
+ * be from it). For keys in both trees the node (and data) of a is kept.
+ *
+ * With threads > 1 the independent halves of the top recursion levels
+ * are run on up to that many threads (the calling one included). */
+tree_node *rbtree_union(rbtree_pool *pool, tree_node *a, tree_node *b,
+        int threads);
+tree_node *rbtree_intersection(rbtree_pool *pool, tree_node *a,
+        tree_node *b, int threads);
+/* the elements of a not in b */
+tree_node *rbtree_difference(rbtree_pool *pool, tree_node *a, tree_node *b,
+        int threads);
+
 #endif
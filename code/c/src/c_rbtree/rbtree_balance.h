@@ -0,0 +1,256 @@
+/* rbtree/rbtree_balance.h */
+#ifndef RBTREE_BALANCE_SENTRY
+#define RBTREE_BALANCE_SENTRY
+
+/* The rotations and the insertion/deletion cases of the red-black tree,
+ * closely following the wiki page, for any node type with left, right,
+ * parent and color fields. Included by rbtree.c (on tree_node) and
+ * intrusive_rbtree.c (on irb_link), so both balance the same way.
+ *
+ * Before including, define:
+ *   RB_NODE         the node type
+ *   RB_ROTATED(n)   done on the two nodes a rotation moved, the lower one
+ *                   first (sizes), may be empty
+ *
+ * The entry points are insert_case_1, on a new red node linked in, and
+ * delete_case_1, on the child (possibly null) that took the place of a
+ * removed black node, with its parent. */
+
+/* General data structure utility functions */
+
+static int is_black(RB_NODE *n)
+{
+    return !n || n->color == black;
+}
+
+static int is_red(RB_NODE *n)
+{
+    return !is_black(n);
+}
+
+static RB_NODE *grandparent(const RB_NODE *n)
+{
+    return (n && n->parent) ? n->parent->parent : NULL;
+}
+
+static RB_NODE *uncle(const RB_NODE *n)
+{
+    const RB_NODE *gp;
+    gp = grandparent(n);
+
+    if (gp)
+        return n->parent == gp->left ? gp->right : gp->left;
+    else
+        return NULL;
+}
+
+static RB_NODE *sibling(const RB_NODE *n, const RB_NODE *parent)
+{
+    if (!parent)
+        return NULL;
+
+    return n == parent->left ? parent->right : parent->left;
+}
+
+static void rotate_left(RB_NODE *n, RB_NODE **root)
+{
+    RB_NODE *pivot;
+
+    if (!n || !(n->right))
+        return;
+
+    pivot = n->right;
+    pivot->parent = n->parent;
+
+    if (n->parent) {
+        if (n == n->parent->left)
+            n->parent->left = pivot;
+        else
+            n->parent->right = pivot;
+    } else
+        *root = pivot;
+
+    n->right = pivot->left;
+    if (pivot->left)
+        pivot->left->parent = n;
+    n->parent = pivot;
+    pivot->left = n;
+
+    RB_ROTATED(n);
+    RB_ROTATED(pivot);
+}
+
+static void rotate_right(RB_NODE *n, RB_NODE **root)
+{
+    RB_NODE *pivot;
+
+    if (!n || !(n->left))
+        return;
+
+    pivot = n->left;
+    pivot->parent = n->parent;
+
+    if (n->parent) {
+        if (n == n->parent->left)
+            n->parent->left = pivot;
+        else
+            n->parent->right = pivot;
+    } else
+        *root = pivot;
+
+    n->left = pivot->right;
+    if (pivot->right)
+        pivot->right->parent = n;
+    n->parent = pivot;
+    pivot->right = n;
+
+    RB_ROTATED(n);
+    RB_ROTATED(pivot);
+}
+
+/* Insertion */
+
+static void insert_case_1(RB_NODE *n, RB_NODE **root);
+static void insert_case_2(RB_NODE *n, RB_NODE **root);
+static void insert_case_3(RB_NODE *n, RB_NODE **root);
+static void insert_case_4(RB_NODE *n, RB_NODE **root);
+
+static void insert_case_1(RB_NODE *n, RB_NODE **root)
+{
+    if (!(n->parent))
+        n->color = black;
+    else if (is_red(n->parent))
+        insert_case_2(n, root);
+}
+
+static void insert_case_2(RB_NODE *n, RB_NODE **root)
+{
+    RB_NODE *gp, *un;
+
+    un = uncle(n);
+    if (is_red(un)) {
+        n->parent->color = black;
+        un->color = black;
+
+        gp = grandparent(n);
+        gp->color = red;
+        insert_case_1(gp, root);
+    } else
+        insert_case_3(n, root);
+}
+
+static void insert_case_3(RB_NODE *n, RB_NODE **root)
+{
+    RB_NODE *gp;
+
+    gp = grandparent(n);
+    if (n->parent == gp->left && n == n->parent->right) {
+        rotate_left(n->parent, root);
+        n = n->left;
+    } else if (n->parent == gp->right && n == n->parent->left) {
+        rotate_right(n->parent, root);
+        n = n->right;
+    }
+
+    insert_case_4(n, root);
+}
+
+static void insert_case_4(RB_NODE *n, RB_NODE **root)
+{
+    RB_NODE *gp;
+
+    gp = grandparent(n);
+    n->parent->color = black;
+    gp->color = red;
+
+    if (n == n->parent->left && n->parent == gp->left)
+        rotate_right(gp, root);
+    else
+        rotate_left(gp, root);
+}
+
+/* Deletion */
+
+static void delete_case_1(RB_NODE *n, RB_NODE *parent, RB_NODE **root);
+static void delete_case_2(RB_NODE *n, RB_NODE *parent, RB_NODE **root);
+static void delete_case_3(RB_NODE *n, RB_NODE *parent, RB_NODE **root);
+static void delete_case_4(RB_NODE *n, RB_NODE *parent, RB_NODE **root);
+static void delete_case_5(RB_NODE *n, RB_NODE *parent, RB_NODE **root);
+
+static void delete_case_1(RB_NODE *n, RB_NODE *parent, RB_NODE **root)
+{
+    if (is_red(n))
+        n->color = black;
+    else if (parent)
+        delete_case_2(n, parent, root);
+}
+
+static void delete_case_2(RB_NODE *n, RB_NODE *parent, RB_NODE **root)
+{
+    RB_NODE *s;
+    s = sibling(n, parent);
+
+    if (is_red(s)) {
+        s->color = black;
+        parent->color = red;
+        if (n == parent->left)
+            rotate_left(parent, root);
+        else
+            rotate_right(parent, root);
+    }
+
+    delete_case_3(n, parent, root);
+}
+
+static void delete_case_3(RB_NODE *n, RB_NODE *parent, RB_NODE **root)
+{
+    RB_NODE *s;
+    s = sibling(n, parent);
+
+    if (s && is_black(s->left) && is_black(s->right)) {
+        s->color = red;
+        if (parent->color == black)
+            delete_case_1(parent, parent->parent, root);
+        else
+            parent->color = black;
+    } else
+        delete_case_4(n, parent, root);
+}
+
+static void delete_case_4(RB_NODE *n, RB_NODE *parent, RB_NODE **root)
+{
+    RB_NODE *s;
+    s = sibling(n, parent);
+
+    if (s && n == parent->left && is_red(s->left) && is_black(s->right)) {
+        s->color = red;
+        s->left->color = black;
+        rotate_right(s, root);
+    }
+    else if (s && n == parent->right && is_red(s->right) && is_black(s->left)) {
+        s->color = red;
+        s->right->color = black;
+        rotate_left(s, root);
+    }
+
+    delete_case_5(n, parent, root);
+}
+
+static void delete_case_5(RB_NODE *n, RB_NODE *parent, RB_NODE **root)
+{
+    RB_NODE *s;
+    s = sibling(n, parent);
+
+    s->color = parent->color;
+    parent->color = black;
+
+    if (n == parent->left) {
+        s->right->color = black;
+        rotate_left(parent, root);
+    } else {
+        s->left->color = black;
+        rotate_right(parent, root);
+    }
+}
+
+#endif
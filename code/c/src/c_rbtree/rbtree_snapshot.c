@@ -0,0 +1,337 @@
+/* rbtree/rbtree_snapshot.c */
+#include "rbtree_snapshot.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* File layout:
+ *
+ *   header                 32 bytes
+ *   node_cnt records       32 bytes each, record 0 is the root
+ *   keys blob              keys_size bytes, every key followed by a '\0'
+ *
+ * The records are the sorted keys linked into a perfectly balanced tree
+ * (always taking the middle as the root, as link_balanced in rbtree.c),
+ * numbered in breadth-first order. No record points to the root, so 0
+ * doubles as "no child". The key prefix is the same big-endian number
+ * as in tree_node, so most steps of a lookup do not touch the blob.
+ *
+ * Lookups check every index and offset they follow against the sizes in
+ * the header, so a damaged file gives wrong answers, never bad reads.
+ * A snapshot is never rewritten in place, a new one replaces the file. */
+
+enum {
+    snapshot_version = 1,
+    snapshot_byte_order = 0x01020304,
+    snapshot_no_child = 0
+};
+
+static const char snapshot_magic[8] = "RBTSNAP";
+
+struct rbtree_snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t node_cnt;
+    uint64_t keys_size;
+};
+
+struct rbtree_snapshot_record {
+    uint64_t key_prefix;
+    uint64_t value;
+    uint32_t key_off;
+    uint32_t key_len;
+    uint32_t left, right;
+};
+
+/* a range of the sorted nodes, waiting for its record */
+struct pending_range {
+    uint64_t from, to;
+};
+
+/* API Impl and forward declarations */
+
+static FILE *create_temp_file(const char *path, char **tmp_path);
+static uint64_t key_prefix(const char *key, size_t len);
+static int compare_record(const rbtree_snapshot *s,
+        const struct rbtree_snapshot_record *r,
+        uint64_t prefix, const char *key, size_t len);
+
+int rbtree_snapshot_write(const tree_node *root, const char *path,
+        rbtree_snapshot_encoder encode, void *ctx)
+{
+    struct rbtree_snapshot_header header;
+    struct rbtree_snapshot_record rec;
+    struct pending_range *queue = NULL, range;
+    const tree_node **nodes = NULL, *n;
+    uint64_t cnt = 0, keys_size = 0, head, tail, mid, i;
+    uint32_t *key_offs = NULL;
+    char *tmp_path;
+    FILE *f;
+    int ok = 0;
+
+    for (n = rbtree_first(root); n; n = rbtree_next(n)) {
+        cnt++;
+        keys_size += n->key_len + 1;
+    }
+    if (keys_size > UINT32_MAX || cnt >= UINT32_MAX)
+        return 0;
+
+    f = create_temp_file(path, &tmp_path);
+    if (!f)
+        return 0;
+
+    nodes = malloc((cnt ? cnt : 1) * sizeof(*nodes));
+    key_offs = malloc((cnt ? cnt : 1) * sizeof(*key_offs));
+    queue = malloc((cnt ? cnt : 1) * sizeof(*queue));
+    if (!nodes || !key_offs || !queue)
+        goto out;
+
+    keys_size = 0;
+    for (n = rbtree_first(root), i = 0; n; n = rbtree_next(n), i++) {
+        nodes[i] = n;
+        key_offs[i] = (uint32_t)keys_size;
+        keys_size += n->key_len + 1;
+    }
+
+    memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+    header.version = snapshot_version;
+    header.byte_order = snapshot_byte_order;
+    header.node_cnt = cnt;
+    header.keys_size = keys_size;
+    if (fwrite(&header, sizeof(header), 1, f) != 1)
+        goto out;
+
+    /* breadth-first over the ranges, a child gets the index its range
+     * is queued at, which is the order the records are written in */
+    head = tail = 0;
+    if (cnt > 0) {
+        queue[tail].from = 0;
+        queue[tail].to = cnt;
+        tail++;
+    }
+
+    while (head < tail) {
+        range = queue[head++];
+        mid = range.from + (range.to - range.from) / 2;
+        n = nodes[mid];
+
+        rec.key_prefix = n->key_prefix;
+        rec.value = encode ? encode(n, ctx) : 0;
+        rec.key_off = key_offs[mid];
+        rec.key_len = n->key_len;
+        rec.left = rec.right = snapshot_no_child;
+
+        if (mid > range.from) {
+            rec.left = (uint32_t)tail;
+            queue[tail].from = range.from;
+            queue[tail].to = mid;
+            tail++;
+        }
+        if (mid + 1 < range.to) {
+            rec.right = (uint32_t)tail;
+            queue[tail].from = mid + 1;
+            queue[tail].to = range.to;
+            tail++;
+        }
+
+        if (fwrite(&rec, sizeof(rec), 1, f) != 1)
+            goto out;
+    }
+
+    for (i = 0; i < cnt; i++) {
+        if (fwrite(nodes[i]->key, 1, nodes[i]->key_len + 1, f) !=
+                nodes[i]->key_len + 1)
+            goto out;
+    }
+
+    ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+
+out:
+    free(queue);
+    free(key_offs);
+    free(nodes);
+    if (fclose(f) != 0)
+        ok = 0;
+    if (ok && rename(tmp_path, path) != 0)
+        ok = 0;
+    if (!ok)
+        remove(tmp_path);
+
+    free(tmp_path);
+    return ok;
+}
+
+int rbtree_snapshot_open(rbtree_snapshot *s, const char *path)
+{
+    const struct rbtree_snapshot_header *header;
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return 0;
+
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(*header)) {
+        close(fd);
+        return 0;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 0;
+
+    header = map;
+    if (memcmp(header->magic, snapshot_magic, sizeof(header->magic)) != 0 ||
+            header->version != snapshot_version ||
+            header->byte_order != snapshot_byte_order ||
+            header->node_cnt > (st.st_size - sizeof(*header)) /
+                sizeof(struct rbtree_snapshot_record) ||
+            header->keys_size != st.st_size - sizeof(*header) -
+                header->node_cnt * sizeof(struct rbtree_snapshot_record))
+    {
+        munmap(map, st.st_size);
+        return 0;
+    }
+
+    s->map = map;
+    s->map_size = st.st_size;
+    s->node_cnt = header->node_cnt;
+    s->nodes = (const struct rbtree_snapshot_record *)(header + 1);
+    s->keys_size = header->keys_size;
+    s->keys = (const char *)(s->nodes + s->node_cnt);
+
+    return 1;
+}
+
+void rbtree_snapshot_close(rbtree_snapshot *s)
+{
+    if (s->map)
+        munmap(s->map, s->map_size);
+    s->map = NULL;
+    s->map_size = 0;
+}
+
+int rbtree_snapshot_get(const rbtree_snapshot *s, const char *key,
+        uint64_t *value)
+{
+    return rbtree_snapshot_get_len(s, key, strlen(key), value);
+}
+
+int rbtree_snapshot_get_len(const rbtree_snapshot *s, const char *key,
+        size_t len, uint64_t *value)
+{
+    const struct rbtree_snapshot_record *r;
+    uint64_t prefix, i, child;
+    int comp_res;
+
+    if (s->node_cnt == 0)
+        return 0;
+
+    prefix = key_prefix(key, len);
+
+    for (i = 0;;) {
+        r = &s->nodes[i];
+        comp_res = compare_record(s, r, prefix, key, len);
+
+        if (comp_res == 0) {
+            if (value)
+                *value = r->value;
+            return 1;
+        }
+
+        /* children always come after their parent in the file, so this
+         * also stops at a damaged record pointing back up the tree */
+        child = comp_res > 0 ? r->left : r->right;
+        if (child == snapshot_no_child || child <= i ||
+                child >= s->node_cnt)
+            return 0;
+        i = child;
+    }
+}
+
+/* Files */
+
+/* The snapshot is written next to the target and renamed over it when
+ * complete, as truncating a file that other processes have mapped would
+ * make their next read of it fault. The name has the pid in it, so only
+ * writers in the same process can clash, and then the later one fails. */
+static FILE *create_temp_file(const char *path, char **tmp_path)
+{
+    size_t size = strlen(path) + 32;
+    FILE *f;
+    int fd;
+
+    *tmp_path = malloc(size);
+    if (!*tmp_path)
+        return NULL;
+    snprintf(*tmp_path, size, "%s.%ld.tmp", path, (long)getpid());
+
+    fd = open(*tmp_path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (fd == -1) {
+        free(*tmp_path);
+        return NULL;
+    }
+
+    f = fdopen(fd, "wb");
+    if (!f) {
+        close(fd);
+        remove(*tmp_path);
+        free(*tmp_path);
+        return NULL;
+    }
+
+    return f;
+}
+
+/* Keys */
+
+/* same as make_search_key in rbtree.c */
+static uint64_t key_prefix(const char *key, size_t len)
+{
+    uint64_t prefix = 0;
+    size_t i;
+
+    for (i = 0; i < 8; i++) {
+        prefix <<= 8;
+        if (i < len)
+            prefix |= (unsigned char)key[i];
+    }
+
+    return prefix;
+}
+
+/* Sign of (record key - key), as compare_key in rbtree.c. A key outside
+ * of the blob compares as empty. */
+static int compare_record(const rbtree_snapshot *s,
+        const struct rbtree_snapshot_record *r,
+        uint64_t prefix, const char *key, size_t len)
+{
+    size_t rec_len, min_len;
+    int comp_res;
+
+    if (r->key_prefix != prefix)
+        return r->key_prefix < prefix ? -1 : 1;
+
+    rec_len = r->key_len;
+    if ((uint64_t)r->key_off + rec_len > s->keys_size)
+        rec_len = 0;
+
+    if (rec_len > 8 && len > 8) {
+        min_len = rec_len < len ? rec_len : len;
+        comp_res = memcmp(s->keys + r->key_off + 8, key + 8, min_len - 8);
+        if (comp_res != 0)
+            return comp_res;
+    }
+
+    if (rec_len == len)
+        return 0;
+
+    return rec_len < len ? -1 : 1;
+}
@@ -0,0 +1,58 @@
+/* rbtree/rbtree_snapshot.h */
+#ifndef RBTREE_SNAPSHOT_SENTRY
+#define RBTREE_SNAPSHOT_SENTRY
+
+#include "rbtree.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* inteface for saving an rbtree dictionary into a file, and looking keys
+ * up right in the memory-mapped file, without rebuilding the tree.
+ *
+ * The file has no pointers in it: all the keys are in one blob in sorted
+ * order, and the nodes are fixed-size records pointing to their keys and
+ * children by offset/index. The records form a balanced search tree laid
+ * out level by level, so the top levels, which every lookup goes
+ * through, are packed into the first few pages. Opening a snapshot is
+ * one mmap, the pages are loaded on first use and shared between all the
+ * processes mapping the same file.
+ *
+ * Data pointers mean nothing in another process, so each element gets
+ * a 64-bit value instead, made from the node by the encoder passed to
+ * rbtree_snapshot_write (an index, a file offset, a number...), NULL
+ * encoder means 0 for all. The file is in the byte order of the machine
+ * that wrote it, opening it on another one fails. */
+
+struct rbtree_snapshot_record;
+
+typedef uint64_t (*rbtree_snapshot_encoder)(const tree_node *n, void *ctx);
+
+typedef struct tag_rbtree_snapshot {
+    void *map;
+    size_t map_size;
+    const struct rbtree_snapshot_record *nodes;
+    uint64_t node_cnt;
+    const char *keys;
+    uint64_t keys_size;
+} rbtree_snapshot;
+
+/* Writes to a temporary file in the same directory, renamed to path
+ * once complete, so the processes that have the old snapshot open keep
+ * reading it unchanged. Returns 1 on success, 0 if the file could not be
+ * written (path is then left as it was). */
+int rbtree_snapshot_write(const tree_node *root, const char *path,
+        rbtree_snapshot_encoder encode, void *ctx);
+
+/* returns 1 on success, 0 if the file is missing or not a valid snapshot */
+int rbtree_snapshot_open(rbtree_snapshot *s, const char *path);
+void rbtree_snapshot_close(rbtree_snapshot *s);
+
+/* return 1 and put the element value into *value (if not NULL) if the key
+ * is in the snapshot, 0 else */
+int rbtree_snapshot_get(const rbtree_snapshot *s, const char *key,
+        uint64_t *value);
+int rbtree_snapshot_get_len(const rbtree_snapshot *s, const char *key,
+        size_t len, uint64_t *value);
+
+#endif
@@ -0,0 +1,602 @@
+/* rbtree/rcu_rbtree.c */
+#include "rcu_rbtree.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* The balancing is the same as in rbtree.c, but with no parent pointers
+ * (a copied node would invalidate the parent pointers of its children):
+ * the writer keeps the path from the root on a stack instead.
+ *
+ * A node may only be changed by the write that created it, which is
+ * checked with the txn stamp. Anything else is copied first, see own(). */
+
+struct rcu_tree_node {
+    struct rcu_tree_node *left, *right;
+    char *key;
+    void *data;
+    unsigned long txn;
+    node_color color;
+};
+
+/* the memory freed by one write, to be freed after the epoch */
+struct rcu_retired_batch {
+    unsigned long epoch;
+    void **ptrs;
+    int cnt, cap;
+    struct rcu_retired_batch *next;
+};
+
+/* enough for 2^64 elements, as the height is at most 2 * log2(n + 1) */
+enum { max_path_len = 130 };
+
+/* state of one write in progress */
+struct write_op {
+    rcu_rbtree *t;
+    struct rcu_tree_node *root;
+    struct rcu_tree_node *path[max_path_len];
+    int path_len;
+    struct rcu_retired_batch *batch;
+};
+
+/* API Impl and forward declarations */
+
+void rcu_rbtree_init(rcu_rbtree *t)
+{
+    atomic_init(&t->root, NULL);
+    atomic_init(&t->epoch, 1);
+    pthread_mutex_init(&t->write_mutex, NULL);
+    t->txn = 0;
+    t->readers = NULL;
+    t->retired = t->retired_last = NULL;
+}
+
+static void free_subtree(struct rcu_tree_node *root);
+static void free_batch(struct rcu_retired_batch *b);
+
+void rcu_rbtree_destroy(rcu_rbtree *t)
+{
+    struct rcu_retired_batch *next;
+
+    free_subtree(atomic_load(&t->root));
+
+    for (; t->retired; t->retired = next) {
+        next = t->retired->next;
+        free_batch(t->retired);
+    }
+
+    pthread_mutex_destroy(&t->write_mutex);
+}
+
+void rcu_rbtree_reader_register(rcu_rbtree *t, rcu_rbtree_reader *r)
+{
+    atomic_init(&r->epoch, 0);
+
+    pthread_mutex_lock(&t->write_mutex);
+    r->next = t->readers;
+    t->readers = r;
+    pthread_mutex_unlock(&t->write_mutex);
+}
+
+void rcu_rbtree_reader_unregister(rcu_rbtree *t, rcu_rbtree_reader *r)
+{
+    rcu_rbtree_reader **rp;
+
+    pthread_mutex_lock(&t->write_mutex);
+    for (rp = &t->readers; *rp; rp = &(*rp)->next) {
+        if (*rp == r) {
+            *rp = r->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&t->write_mutex);
+}
+
+/* All the accesses to the epochs and the root are sequentially
+ * consistent: if a writer sees a reader slot as free, the reader's
+ * later load of the root is ordered after the publication, so it can
+ * not reach anything retired by then. */
+int rcu_rbtree_get_element(rcu_rbtree *t, rcu_rbtree_reader *r,
+        const char *key, void **data)
+{
+    const struct rcu_tree_node *n;
+    int comp_res, found = 0;
+
+    atomic_store(&r->epoch, atomic_load(&t->epoch));
+
+    n = atomic_load(&t->root);
+    while (n) {
+        comp_res = strcmp(n->key, key);
+
+        if (comp_res == 0) {
+            if (data)
+                *data = n->data;
+            found = 1;
+            break;
+        }
+
+        n = comp_res > 0 ? n->left : n->right;
+    }
+
+    atomic_store(&r->epoch, 0);
+
+    return found;
+}
+
+static void begin_write(rcu_rbtree *t, struct write_op *op);
+static void commit_write(struct write_op *op);
+static int find_path(struct write_op *op, const char *key);
+static void copy_path(struct write_op *op, int len);
+static struct rcu_tree_node *create_node(struct write_op *op,
+        const char *key, void *data);
+static void insert_fixup(struct write_op *op);
+static void remove_at_path_end(struct write_op *op);
+
+int rcu_rbtree_add_element(rcu_rbtree *t, const char *key, void *data)
+{
+    struct write_op op;
+    struct rcu_tree_node *n, *parent;
+
+    begin_write(t, &op);
+
+    if (find_path(&op, key)) {
+        pthread_mutex_unlock(&t->write_mutex);
+        return 0;
+    }
+
+    copy_path(&op, op.path_len);
+
+    n = create_node(&op, key, data);
+    if (op.path_len == 0)
+        op.root = n;
+    else {
+        parent = op.path[op.path_len - 1];
+        if (strcmp(parent->key, key) > 0)
+            parent->left = n;
+        else
+            parent->right = n;
+    }
+    op.path[op.path_len++] = n;
+
+    insert_fixup(&op);
+
+    commit_write(&op);
+    return 1;
+}
+
+int rcu_rbtree_remove_element(rcu_rbtree *t, const char *key)
+{
+    struct write_op op;
+
+    begin_write(t, &op);
+
+    if (!find_path(&op, key)) {
+        pthread_mutex_unlock(&t->write_mutex);
+        return 0;
+    }
+
+    remove_at_path_end(&op);
+
+    commit_write(&op);
+    return 1;
+}
+
+/* Memory functions */
+
+/* nodes have no parent pointers, so the walk keeps its own stack */
+static void free_subtree(struct rcu_tree_node *root)
+{
+    struct rcu_tree_node *stack[max_path_len], *n;
+    int top = 0;
+
+    if (root)
+        stack[top++] = root;
+
+    while (top > 0) {
+        n = stack[--top];
+        if (n->left)
+            stack[top++] = n->left;
+        if (n->right)
+            stack[top++] = n->right;
+
+        free(n->key);
+        free(n);
+    }
+}
+
+static void free_batch(struct rcu_retired_batch *b)
+{
+    int i;
+
+    for (i = 0; i < b->cnt; i++)
+        free(b->ptrs[i]);
+
+    free(b->ptrs);
+    free(b);
+}
+
+static void retire(struct write_op *op, void *p)
+{
+    struct rcu_retired_batch *b;
+
+    if (!op->batch) {
+        op->batch = malloc(sizeof(*op->batch));
+        op->batch->cnt = 0;
+        op->batch->cap = 16;
+        op->batch->ptrs = malloc(op->batch->cap * sizeof(*op->batch->ptrs));
+        op->batch->next = NULL;
+    }
+
+    b = op->batch;
+    if (b->cnt == b->cap) {
+        b->cap *= 2;
+        b->ptrs = realloc(b->ptrs, b->cap * sizeof(*b->ptrs));
+    }
+
+    b->ptrs[b->cnt++] = p;
+}
+
+/* frees the batches retired before any epoch a reader is still in */
+static void reclaim(rcu_rbtree *t)
+{
+    struct rcu_retired_batch *next;
+    rcu_rbtree_reader *r;
+    unsigned long min_epoch, e;
+
+    min_epoch = atomic_load(&t->epoch);
+    for (r = t->readers; r; r = r->next) {
+        e = atomic_load(&r->epoch);
+        if (e != 0 && e < min_epoch)
+            min_epoch = e;
+    }
+
+    while (t->retired && t->retired->epoch < min_epoch) {
+        next = t->retired->next;
+        free_batch(t->retired);
+        t->retired = next;
+    }
+
+    if (!t->retired)
+        t->retired_last = NULL;
+}
+
+static struct rcu_tree_node *create_node(struct write_op *op,
+        const char *key, void *data)
+{
+    struct rcu_tree_node *n;
+    size_t key_size;
+
+    key_size = (strlen(key) + 1) * sizeof(char);
+
+    n = malloc(sizeof(*n));
+    n->key = malloc(key_size);
+    memcpy(n->key, key, key_size);
+    n->data = data;
+    n->left = n->right = NULL;
+    n->txn = op->t->txn;
+    n->color = red;
+
+    return n;
+}
+
+/* Writes */
+
+static void begin_write(rcu_rbtree *t, struct write_op *op)
+{
+    pthread_mutex_lock(&t->write_mutex);
+
+    t->txn++;
+    op->t = t;
+    op->root = atomic_load(&t->root);
+    op->path_len = 0;
+    op->batch = NULL;
+}
+
+static void commit_write(struct write_op *op)
+{
+    rcu_rbtree *t = op->t;
+
+    atomic_store(&t->root, op->root);
+
+    /* anything retired now may still be seen by readers in this epoch */
+    if (op->batch) {
+        op->batch->epoch = atomic_fetch_add(&t->epoch, 1);
+        if (t->retired_last)
+            t->retired_last->next = op->batch;
+        else
+            t->retired = op->batch;
+        t->retired_last = op->batch;
+    }
+
+    reclaim(t);
+
+    pthread_mutex_unlock(&t->write_mutex);
+}
+
+/* Fills the path from the root to the node with the key (returns 1), or
+ * to the node under which it would be inserted (returns 0). */
+static int find_path(struct write_op *op, const char *key)
+{
+    struct rcu_tree_node *n;
+    int comp_res;
+
+    for (n = op->root; n; n = comp_res > 0 ? n->left : n->right) {
+        op->path[op->path_len++] = n;
+
+        comp_res = strcmp(n->key, key);
+        if (comp_res == 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+static void set_child(struct write_op *op, struct rcu_tree_node *parent,
+        struct rcu_tree_node *old, struct rcu_tree_node *new)
+{
+    if (!parent)
+        op->root = new;
+    else if (parent->left == old)
+        parent->left = new;
+    else
+        parent->right = new;
+}
+
+/* Makes n changeable by this write: returns n itself if this write
+ * created it, or else a copy put in place of n under the (already owned)
+ * parent, retiring n. */
+static struct rcu_tree_node *own(struct write_op *op,
+        struct rcu_tree_node *parent, struct rcu_tree_node *n)
+{
+    struct rcu_tree_node *copy;
+
+    if (!n || n->txn == op->t->txn)
+        return n;
+
+    copy = malloc(sizeof(*copy));
+    *copy = *n;
+    copy->txn = op->t->txn;
+
+    set_child(op, parent, n, copy);
+    retire(op, n);
+
+    return copy;
+}
+
+static void copy_path(struct write_op *op, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+        op->path[i] = own(op, i > 0 ? op->path[i-1] : NULL, op->path[i]);
+}
+
+/* General data structure utility functions */
+
+static int is_black(const struct rcu_tree_node *n)
+{
+    return !n || n->color == black;
+}
+
+static int is_red(const struct rcu_tree_node *n)
+{
+    return !is_black(n);
+}
+
+/* n, its right child and the parent of n must be owned */
+static void rotate_left(struct write_op *op, struct rcu_tree_node *n,
+        struct rcu_tree_node *parent)
+{
+    struct rcu_tree_node *pivot;
+
+    pivot = n->right;
+    set_child(op, parent, n, pivot);
+    n->right = pivot->left;
+    pivot->left = n;
+}
+
+/* n, its left child and the parent of n must be owned */
+static void rotate_right(struct write_op *op, struct rcu_tree_node *n,
+        struct rcu_tree_node *parent)
+{
+    struct rcu_tree_node *pivot;
+
+    pivot = n->left;
+    set_child(op, parent, n, pivot);
+    n->left = pivot->right;
+    pivot->right = n;
+}
+
+/* Insertion */
+
+/* The cases of rbtree.c as one loop, the new node is at the end of the
+ * (owned) path, parents and grandparents are taken from the path. */
+static void insert_fixup(struct write_op *op)
+{
+    struct rcu_tree_node *n, *p, *gp, *un, *ggp;
+    int i;
+
+    i = op->path_len - 1;
+
+    for (;;) {
+        n = op->path[i];
+
+        /* case 1 */
+        if (i == 0) {
+            n->color = black;
+            return;
+        }
+
+        p = op->path[i-1];
+        if (is_black(p))
+            return;
+
+        /* a red parent is never the root */
+        gp = op->path[i-2];
+
+        /* case 2 */
+        un = p == gp->left ? gp->right : gp->left;
+        if (is_red(un)) {
+            un = own(op, gp, un);
+            p->color = black;
+            un->color = black;
+            gp->color = red;
+            i -= 2;
+            continue;
+        }
+
+        /* case 3 */
+        if (p == gp->left && n == p->right) {
+            rotate_left(op, p, gp);
+            op->path[i-1] = n;
+            op->path[i] = p;
+        } else if (p == gp->right && n == p->left) {
+            rotate_right(op, p, gp);
+            op->path[i-1] = n;
+            op->path[i] = p;
+        }
+
+        /* case 4 */
+        n = op->path[i];
+        p = op->path[i-1];
+        ggp = i >= 3 ? op->path[i-3] : NULL;
+
+        p->color = black;
+        gp->color = red;
+        if (n == p->left && p == gp->left)
+            rotate_right(op, gp, ggp);
+        else
+            rotate_left(op, gp, ggp);
+
+        return;
+    }
+}
+
+/* Deletion */
+
+static void delete_fixup(struct write_op *op, struct rcu_tree_node *n,
+        int n_is_left, int parent_i);
+
+/* removes the node at the end of the path */
+static void remove_at_path_end(struct write_op *op)
+{
+    struct rcu_tree_node *n, *repl, *parent, *c;
+    int n_i, parent_i, is_left;
+
+    n_i = op->path_len - 1;
+    n = op->path[n_i];
+
+    /* with two children, the predecessor takes the place of the element
+     * and is removed instead */
+    if (n->left && n->right) {
+        for (repl = n->left; repl; repl = repl->right)
+            op->path[op->path_len++] = repl;
+    }
+
+    /* the node to unlink is left as is, only copy down to its parent */
+    copy_path(op, op->path_len - 1);
+
+    if (op->path_len - 1 != n_i) {
+        n = op->path[n_i];
+        repl = op->path[op->path_len - 1];
+
+        retire(op, n->key);
+        n->key = repl->key;
+        n->data = repl->data;
+    } else
+        retire(op, n->key);
+
+    repl = op->path[--op->path_len];
+    parent_i = op->path_len - 1;
+    parent = parent_i >= 0 ? op->path[parent_i] : NULL;
+
+    c = repl->left ? repl->left : repl->right;
+    is_left = parent && parent->left == repl;
+    set_child(op, parent, repl, c);
+    retire(op, repl);
+
+    if (repl->color == black)
+        delete_fixup(op, c, is_left, parent_i);
+}
+
+/* The cases of rbtree.c as one loop, n (possibly null) is the child of
+ * the path node at parent_i, which is one black short on its side. */
+static void delete_fixup(struct write_op *op, struct rcu_tree_node *n,
+        int n_is_left, int parent_i)
+{
+    struct rcu_tree_node *parent, *gp, *s;
+
+    for (;;) {
+        parent = parent_i >= 0 ? op->path[parent_i] : NULL;
+
+        /* case 1 */
+        if (is_red(n)) {
+            n = own(op, parent, n);
+            n->color = black;
+            return;
+        }
+        if (!parent)
+            return;
+
+        gp = parent_i > 0 ? op->path[parent_i - 1] : NULL;
+
+        /* case 2 */
+        s = n_is_left ? parent->right : parent->left;
+        if (is_red(s)) {
+            s = own(op, parent, s);
+            s->color = black;
+            parent->color = red;
+            if (n_is_left)
+                rotate_left(op, parent, gp);
+            else
+                rotate_right(op, parent, gp);
+            gp = s;
+        }
+
+        /* case 3 */
+        s = n_is_left ? parent->right : parent->left;
+        if (is_black(s->left) && is_black(s->right)) {
+            s = own(op, parent, s);
+            s->color = red;
+            if (parent->color == red) {
+                parent->color = black;
+                return;
+            }
+
+            /* only when nothing was rotated, so the path is still valid */
+            n = parent;
+            n_is_left = gp && gp->left == parent;
+            parent_i--;
+            continue;
+        }
+
+        /* case 4 */
+        s = own(op, parent, s);
+        if (n_is_left && is_red(s->left) && is_black(s->right)) {
+            s->left = own(op, s, s->left);
+            s->color = red;
+            s->left->color = black;
+            rotate_right(op, s, parent);
+        } else if (!n_is_left && is_red(s->right) && is_black(s->left)) {
+            s->right = own(op, s, s->right);
+            s->color = red;
+            s->right->color = black;
+            rotate_left(op, s, parent);
+        }
+
+        /* case 5 */
+        s = n_is_left ? parent->right : parent->left;
+        s->color = parent->color;
+        parent->color = black;
+        if (n_is_left) {
+            s->right = own(op, s, s->right);
+            s->right->color = black;
+            rotate_left(op, parent, gp);
+        } else {
+            s->left = own(op, s, s->left);
+            s->left->color = black;
+            rotate_right(op, parent, gp);
+        }
+
+        return;
+    }
+}
@@ -0,0 +1,57 @@
+/* rbtree/rcu_rbtree.h */
+#ifndef RCU_RBTREE_SENTRY
+#define RCU_RBTREE_SENTRY
+
+#include "rbtree.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* inteface for the concurrent version of the rbtree dictionary, for many
+ * readers and rare writers.
+ *
+ * Lookups take no locks and never wait: published nodes are never
+ * changed. A writer copies the path it touches (and the few siblings
+ * the balancing recolors or rotates), then publishes the new root in one
+ * atomic store. The replaced nodes are freed once no reader can see them
+ * anymore: every reader announces the epoch it entered at in its own
+ * slot, and the writers only free what was retired before the oldest
+ * announced epoch.
+ *
+ * Writers are serialized with a mutex. Every thread doing lookups needs
+ * its own registered reader. Keys are copied, data passed by reference,
+ * as in rbtree.h. */
+
+struct rcu_tree_node;
+struct rcu_retired_batch;
+
+/* aligned to its own cache line, so readers do not contend on slots */
+typedef struct tag_rcu_rbtree_reader {
+    _Alignas(64) atomic_ulong epoch;
+    struct tag_rcu_rbtree_reader *next;
+} rcu_rbtree_reader;
+
+typedef struct tag_rcu_rbtree {
+    struct rcu_tree_node *_Atomic root;
+    atomic_ulong epoch;
+    pthread_mutex_t write_mutex;
+    unsigned long txn;
+    rcu_rbtree_reader *readers;
+    struct rcu_retired_batch *retired, *retired_last;
+} rcu_rbtree;
+
+void rcu_rbtree_init(rcu_rbtree *t);
+/* frees everything, no other thread may be using the tree */
+void rcu_rbtree_destroy(rcu_rbtree *t);
+
+void rcu_rbtree_reader_register(rcu_rbtree *t, rcu_rbtree_reader *r);
+void rcu_rbtree_reader_unregister(rcu_rbtree *t, rcu_rbtree_reader *r);
+
+/* returns 1 and puts the element data into *data (if not NULL) if the key
+ * is in the tree, 0 else */
+int rcu_rbtree_get_element(rcu_rbtree *t, rcu_rbtree_reader *r,
+        const char *key, void **data);
+int rcu_rbtree_add_element(rcu_rbtree *t, const char *key, void *data);
+int rcu_rbtree_remove_element(rcu_rbtree *t, const char *key);
+
+#endif
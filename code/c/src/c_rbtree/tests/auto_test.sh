@@ -9,7 +9,9 @@ gcc -Wall -g generate_test.c -o generate_test.out
 
 # compile the test engine, and link it to rbtree (must be pre-compiled)
 gcc -Wall -g -c test_engine.c
-gcc -Wall -g test_engine.o ../rbtree.o -o test_engine.out
+gcc -Wall -g -c tree_check.c
+gcc -Wall -g test_engine.o tree_check.o ../rbtree.o -lpthread \
+    -o test_engine.out
 
 # for the specified amount of time generate test and redirect it's output
 # to the test engine
@@ -0,0 +1,360 @@
+/* rbtree/tests/bench.c */
+#include "../rbtree.h"
+#include "../../c_btree/btree.h"
+#include "../../c_hashtable/hashtable.h"
+#include "../../c_art/art.h"
+#include "test_rng.h"
+#include "perf_counter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* This program times the dictionaries against each other: for every size
+ * it adds the same random keys to each of them, looks them all up in a
+ * different random order, and removes them, printing ns per operation.
+ * The batch column is the same lookups done batch_size at a time, for the
+ * dictionaries that have a batched lookup. Where the cpu counters can be
+ * read (perf_event_open, not in most vms) the cache misses per lookup
+ * are printed too, otherwise they show as "-".
+ *
+ * Build (optimized, or the numbers are meaningless):
+ *   gcc -O2 bench.c ../rbtree.c ../../c_btree/btree.c \
+ *       ../../c_hashtable/hashtable.c ../../c_art/art.c -lpthread \
+ *       -o bench.out
+ * (add -mavx2 for the 32-wide hash table groups)
+ *
+ * Usage: ./bench.out [key counts...], by default 10^4 10^5 10^6
+ * (10^7 works too, but takes a couple of GB of memory). */
+
+enum { key_len = 16, default_sizes_cnt = 3, batch_size = 256 };
+
+static const int default_sizes[default_sizes_cnt] = { 10000, 100000, 1000000 };
+
+/* every dictionary behind the same interface */
+struct backend {
+    const char *name;
+    void *(*create)(void);
+    int (*add)(void *dict, const char *key, void *data);
+    int (*get)(void *dict, const char *key);
+    /* returns the number of keys found, NULL if there is no batched get */
+    int (*get_many)(void *dict, char **keys, int cnt);
+    int (*remove)(void *dict, const char *key);
+    void (*destroy)(void *dict);
+};
+
+/* rbtree, plain */
+
+static void *rbtree_create(void)
+{
+    return calloc(1, sizeof(tree_node *));
+}
+
+static int rbtree_add(void *dict, const char *key, void *data)
+{
+    return rbtree_add_element(dict, key, data);
+}
+
+static int rbtree_get(void *dict, const char *key)
+{
+    return rbtree_get_element(*(tree_node **)dict, key) != NULL;
+}
+
+static int rbtree_get_many_keys(void *dict, char **keys, int cnt)
+{
+    const tree_node *found[batch_size];
+    int i, res = 0;
+
+    rbtree_get_many(*(tree_node **)dict, (const char *const *)keys, cnt,
+            found);
+    for (i = 0; i < cnt; i++)
+        res += found[i] != NULL;
+
+    return res;
+}
+
+static int rbtree_remove(void *dict, const char *key)
+{
+    return rbtree_remove_element(dict, key);
+}
+
+static void rbtree_free(void *dict)
+{
+    rbtree_destroy(*(tree_node **)dict);
+    free(dict);
+}
+
+/* rbtree, pool mode */
+
+struct pooled_rbtree {
+    tree_node *root;
+    rbtree_pool pool;
+};
+
+static void *pooled_rbtree_create(void)
+{
+    struct pooled_rbtree *t;
+
+    t = malloc(sizeof(*t));
+    t->root = NULL;
+    rbtree_pool_init(&t->pool);
+    return t;
+}
+
+static int pooled_rbtree_add(void *dict, const char *key, void *data)
+{
+    struct pooled_rbtree *t = dict;
+    return rbtree_pool_add_element(&t->pool, &t->root, key, data);
+}
+
+static int pooled_rbtree_remove(void *dict, const char *key)
+{
+    struct pooled_rbtree *t = dict;
+    return rbtree_pool_remove_element(&t->pool, &t->root, key);
+}
+
+static void pooled_rbtree_free(void *dict)
+{
+    struct pooled_rbtree *t = dict;
+    rbtree_pool_destroy(&t->pool);
+    free(t);
+}
+
+/* btree */
+
+static void *btree_create(void)
+{
+    return calloc(1, sizeof(btree_node *));
+}
+
+static int btree_add(void *dict, const char *key, void *data)
+{
+    return btree_add_element(dict, key, data);
+}
+
+static int btree_get(void *dict, const char *key)
+{
+    return btree_get_element(*(btree_node **)dict, key, NULL);
+}
+
+static int btree_remove(void *dict, const char *key)
+{
+    return btree_remove_element(dict, key);
+}
+
+static void btree_free(void *dict)
+{
+    btree_destroy(*(btree_node **)dict);
+    free(dict);
+}
+
+/* hashtable */
+
+static void *hashtable_create(void)
+{
+    hashtable *t;
+
+    t = malloc(sizeof(*t));
+    hashtable_init(t);
+    return t;
+}
+
+static int hashtable_add(void *dict, const char *key, void *data)
+{
+    return hashtable_add_element(dict, key, data);
+}
+
+static int hashtable_get(void *dict, const char *key)
+{
+    return hashtable_get_element(dict, key, NULL);
+}
+
+static int hashtable_remove(void *dict, const char *key)
+{
+    return hashtable_remove_element(dict, key);
+}
+
+static void hashtable_free(void *dict)
+{
+    hashtable_destroy(dict);
+    free(dict);
+}
+
+/* art */
+
+static void *art_create(void)
+{
+    art_tree *t;
+
+    t = malloc(sizeof(*t));
+    art_init(t);
+    return t;
+}
+
+static int art_add(void *dict, const char *key, void *data)
+{
+    return art_add_element(dict, key, data);
+}
+
+static int art_get(void *dict, const char *key)
+{
+    return art_get_element(dict, key, NULL);
+}
+
+static int art_remove(void *dict, const char *key)
+{
+    return art_remove_element(dict, key);
+}
+
+static void art_free(void *dict)
+{
+    art_destroy(dict);
+    free(dict);
+}
+
+static const struct backend backends[] = {
+    { "rbtree", rbtree_create, rbtree_add, rbtree_get,
+        rbtree_get_many_keys, rbtree_remove, rbtree_free },
+    /* the root pointer is the first member, so the plain gets work */
+    { "rbtree (pool)", pooled_rbtree_create, pooled_rbtree_add, rbtree_get,
+        rbtree_get_many_keys, pooled_rbtree_remove, pooled_rbtree_free },
+    { "btree", btree_create, btree_add, btree_get, NULL, btree_remove,
+        btree_free },
+    { "hashtable", hashtable_create, hashtable_add, hashtable_get, NULL,
+        hashtable_remove, hashtable_free },
+    { "art", art_create, art_add, art_get, NULL, art_remove, art_free }
+};
+
+/* Workload */
+
+/* distinct keys: the index in hex, scrambled with random letters, so
+ * that the keys do not come in order and do not share long prefixes */
+static char **generate_keys(int cnt)
+{
+    char **keys;
+    int i, j;
+
+    keys = malloc(cnt * sizeof(*keys));
+    for (i = 0; i < cnt; i++) {
+        keys[i] = malloc(key_len + 1);
+        for (j = 0; j < key_len - 8; j++)
+            keys[i][j] = 'a' + rng_next() % 26;
+        sprintf(keys[i] + key_len - 8, "%08x", i);
+    }
+
+    return keys;
+}
+
+static void shuffle_keys(char **keys, int cnt)
+{
+    char *tmp;
+    int i, j;
+
+    for (i = cnt - 1; i > 0; i--) {
+        j = rng_next() % (i + 1);
+        tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double ns_per_op(double start, int cnt)
+{
+    return (now() - start) * 1e9 / cnt;
+}
+
+static int cache_misses_fd = -1;
+
+static void run_backend(const struct backend *b, char **keys, int cnt)
+{
+    void *dict;
+    double start, add_ns, get_ns, batch_ns = 0, remove_ns;
+    long long misses;
+    int i, batch, ok = 1;
+
+    dict = b->create();
+
+    shuffle_keys(keys, cnt);
+    start = now();
+    for (i = 0; i < cnt; i++)
+        ok &= b->add(dict, keys[i], keys[i]);
+    add_ns = ns_per_op(start, cnt);
+
+    shuffle_keys(keys, cnt);
+    perf_counter_start(cache_misses_fd);
+    start = now();
+    for (i = 0; i < cnt; i++)
+        ok &= b->get(dict, keys[i]);
+    get_ns = ns_per_op(start, cnt);
+    misses = perf_counter_stop(cache_misses_fd);
+
+    if (b->get_many) {
+        shuffle_keys(keys, cnt);
+        start = now();
+        for (i = 0; i < cnt; i += batch) {
+            batch = cnt - i < batch_size ? cnt - i : batch_size;
+            ok &= b->get_many(dict, keys + i, batch) == batch;
+        }
+        batch_ns = ns_per_op(start, cnt);
+    }
+
+    shuffle_keys(keys, cnt);
+    start = now();
+    for (i = 0; i < cnt; i++)
+        ok &= b->remove(dict, keys[i]);
+    remove_ns = ns_per_op(start, cnt);
+
+    b->destroy(dict);
+
+    printf("%-16s %10d %10.1f %10.1f ", b->name, cnt, add_ns, get_ns);
+    if (misses >= 0)
+        printf("%10.2f ", (double)misses / cnt);
+    else
+        printf("%10s ", "-");
+    if (b->get_many)
+        printf("%10.1f", batch_ns);
+    else
+        printf("%10s", "-");
+    printf(" %10.1f%s\n", remove_ns, ok ? "" : "  WRONG RESULTS");
+}
+
+int main(int argc, char **argv)
+{
+    char **keys;
+    int sizes_cnt, cnt, i, j;
+
+    sizes_cnt = argc > 1 ? argc - 1 : default_sizes_cnt;
+    rng_state = 0x9e3779b97f4a7c15ULL;
+
+    cache_misses_fd = perf_counter_open(PERF_COUNT_HW_CACHE_MISSES);
+
+    printf("%-16s %10s %10s %10s %10s %10s %10s\n", "dictionary", "keys",
+            "add ns", "get ns", "get miss", "batch ns", "remove ns");
+
+    for (i = 0; i < sizes_cnt; i++) {
+        cnt = argc > 1 ? atoi(argv[i+1]) : default_sizes[i];
+        if (cnt <= 0)
+            continue;
+
+        keys = generate_keys(cnt);
+
+        for (j = 0; j < (int)(sizeof(backends) / sizeof(*backends)); j++)
+            run_backend(&backends[j], keys, cnt);
+
+        for (j = 0; j < cnt; j++)
+            free(keys[j]);
+        free(keys);
+    }
+
+    if (cache_misses_fd >= 0)
+        close(cache_misses_fd);
+
+    return 0;
+}
@@ -0,0 +1,248 @@
+/* rbtree/tests/bulk_test.c */
+#include "../rbtree.h"
+#include "tree_check.h"
+#include "test_rng.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This program checks rbtree_build_sorted and rbtree_merge_sorted against
+ * a reference set of the keys 0..universe-1: a random set is built into
+ * a tree, then random batches are merged into it, and after every step
+ * the tree must be valid (check_tree) and hold exactly the keys of the
+ * set in order, each with the data of the step that added it.
+ *
+ * The batches are sorted or shuffled, small (added one by one) or big
+ * (relinked), and mix keys already in the tree with new ones. Runs go
+ * with a pool and in the malloc mode, where the first tree is merged
+ * into an empty one. The calls that must fail are checked too: no pool,
+ * a non empty tree, keys out of order or repeated.
+ *
+ * The keys are of different lengths, so both the inline and the
+ * allocated ones come up.
+ *
+ * Build:
+ *   gcc -O2 bulk_test.c tree_check.c ../rbtree.c -lpthread \
+ *       -o bulk_test.out
+ *
+ * Usage: ./bulk_test.out [iterations] [seed], returns 0 if all the trees
+ * were right, 1 else. */
+
+enum { universe = 4096, key_size = 40, batches = 6 };
+
+static char key_store[universe][key_size];
+/* the data of the step that added the key, NULL if not in the set */
+static void *ref[universe];
+/* the data of each step, the build is 0 */
+static char tags[batches + 1];
+
+/* the number at a fixed width first, so the key order is the number
+ * order, then 0 to 29 letters */
+static void make_keys(void)
+{
+    int i, len, j;
+
+    for (i = 0; i < universe; i++) {
+        sprintf(key_store[i], "%06d", i);
+        len = 6 + (i * 7919) % 30;
+        for (j = 6; j < len; j++)
+            key_store[i][j] = 'a' + (i + j) % 26;
+        key_store[i][len] = '\0';
+    }
+}
+
+static int rand_size(void)
+{
+    switch (rng_next() % 5) {
+        case 0:
+            return 0;
+        case 1:
+            return 1 + rng_next() % 8;
+        case 2:
+            return universe / 2 + rng_next() % (universe / 2);
+        default:
+            return rng_next() % (universe / 4);
+    }
+}
+
+/* cnt distinct random key indices, sorted, returns how many */
+static int rand_indices(int *idx, int cnt)
+{
+    static unsigned char picked[universe];
+    int n = 0, i;
+
+    memset(picked, 0, sizeof(picked));
+    for (i = 0; i < cnt; i++)
+        picked[rng_next() % universe] = 1;
+    for (i = 0; i < universe; i++) {
+        if (picked[i])
+            idx[n++] = i;
+    }
+
+    return n;
+}
+
+static void shuffle(int *idx, int n)
+{
+    int i, j, tmp;
+
+    for (i = n - 1; i > 0; i--) {
+        j = rng_next() % (i + 1);
+        tmp = idx[i];
+        idx[i] = idx[j];
+        idx[j] = tmp;
+    }
+}
+
+/* the tree must be valid and hold the keys of ref in order, with their
+ * data */
+static int check_contents(const tree_node *root)
+{
+    const tree_node *n;
+    int i;
+
+    if (!check_tree(root))
+        return 0;
+
+    n = rbtree_first(root);
+    for (i = 0; i < universe; i++) {
+        if (!ref[i])
+            continue;
+        if (!n || strcmp(n->key, key_store[i]) != 0 || n->data != ref[i])
+            return 0;
+        n = rbtree_next(n);
+    }
+
+    return n == NULL;
+}
+
+/* Steps */
+
+/* the calls that must fail, leaving the tree as it was */
+static int check_refused(rbtree_pool *pool, tree_node **root,
+        const char **keys, void **data, int n)
+{
+    const char *tmp;
+    tree_node *empty = NULL;
+    int i;
+
+    if (rbtree_build_sorted(NULL, &empty, keys, data, n) || empty)
+        return 0;
+    if (!pool)
+        return 1;
+
+    if (n > 0 && *root && rbtree_build_sorted(pool, root, keys, data, n))
+        return 0;
+    if (n < 2)
+        return 1;
+
+    i = rng_next() % (n - 1);
+    tmp = keys[i];
+    keys[i] = keys[i+1];
+    keys[i+1] = rng_next() % 2 ? tmp : keys[i];
+    if (rbtree_build_sorted(pool, &empty, keys, data, n) || empty)
+        return 0;
+    keys[i+1] = keys[i];
+    keys[i] = tmp;
+
+    return 1;
+}
+
+static int build(rbtree_pool *pool, tree_node **root)
+{
+    static const char *keys[universe];
+    static void *data[universe];
+    static int idx[universe];
+    int n, i;
+
+    n = rand_indices(idx, rand_size());
+    for (i = 0; i < n; i++) {
+        keys[i] = key_store[idx[i]];
+        data[i] = &tags[0];
+        ref[idx[i]] = &tags[0];
+    }
+
+    if (!check_refused(pool, root, keys, data, n))
+        return 0;
+
+    if (pool) {
+        if (!rbtree_build_sorted(pool, root, keys, data, n))
+            return 0;
+    } else if (rbtree_merge_sorted(NULL, root, keys, data, n) != n)
+        return 0;
+
+    return check_contents(*root) && check_refused(pool, root, keys, data, n);
+}
+
+static int merge(rbtree_pool *pool, tree_node **root, int step)
+{
+    static const char *keys[universe];
+    static void *data[universe];
+    static int idx[universe];
+    int n, added = 0, i;
+
+    n = rng_next() % 3 ? rand_size() : 1 + (int)(rng_next() % 8);
+    n = rand_indices(idx, n);
+    if (rng_next() % 2)
+        shuffle(idx, n);
+
+    /* the keys already in keep their data */
+    for (i = 0; i < n; i++) {
+        keys[i] = key_store[idx[i]];
+        data[i] = &tags[step];
+        if (!ref[idx[i]]) {
+            ref[idx[i]] = &tags[step];
+            added++;
+        }
+    }
+
+    return rbtree_merge_sorted(pool, root, keys, data, n) == added &&
+        check_contents(*root);
+}
+
+int main(int argc, char **argv)
+{
+    rbtree_pool pool, *pool_ptr;
+    tree_node *root;
+    long iterations = 300, it;
+    int use_pool, step;
+
+    if (argc > 1)
+        iterations = atol(argv[1]);
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    if (!rng_state)
+        rng_state = 1;
+
+    make_keys();
+
+    for (it = 0; it < iterations; it++) {
+        use_pool = it % 2;
+        pool_ptr = use_pool ? &pool : NULL;
+        if (use_pool)
+            rbtree_pool_init(&pool);
+        memset(ref, 0, sizeof(ref));
+        root = NULL;
+
+        if (!build(pool_ptr, &root)) {
+            printf("build failed: iteration %ld%s\n", it,
+                    use_pool ? ", pool" : "");
+            return 1;
+        }
+
+        for (step = 1; step <= batches; step++) {
+            if (merge(pool_ptr, &root, step))
+                continue;
+            printf("merge failed: iteration %ld, batch %d%s\n", it, step,
+                    use_pool ? ", pool" : "");
+            return 1;
+        }
+
+        if (use_pool)
+            rbtree_pool_destroy(&pool);
+        else
+            rbtree_destroy(root);
+    }
+
+    printf("ok\n");
+    return 0;
+}
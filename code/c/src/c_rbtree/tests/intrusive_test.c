@@ -0,0 +1,211 @@
+/* rbtree/tests/intrusive_test.c */
+#include "../intrusive_rbtree.h"
+#include "test_rng.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This program checks the intrusive rbtree against a reference: a fixed
+ * set of elements, each with a flag telling whether it must be in the
+ * tree. Every element has two links, one in a tree driven by irb_insert
+ * with a compare callback and one in a tree driven by an IRB_GENERATE
+ * instance, and random inserts, finds and removes are done on both, with
+ * every answer checked.
+ *
+ * Every so often both trees are checked: the red-black properties, the
+ * parent pointers, and the contents in order both ways (irb_first and
+ * irb_next, irb_last and irb_prev). The removes hit the root, nodes with
+ * two children (the predecessor relinking) and leaves, the keys are few
+ * enough for the trees to fill and drain again and again.
+ *
+ * Build:
+ *   gcc -O2 intrusive_test.c ../intrusive_rbtree.c -o intrusive_test.out
+ *
+ * Usage: ./intrusive_test.out [ops] [seed], returns 0 if all the answers
+ * and checks were right, 1 else. */
+
+enum { elem_cnt = 1000, check_every = 200 };
+
+struct elem {
+    int key;
+    irb_link by_cb, by_gen;
+};
+
+static int cmp_elems(const struct elem *a, const struct elem *b)
+{
+    return (a->key > b->key) - (a->key < b->key);
+}
+
+IRB_GENERATE(gen, struct elem, by_gen, cmp_elems)
+
+static int cmp_links(const irb_link *a, const irb_link *b)
+{
+    return cmp_elems(irb_entry(a, struct elem, by_cb),
+            irb_entry(b, struct elem, by_cb));
+}
+
+static int cmp_key(const void *key, const irb_link *n)
+{
+    int k = *(const int *)key, nk = irb_entry(n, struct elem, by_cb)->key;
+
+    return (k > nk) - (k < nk);
+}
+
+static struct elem elems[elem_cnt];
+static unsigned char present[elem_cnt];
+static int present_cnt;
+
+/* Checks */
+
+/* the black height of the subtree, -1 if it breaks the red-black
+ * properties or the parent pointers */
+static int check_subtree(const irb_link *n, const irb_link *parent)
+{
+    int l, r;
+
+    if (!n)
+        return 0;
+
+    if (n->parent != parent)
+        return -1;
+    if (n->color == red && ((n->left && n->left->color == red) ||
+                (n->right && n->right->color == red)))
+        return -1;
+
+    l = check_subtree(n->left, n);
+    r = check_subtree(n->right, n);
+    if (l < 0 || r < 0 || l != r)
+        return -1;
+
+    return l + (n->color == black);
+}
+
+/* the elements of the tree must be the present ones, in key order */
+static int check_links(irb_link *root, size_t link_off)
+{
+    irb_link *n;
+    int k;
+
+    if ((root && root->color != black) || check_subtree(root, NULL) < 0)
+        return 0;
+
+    n = irb_first(root);
+    for (k = 0; k < elem_cnt; k++) {
+        if (!present[k])
+            continue;
+        if (n != (irb_link *)((char *)&elems[k] + link_off))
+            return 0;
+        n = irb_next(n);
+    }
+    if (n)
+        return 0;
+
+    n = irb_last(root);
+    for (k = elem_cnt - 1; k >= 0; k--) {
+        if (!present[k])
+            continue;
+        if (n != (irb_link *)((char *)&elems[k] + link_off))
+            return 0;
+        n = irb_prev(n);
+    }
+
+    return !n;
+}
+
+static int check_all(irb_link *cb_root, irb_link *gen_root)
+{
+    return check_links(cb_root, offsetof(struct elem, by_cb)) &&
+        check_links(gen_root, offsetof(struct elem, by_gen));
+}
+
+/* Random operations */
+
+static int random_op(irb_link **cb_root, irb_link **gen_root)
+{
+    struct elem probe, *e;
+    irb_link *found;
+    int k = rng_next() % elem_cnt, kind;
+
+    e = &elems[k];
+    probe.key = k;
+
+    /* more inserts while the trees are small, more removes when full */
+    kind = rng_next() % elem_cnt < (unsigned)present_cnt ? 1 : 0;
+    if (rng_next() % 4 == 0)
+        kind = 2;
+
+    if (kind == 0) {
+        if (present[k]) {
+            found = irb_insert(cb_root, &probe.by_cb, cmp_links);
+            return found == &e->by_cb && gen_insert(gen_root, &probe) == e;
+        }
+        if (irb_insert(cb_root, &e->by_cb, cmp_links) ||
+                gen_insert(gen_root, e))
+            return 0;
+        present[k] = 1;
+        present_cnt++;
+        return 1;
+    }
+
+    if (kind == 1) {
+        if (!present[k])
+            return 1;
+        irb_remove(cb_root, &e->by_cb);
+        gen_remove(gen_root, e);
+        present[k] = 0;
+        present_cnt--;
+        return 1;
+    }
+
+    found = irb_find(*cb_root, &k, cmp_key);
+    if (found != (present[k] ? &e->by_cb : NULL))
+        return 0;
+    return gen_find(*gen_root, &probe) == (present[k] ? e : NULL);
+}
+
+int main(int argc, char **argv)
+{
+    irb_link *cb_root = NULL, *gen_root = NULL;
+    long ops = 1000000, i;
+    int k;
+
+    if (argc > 1)
+        ops = atol(argv[1]);
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    if (!rng_state)
+        rng_state = 1;
+
+    for (k = 0; k < elem_cnt; k++)
+        elems[k].key = k;
+
+    for (i = 0; i < ops; i++) {
+        if (!random_op(&cb_root, &gen_root)) {
+            printf("failed: wrong answer at op %ld\n", i);
+            return 1;
+        }
+        if (i % check_every == 0 && !check_all(cb_root, gen_root)) {
+            printf("failed: check at op %ld\n", i);
+            return 1;
+        }
+    }
+
+    /* drained in key order, checked at every step */
+    for (k = 0; k < elem_cnt; k++) {
+        if (!present[k])
+            continue;
+        irb_remove(&cb_root, &elems[k].by_cb);
+        gen_remove(&gen_root, &elems[k]);
+        present[k] = 0;
+        if (!check_all(cb_root, gen_root)) {
+            printf("failed: check while draining\n");
+            return 1;
+        }
+    }
+
+    if (cb_root || gen_root) {
+        printf("failed: the drained trees are not empty\n");
+        return 1;
+    }
+
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,53 @@
+/* rbtree/tests/perf_counter.h */
+#ifndef PERF_COUNTER_SENTRY
+#define PERF_COUNTER_SENTRY
+
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* A hardware event counter of this process for the benches, through
+ * perf_event_open. Most vms have none, so every function takes the -1 of
+ * a counter that could not be opened, and the benches print "-" for it. */
+
+/* config is a PERF_COUNT_HW_ event, the counter counts in the threads
+ * started after it too, returns -1 if there is no such counter */
+static int perf_counter_open(unsigned long long config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void perf_counter_start(int fd)
+{
+    if (fd < 0)
+        return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+/* -1 if not counted */
+static long long perf_counter_stop(int fd)
+{
+    long long cnt;
+
+    if (fd < 0)
+        return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &cnt, sizeof(cnt)) != sizeof(cnt))
+        return -1;
+    return cnt;
+}
+
+#endif
@@ -0,0 +1,297 @@
+/* rbtree/tests/persistent_test.c */
+#include "../persistent_rbtree.c"
+#include "test_rng.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This program checks the persistent rbtree against a reference model: a
+ * set of versions, each with the set of keys it must hold. Random adds,
+ * removes, snapshots and releases are done on random versions, and every
+ * answer is checked against the model.
+ *
+ * Every so often all the versions are checked: the contents against the
+ * model, the red-black and order properties, and the reference count of
+ * every node reachable from any version, which must be exactly the number
+ * of nodes pointing to it plus the number of version handles to it (the
+ * implementation is included for that, the nodes are private to it). At
+ * the end everything is released, a build with -fsanitize=address then
+ * reports any node left over or freed twice.
+ *
+ * Last, threads update and release their own snapshots of one shared
+ * version at the same time, which must stay unchanged (for
+ * -fsanitize=thread, the counts of shared nodes are changed by all of
+ * them).
+ *
+ * Build:
+ *   gcc -O1 -g -fsanitize=address persistent_test.c -lpthread \
+ *       -o persistent_test.out
+ *
+ * Usage: ./persistent_test.out [ops] [seed], returns 0 if all the answers
+ * and checks were right, 1 else. */
+
+enum {
+    version_cnt = 16,
+    key_cnt = 400,
+    check_every = 500,
+    thread_cnt = 4,
+    thread_ops = 20000,
+    key_size = 16
+};
+
+struct version {
+    prbtree_node *root;
+    unsigned char present[key_cnt];
+};
+
+static struct version versions[version_cnt];
+
+static void make_key(int k, char *key)
+{
+    snprintf(key, key_size, "key%04d", k);
+}
+
+/* Checks */
+
+/* the black height of the subtree, -1 if it is not a valid red-black
+ * tree with all keys in (lo, hi), NULL meaning no bound */
+static int check_subtree(const prbtree_node *n, const char *lo,
+        const char *hi)
+{
+    int l, r;
+
+    if (!n)
+        return 0;
+
+    if ((lo && strcmp(n->key, lo) <= 0) || (hi && strcmp(n->key, hi) >= 0))
+        return -1;
+    if (n->fresh || (is_red(n) && (is_red(n->left) || is_red(n->right))))
+        return -1;
+
+    l = check_subtree(n->left, lo, n->key);
+    r = check_subtree(n->right, n->key, hi);
+    if (l < 0 || r < 0 || l != r)
+        return -1;
+
+    return l + is_black(n);
+}
+
+static int check_contents(const struct version *v)
+{
+    char key[key_size];
+    void *data;
+    int k, found;
+
+    if (is_red(v->root) || check_subtree(v->root, NULL, NULL) < 0)
+        return 0;
+
+    for (k = 0; k < key_cnt; k++) {
+        make_key(k, key);
+        found = prbtree_get_element(v->root, key, &data);
+        if (found != v->present[k] || (found && data != (void *)(long)k))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* the nodes reachable from the versions, each once, with the references
+ * to them counted, in an open addressing set */
+struct node_counts {
+    const prbtree_node **nodes;
+    int *refs;
+    size_t cap;
+};
+
+static int *count_of(struct node_counts *c, const prbtree_node *n,
+        int *is_new)
+{
+    size_t pos = ((size_t)n >> 4) * 0x9e3779b97f4a7c15ULL & (c->cap - 1);
+
+    while (c->nodes[pos] && c->nodes[pos] != n)
+        pos = (pos + 1) & (c->cap - 1);
+
+    *is_new = !c->nodes[pos];
+    c->nodes[pos] = n;
+    return &c->refs[pos];
+}
+
+static void count_refs(struct node_counts *c, const prbtree_node *n)
+{
+    int is_new;
+
+    if (!n)
+        return;
+
+    ++*count_of(c, n, &is_new);
+    if (!is_new)
+        return;
+
+    count_refs(c, n->left);
+    count_refs(c, n->right);
+}
+
+static int check_ref_counts(void)
+{
+    struct node_counts c;
+    size_t i;
+    int ok = 1, v;
+
+    c.cap = 1;
+    while (c.cap < 4 * version_cnt * key_cnt)
+        c.cap *= 2;
+    c.nodes = calloc(c.cap, sizeof(*c.nodes));
+    c.refs = calloc(c.cap, sizeof(*c.refs));
+
+    for (v = 0; v < version_cnt; v++)
+        count_refs(&c, versions[v].root);
+
+    for (i = 0; i < c.cap; i++) {
+        if (c.nodes[i] && atomic_load(&c.nodes[i]->refs) != c.refs[i])
+            ok = 0;
+    }
+
+    free(c.nodes);
+    free(c.refs);
+    return ok;
+}
+
+static int check_all(void)
+{
+    int v;
+
+    for (v = 0; v < version_cnt; v++) {
+        if (!check_contents(&versions[v]))
+            return 0;
+    }
+
+    return check_ref_counts();
+}
+
+/* Random updates */
+
+/* the new version of a goes to b, the old b is released */
+static int update(int a, int b)
+{
+    prbtree_node *root;
+    unsigned char present[key_cnt];
+    char key[key_size];
+    int k, res;
+
+    k = rng_next() % key_cnt;
+    make_key(k, key);
+    memcpy(present, versions[a].present, key_cnt);
+
+    switch (rng_next() % 8) {
+        case 0:
+            root = prbtree_snapshot(versions[a].root);
+            break;
+        case 1:
+        case 2:
+        case 3:
+        case 4:
+            root = prbtree_add_element(versions[a].root, key, (void *)(long)k,
+                    &res);
+            if (res == present[k])
+                return 0;
+            present[k] = 1;
+            break;
+        default:
+            root = prbtree_remove_element(versions[a].root, key, &res);
+            if (res != present[k])
+                return 0;
+            present[k] = 0;
+            break;
+    }
+
+    prbtree_release(versions[b].root);
+    versions[b].root = root;
+    memcpy(versions[b].present, present, key_cnt);
+    return 1;
+}
+
+/* Threads */
+
+struct thread_arg {
+    prbtree_node *base;
+    unsigned seed;
+    int ok;
+};
+
+static void *update_snapshot(void *arg)
+{
+    struct thread_arg *a = arg;
+    prbtree_node *mine, *next;
+    char key[key_size];
+    int i, k;
+
+    mine = prbtree_snapshot(a->base);
+
+    for (i = 0; i < thread_ops; i++) {
+        k = rand_r(&a->seed) % key_cnt;
+        make_key(k, key);
+        if (rand_r(&a->seed) % 2)
+            next = prbtree_add_element(mine, key, (void *)(long)k, NULL);
+        else
+            next = prbtree_remove_element(mine, key, NULL);
+        prbtree_release(mine);
+        mine = next;
+    }
+
+    a->ok = !is_red(mine) && check_subtree(mine, NULL, NULL) >= 0;
+    prbtree_release(mine);
+    return NULL;
+}
+
+static int run_threads(void)
+{
+    struct thread_arg args[thread_cnt];
+    pthread_t threads[thread_cnt];
+    int ok = 1, i;
+
+    for (i = 0; i < thread_cnt; i++) {
+        args[i].base = versions[0].root;
+        args[i].seed = i + 1;
+        pthread_create(&threads[i], NULL, update_snapshot, &args[i]);
+    }
+    for (i = 0; i < thread_cnt; i++) {
+        pthread_join(threads[i], NULL);
+        ok = ok && args[i].ok;
+    }
+
+    return ok && check_all();
+}
+
+int main(int argc, char **argv)
+{
+    long ops = 100000, i;
+    int v;
+
+    if (argc > 1)
+        ops = atol(argv[1]);
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    if (!rng_state)
+        rng_state = 1;
+
+    for (i = 0; i < ops; i++) {
+        if (!update(rng_next() % version_cnt, rng_next() % version_cnt)) {
+            printf("failed: wrong answer at op %ld\n", i);
+            return 1;
+        }
+        if (i % check_every == 0 && !check_all()) {
+            printf("failed: check at op %ld\n", i);
+            return 1;
+        }
+    }
+
+    if (!check_all() || !run_threads()) {
+        printf("failed: final checks\n");
+        return 1;
+    }
+
+    for (v = 0; v < version_cnt; v++)
+        prbtree_release(versions[v].root);
+
+    printf("ok\n");
+    return 0;
+}
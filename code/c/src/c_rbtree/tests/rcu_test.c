@@ -0,0 +1,195 @@
+/* rbtree/tests/rcu_test.c */
+#include "../rcu_rbtree.c"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This program runs one writer doing random adds and removes on an
+ * rcu_rbtree against reader threads doing lookups all the while, meant
+ * to be built with -fsanitize=thread (races) or -fsanitize=address (a
+ * node freed while a reader could still see it).
+ *
+ * The writer checks every answer against a reference set, and every so
+ * often the published tree for the red-black and order properties (the
+ * implementation is included for that, the nodes are private to it).
+ * The readers look up a set of stable keys, which must always be found
+ * with their data, and the churning keys, which must have the data the
+ * writer gave them whenever found. One of the readers keeps registering
+ * and unregistering, as threads coming and going do.
+ *
+ * Build:
+ *   gcc -O1 -g -fsanitize=thread rcu_test.c -lpthread -o rcu_test.out
+ *
+ * Usage: ./rcu_test.out [writes] [readers], returns 0 if all the answers
+ * and checks were right, 1 else. */
+
+enum {
+    stable_cnt = 1000,
+    churn_cnt = 5000,
+    check_every = 1000,
+    max_readers = 16,
+    key_size = 32
+};
+
+static rcu_rbtree tree;
+static atomic_int stop, failed;
+
+struct reader_arg {
+    unsigned seed;
+    int reregister;
+    long lookups;
+};
+
+/* Tree checks */
+
+/* the black height of the subtree, -1 if it is not a valid red-black
+ * tree with all keys in (lo, hi), NULL meaning no bound */
+static int check_subtree(const struct rcu_tree_node *n, const char *lo,
+        const char *hi)
+{
+    int l, r;
+
+    if (!n)
+        return 0;
+
+    if ((lo && strcmp(n->key, lo) <= 0) || (hi && strcmp(n->key, hi) >= 0))
+        return -1;
+    if (is_red(n) && (is_red(n->left) || is_red(n->right)))
+        return -1;
+
+    l = check_subtree(n->left, lo, n->key);
+    r = check_subtree(n->right, n->key, hi);
+    if (l < 0 || r < 0 || l != r)
+        return -1;
+
+    return l + is_black(n);
+}
+
+static int check_published(rcu_rbtree *t)
+{
+    const struct rcu_tree_node *root = atomic_load(&t->root);
+
+    return !is_red(root) && check_subtree(root, NULL, NULL) >= 0;
+}
+
+/* Threads */
+
+static void fail(const char *what)
+{
+    printf("failed: %s\n", what);
+    atomic_store(&failed, 1);
+    atomic_store(&stop, 1);
+}
+
+static void *reader(void *arg)
+{
+    struct reader_arg *a = arg;
+    rcu_rbtree_reader r;
+    char key[key_size];
+    void *data;
+    int k;
+
+    rcu_rbtree_reader_register(&tree, &r);
+
+    while (!atomic_load(&stop)) {
+        k = rand_r(&a->seed) % stable_cnt;
+        snprintf(key, sizeof(key), "stable%d", k);
+        if (!rcu_rbtree_get_element(&tree, &r, key, &data) ||
+                data != (void *)(long)(k + 1))
+        {
+            fail("a stable key was lost");
+        }
+
+        k = rand_r(&a->seed) % churn_cnt;
+        snprintf(key, sizeof(key), "k%d", k);
+        if (rcu_rbtree_get_element(&tree, &r, key, &data) &&
+                data != (void *)(long)(k + 1))
+        {
+            fail("a key had the wrong data");
+        }
+
+        a->lookups += 2;
+        if (a->reregister && a->lookups % 1024 == 0) {
+            rcu_rbtree_reader_unregister(&tree, &r);
+            rcu_rbtree_reader_register(&tree, &r);
+        }
+    }
+
+    rcu_rbtree_reader_unregister(&tree, &r);
+    return NULL;
+}
+
+static void write_all(long writes)
+{
+    static char present[churn_cnt];
+    char key[key_size];
+    unsigned seed = 1;
+    long i;
+    int k;
+
+    for (i = 0; i < writes && !atomic_load(&stop); i++) {
+        k = rand_r(&seed) % churn_cnt;
+        snprintf(key, sizeof(key), "k%d", k);
+
+        if (rand_r(&seed) % 2) {
+            if (rcu_rbtree_add_element(&tree, key, (void *)(long)(k + 1))
+                    == present[k])
+                fail("add");
+            present[k] = 1;
+        } else {
+            if (rcu_rbtree_remove_element(&tree, key) != present[k])
+                fail("remove");
+            present[k] = 0;
+        }
+
+        if (i % check_every == 0 && !check_published(&tree))
+            fail("the published tree is not valid");
+    }
+
+    if (!check_published(&tree))
+        fail("the final tree is not valid");
+}
+
+int main(int argc, char **argv)
+{
+    struct reader_arg args[max_readers];
+    pthread_t threads[max_readers];
+    long writes = 200000, lookups = 0;
+    char key[key_size];
+    int readers = 3, i;
+
+    if (argc > 1)
+        writes = atol(argv[1]);
+    if (argc > 2)
+        readers = atoi(argv[2]);
+    if (readers < 1 || readers > max_readers)
+        readers = 3;
+
+    rcu_rbtree_init(&tree);
+    for (i = 0; i < stable_cnt; i++) {
+        snprintf(key, sizeof(key), "stable%d", i);
+        rcu_rbtree_add_element(&tree, key, (void *)(long)(i + 1));
+    }
+
+    for (i = 0; i < readers; i++) {
+        args[i].seed = i + 1;
+        args[i].reregister = i == 0;
+        args[i].lookups = 0;
+        pthread_create(&threads[i], NULL, reader, &args[i]);
+    }
+
+    write_all(writes);
+
+    atomic_store(&stop, 1);
+    for (i = 0; i < readers; i++) {
+        pthread_join(threads[i], NULL);
+        lookups += args[i].lookups;
+    }
+
+    rcu_rbtree_destroy(&tree);
+
+    if (atomic_load(&failed))
+        return 1;
+
+    printf("ok, %ld writes against %ld lookups\n", writes, lookups);
+    return 0;
+}
@@ -0,0 +1,241 @@
+/* rbtree/tests/set_test.c */
+#include "../rbtree.h"
+#include "tree_check.h"
+#include "test_rng.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This program checks rbtree_union, rbtree_intersection and
+ * rbtree_difference against a reference: two random sets of the keys
+ * 0..universe-1 are made into trees, combined, and the result must be
+ * a valid tree (check_tree, parent pointers included) holding exactly the
+ * keys of the same operation on the sets, with the data of a for the keys
+ * in both. The result must then still take adds and removes.
+ *
+ * The set sizes are drawn so that empty, single element and very
+ * unbalanced pairs (a few keys against thousands) come up often, the
+ * keys of both sets are often drawn from a few only, so that they
+ * overlap, and every pair is run with 1 to 4 threads, with and without
+ * a pool.
+ *
+ * Build:
+ *   gcc -O2 set_test.c tree_check.c ../rbtree.c -lpthread -o set_test.out
+ *
+ * Usage: ./set_test.out [iterations] [seed], returns 0 if all the results
+ * were right, 1 else. */
+
+enum { universe = 4096, key_size = 16, max_threads = 4 };
+enum { set_union, set_intersection, set_difference, set_ops };
+
+static const char *const op_names[set_ops] = {
+    "union", "intersection", "difference"
+};
+
+/* tags for the data, to tell where a node came from */
+static char from_a, from_b;
+
+/* fixed width, so the key order is the number order */
+static void make_key(int idx, char *key)
+{
+    sprintf(key, "%06d", idx);
+}
+
+static int rand_set_size(void)
+{
+    switch (rng_next() % 6) {
+        case 0:
+            return 0;
+        case 1:
+            return 1;
+        case 2:
+            return 1 + rng_next() % 8;
+        case 3:
+            return universe / 2 + rng_next() % (universe / 2);
+        default:
+            return rng_next() % (universe / 4);
+    }
+}
+
+/* the keys are taken from the first span ones, small spans make sets
+ * that overlap a lot */
+static void rand_set(unsigned char *set, int span)
+{
+    int cnt = rand_set_size(), i;
+
+    memset(set, 0, universe);
+    for (i = 0; i < cnt; i++)
+        set[rng_next() % span] = 1;
+}
+
+static int rand_span(void)
+{
+    static const int spans[] = { 4, 16, 256, universe };
+
+    return spans[rng_next() % (sizeof(spans) / sizeof(spans[0]))];
+}
+
+/* built sorted in one go (merged into nothing in the malloc mode), or
+ * added in random order, so both shapes of trees come in (a NULL pool is
+ * the malloc mode) */
+static tree_node *make_tree(rbtree_pool *pool, const unsigned char *set,
+        void *data)
+{
+    static char key_store[universe][key_size];
+    static const char *keys[universe];
+    static void *datas[universe];
+    tree_node *root = NULL;
+    const char *tmp;
+    int n = 0, i, j;
+
+    for (i = 0; i < universe; i++) {
+        if (!set[i])
+            continue;
+        make_key(i, key_store[n]);
+        keys[n] = key_store[n];
+        datas[n] = data;
+        n++;
+    }
+
+    if (rng_next() % 2) {
+        if (pool)
+            rbtree_build_sorted(pool, &root, keys, datas, n);
+        else
+            rbtree_merge_sorted(NULL, &root, keys, datas, n);
+        return root;
+    }
+
+    for (i = n - 1; i > 0; i--) {
+        j = rng_next() % (i + 1);
+        tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+    for (i = 0; i < n; i++)
+        rbtree_pool_add_element(pool, &root, keys[i], data);
+    return root;
+}
+
+static int expected_in(int op, int in_a, int in_b)
+{
+    switch (op) {
+        case set_union:
+            return in_a || in_b;
+        case set_intersection:
+            return in_a && in_b;
+        default:
+            return in_a && !in_b;
+    }
+}
+
+static int check_result(int op, const tree_node *res,
+        const unsigned char *a, const unsigned char *b)
+{
+    char key[key_size];
+    const tree_node *n;
+    int i;
+
+    if (!check_tree(res))
+        return 0;
+
+    for (i = 0; i < universe; i++) {
+        make_key(i, key);
+        n = rbtree_get_element(res, key);
+
+        if (!n != !expected_in(op, a[i], b[i]))
+            return 0;
+        if (n && n->data != (a[i] ? &from_a : &from_b))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* the result must be a tree like any other */
+static int modify_result(rbtree_pool *pool, tree_node **res)
+{
+    char key[key_size];
+    int i, idx;
+
+    for (i = 0; i < 16; i++) {
+        idx = rng_next() % universe;
+        make_key(idx, key);
+        if (i % 2)
+            rbtree_pool_remove_element(pool, res, key);
+        else
+            rbtree_pool_add_element(pool, res, key, NULL);
+    }
+
+    return check_tree(*res);
+}
+
+static int run_case(int op, int threads, int use_pool,
+        const unsigned char *a, const unsigned char *b)
+{
+    rbtree_pool pool, *pool_ptr = use_pool ? &pool : NULL;
+    tree_node *ta, *tb, *res;
+    int ok;
+
+    if (use_pool)
+        rbtree_pool_init(&pool);
+
+    ta = make_tree(pool_ptr, a, &from_a);
+    tb = make_tree(pool_ptr, b, &from_b);
+
+    switch (op) {
+        case set_union:
+            res = rbtree_union(pool_ptr, ta, tb, threads);
+            break;
+        case set_intersection:
+            res = rbtree_intersection(pool_ptr, ta, tb, threads);
+            break;
+        default:
+            res = rbtree_difference(pool_ptr, ta, tb, threads);
+            break;
+    }
+
+    ok = check_result(op, res, a, b) && modify_result(pool_ptr, &res);
+
+    if (use_pool)
+        rbtree_pool_destroy(&pool);
+    else
+        rbtree_destroy(res);
+
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    static unsigned char a[universe], b[universe];
+    long iterations = 200, it;
+    int op, threads, use_pool, span;
+
+    if (argc > 1)
+        iterations = atol(argv[1]);
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    if (!rng_state)
+        rng_state = 1;
+
+    for (it = 0; it < iterations; it++) {
+        span = rand_span();
+        rand_set(a, span);
+        rand_set(b, span);
+
+        for (op = 0; op < set_ops; op++) {
+            for (threads = 1; threads <= max_threads; threads++) {
+                for (use_pool = 0; use_pool <= 1; use_pool++) {
+                    if (run_case(op, threads, use_pool, a, b))
+                        continue;
+
+                    printf("%s failed: iteration %ld, %d threads%s\n",
+                            op_names[op], it, threads,
+                            use_pool ? ", pool" : "");
+                    return 1;
+                }
+            }
+        }
+    }
+
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,290 @@
+/* rbtree/tests/snapshot_test.c */
+#include "../rbtree_snapshot.h"
+#include "test_rng.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* This program checks the snapshot files: a random tree (with some
+ * binary keys and keys sharing long prefixes) is written, opened and
+ * every key looked up, with the value the encoder gave it, along with
+ * keys that are not in it. Rewriting the file must leave a snapshot that
+ * is still open as it was.
+ *
+ * Then damaged copies: a bad magic, a cut file and wrong sizes must fail
+ * to open, and records with children pointing back up the tree, or
+ * overwritten with random bytes, must still give answers, not loops or
+ * crashes (an alarm catches a lookup that never ends).
+ *
+ * Build:
+ *   gcc -O2 snapshot_test.c ../rbtree_snapshot.c ../rbtree.c -lpthread \
+ *       -o snapshot_test.out
+ *
+ * Usage: ./snapshot_test.out [seed], returns 0 if all the checks passed,
+ * 1 else. */
+
+enum {
+    key_cnt = 5000,
+    max_key_len = 40,
+    /* the layout described in rbtree_snapshot.c */
+    header_size = 32,
+    record_size = 32,
+    record_left_off = 24,
+    record_right_off = 28,
+    lookup_timeout_sec = 10
+};
+
+struct test_key {
+    char bytes[max_key_len];
+    size_t len;
+};
+
+static struct test_key keys[key_cnt];
+static int failed;
+
+static void check(int cond, const char *what)
+{
+    if (!cond) {
+        printf("failed: %s\n", what);
+        failed = 1;
+    }
+}
+
+static void make_keys(void)
+{
+    int i, j, kind;
+
+    for (i = 0; i < key_cnt; i++) {
+        kind = rng_next() % 4;
+        if (kind == 0) {
+            /* binary, '\0' in it */
+            keys[i].len = 1 + rng_next() % 12;
+            for (j = 0; j < (int)keys[i].len; j++)
+                keys[i].bytes[j] = rng_next() % 4;
+        } else if (kind == 1) {
+            /* past the 8 byte prefix */
+            keys[i].len = sprintf(keys[i].bytes, "common_prefix_%d", i);
+        } else
+            keys[i].len = sprintf(keys[i].bytes, "%llx", rng_next());
+    }
+}
+
+/* the value of a node is the index of its key plus 1 */
+static uint64_t encode(const tree_node *n, void *ctx)
+{
+    (void)ctx;
+    return (uint64_t)(size_t)n->data;
+}
+
+/* of the keys from..to-1 */
+static tree_node *make_tree(int from, int to)
+{
+    tree_node *root = NULL;
+    int i;
+
+    for (i = from; i < to; i++) {
+        rbtree_add_element_len(&root, keys[i].bytes, keys[i].len,
+                (void *)(size_t)(i + 1));
+    }
+    return root;
+}
+
+/* every key of the tree has its value, the rest are not found */
+static int snapshot_matches(const rbtree_snapshot *s, const tree_node *root)
+{
+    const tree_node *n;
+    uint64_t value;
+    int i, found;
+
+    for (i = 0; i < key_cnt; i++) {
+        n = rbtree_get_element_len(root, keys[i].bytes, keys[i].len);
+        found = rbtree_snapshot_get_len(s, keys[i].bytes, keys[i].len,
+                &value);
+        if (found != (n != NULL))
+            return 0;
+        if (n && value != (uint64_t)(size_t)n->data)
+            return 0;
+    }
+
+    return !rbtree_snapshot_get(s, "not a key", NULL);
+}
+
+static void test_round_trip(const char *path)
+{
+    rbtree_snapshot old, cur;
+    tree_node *first, *second, *empty = NULL;
+
+    first = make_tree(0, key_cnt / 2);
+    second = make_tree(key_cnt / 2, key_cnt);
+
+    check(rbtree_snapshot_write(first, path, encode, NULL), "write");
+    check(rbtree_snapshot_open(&old, path), "open");
+    check(snapshot_matches(&old, first), "lookups");
+
+    /* replaced while open, by other keys */
+    check(rbtree_snapshot_write(second, path, encode, NULL), "rewrite");
+    check(rbtree_snapshot_open(&cur, path), "open rewritten");
+    check(snapshot_matches(&cur, second), "lookups in the rewritten");
+    check(snapshot_matches(&old, first), "lookups in the replaced");
+    rbtree_snapshot_close(&cur);
+    rbtree_snapshot_close(&old);
+
+    check(rbtree_snapshot_write(empty, path, NULL, NULL), "write empty");
+    check(rbtree_snapshot_open(&cur, path), "open empty");
+    check(snapshot_matches(&cur, empty), "lookups in empty");
+    rbtree_snapshot_close(&cur);
+
+    check(!rbtree_snapshot_open(&cur, "/nonexistent/snapshot"),
+            "open missing");
+    check(!rbtree_snapshot_write(first, "/nonexistent/snapshot", NULL,
+                NULL), "write to a missing dir");
+
+    rbtree_destroy(first);
+    rbtree_destroy(second);
+}
+
+/* Damaged files */
+
+static char *read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    char *buf;
+
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = malloc(*size);
+    if (fread(buf, 1, *size, f) != *size)
+        *size = 0;
+    fclose(f);
+    return buf;
+}
+
+static void write_file(const char *path, const char *buf, size_t size)
+{
+    FILE *f = fopen(path, "wb");
+    fwrite(buf, 1, size, f);
+    fclose(f);
+}
+
+static int opens(const char *path, const char *buf, size_t size)
+{
+    rbtree_snapshot s;
+
+    write_file(path, buf, size);
+    if (!rbtree_snapshot_open(&s, path))
+        return 0;
+    rbtree_snapshot_close(&s);
+    return 1;
+}
+
+/* all the keys looked up, only for the lookups to end */
+static void look_up_all(const char *path, const char *buf, size_t size)
+{
+    rbtree_snapshot s;
+    int i;
+
+    write_file(path, buf, size);
+    if (!rbtree_snapshot_open(&s, path)) {
+        check(0, "open damaged records");
+        return;
+    }
+
+    for (i = 0; i < key_cnt; i++)
+        rbtree_snapshot_get_len(&s, keys[i].bytes, keys[i].len, NULL);
+
+    rbtree_snapshot_close(&s);
+}
+
+static void set_child(char *buf, uint32_t rec, int right, uint32_t child)
+{
+    memcpy(buf + header_size + (size_t)rec * record_size +
+            (right ? record_right_off : record_left_off),
+            &child, sizeof(child));
+}
+
+static void test_damaged(const char *path, const char *bad_path)
+{
+    tree_node *root = make_tree(0, key_cnt);
+    size_t size, records_size, i;
+    char *orig, *buf;
+    uint32_t rec, cnt;
+    int round;
+
+    check(rbtree_snapshot_write(root, path, encode, NULL), "write");
+    orig = read_file(path, &size);
+    buf = malloc(size);
+    memcpy(&cnt, orig + 16, sizeof(cnt));
+    records_size = (size_t)cnt * record_size;
+
+    memcpy(buf, orig, size);
+    buf[0] ^= 1;
+    check(!opens(bad_path, buf, size), "bad magic rejected");
+
+    check(!opens(bad_path, orig, size - 1), "cut file rejected");
+    check(!opens(bad_path, orig, header_size - 1), "cut header rejected");
+
+    memcpy(buf, orig, size);
+    buf[16] ^= 0x40;
+    check(!opens(bad_path, buf, size), "bad node count rejected");
+
+    alarm(lookup_timeout_sec);
+
+    /* loops: to itself, to the root, to a parent */
+    for (round = 0; round < 200; round++) {
+        memcpy(buf, orig, size);
+        rec = rng_next() % cnt;
+        set_child(buf, rec, round % 2,
+                round % 3 == 0 ? rec : round % 3 == 1 ? 0 : rec / 2);
+        look_up_all(bad_path, buf, size);
+    }
+
+    /* random bytes over the records */
+    for (round = 0; round < 200; round++) {
+        memcpy(buf, orig, size);
+        for (i = 0; i < 64; i++)
+            buf[header_size + rng_next() % records_size] = rng_next();
+        look_up_all(bad_path, buf, size);
+    }
+
+    alarm(0);
+
+    free(buf);
+    free(orig);
+    rbtree_destroy(root);
+}
+
+static void on_alarm(int sig)
+{
+    (void)sig;
+    write(1, "failed: a lookup never ended\n", 29);
+    _exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    char path[] = "/tmp/rbtree_snapshot_testXXXXXX";
+    char bad_path[sizeof(path) + 4];
+    int fd;
+
+    rng_state = argc > 1 ? strtoull(argv[1], NULL, 10) : 1;
+    if (!rng_state)
+        rng_state = 1;
+    signal(SIGALRM, on_alarm);
+
+    fd = mkstemp(path);
+    close(fd);
+    sprintf(bad_path, "%s.bad", path);
+
+    make_keys();
+    test_round_trip(path);
+    test_damaged(path, bad_path);
+
+    unlink(path);
+    unlink(bad_path);
+
+    printf(failed ? "some checks failed\n" : "ok\n");
+    return failed;
+}
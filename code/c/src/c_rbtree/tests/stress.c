@@ -0,0 +1,869 @@
+/* rbtree/tests/stress.c */
+#include "../rbtree.h"
+#include "tree_check.h"
+#include "test_rng.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* This program runs a long seeded random workload against the rbtree,
+ * checking every answer against a reference set and the tree itself with
+ * the test engine checks at intervals, and reports the throughput, the
+ * latency percentiles per operation, the tree height and the number of
+ * allocations made by the tree.
+ *
+ * The checks also walk the tree in order both ways and compare random
+ * [from, to) ranges (rbtree_lower_bound, rbtree_upper_bound and
+ * rbtree_visit_range, open ends included) with the reference set, and
+ * the answers of rbtree_get_many for random batches with
+ * rbtree_get_element.
+ *
+ * With -h the adds go through rbtree_add_element_hint (or the pool one),
+ * the hint drawn for each: none, the node of the last add, that of an
+ * add long ago, the first, last or root node, or one picked at random.
+ * The node returned must hold the key, and added tell if it was new.
+ *
+ * Built with -DRBTREE_ORDER_STATISTICS, the subtree sizes are checked
+ * after every add and remove around the key: on the paths up from its
+ * neighbors and the node before those, which hold all the nodes the
+ * rotations moved. The checks then also compare rbtree_size, and
+ * rbtree_rank, rbtree_select and rbtree_count_range at random keys and
+ * positions, with the counts of the reference set.
+ *
+ * The keys are numbered 0..universe-1, the number is written at a fixed
+ * width, so the key order is the number order, and the rest up to the
+ * key length is filled with letters. Distributions of the keys picked:
+ * -- uniform     -- any key with the same chance
+ * -- zipf        -- key ranks zipf distributed (-z exponent), the ranks
+ *                   scattered over the key space
+ * -- sorted      -- increasing, wrapping around
+ * -- adversarial -- all keys of the max length with one long common
+ *                   prefix (defeats the prefix compare), taken from both
+ *                   ends towards the middle
+ *
+ * Build:
+ *   gcc -O2 stress.c tree_check.c ../rbtree.c -lm -lpthread \
+ *       -o stress.out
+ * counting the allocations needs GNU ld:
+ *   gcc -O2 -DCOUNT_ALLOCATIONS -Wl,--wrap=malloc,--wrap=free \
+ *       stress.c tree_check.c ../rbtree.c -lm -lpthread -o stress.out
+ * with the order statistics:
+ *   gcc -O2 -DRBTREE_ORDER_STATISTICS stress.c tree_check.c ../rbtree.c \
+ *       -lm -lpthread -o stress_os.out
+ *
+ * Options (defaults in brackets):
+ * -- -n ops          -- number of operations [1000000]
+ * -- -u universe     -- number of different keys [100000]
+ * -- -l min[,max]    -- key length range [16]
+ * -- -d distribution -- uniform, zipf, sorted or adversarial [uniform]
+ * -- -z exponent     -- of the zipf distribution [0.99]
+ * -- -m get,add,del  -- operation mix in percent [50,25,25]
+ * -- -f percent      -- of the universe added before the run [50]
+ * -- -c interval     -- check the tree every that many ops, 0 = only at
+ *                       the end [100000]
+ * -- -s seed         -- [1]
+ * -- -p              -- use pool mode
+ * -- -h              -- add with hints
+ *
+ * Returns 0 if all the answers and checks were right, 1 else. */
+
+enum { op_get, op_add, op_remove, op_kinds };
+enum { dist_uniform, dist_zipf, dist_sorted, dist_adversarial };
+enum { max_key_len = 1024, range_checks = 16, get_many_checks = 16 };
+enum { stats_checks = 64 };
+enum { max_batch = 8 * 8 + 3 };
+
+static const char *const op_names[op_kinds] = { "get", "add", "remove" };
+static const char *const dist_names[] = {
+    "uniform", "zipf", "sorted", "adversarial"
+};
+
+struct options {
+    long ops, universe;
+    int min_len, max_len;
+    int dist;
+    double zipf_exp;
+    int mix[op_kinds];
+    int prefill;
+    long check_every;
+    unsigned long long seed;
+    int use_pool, use_hints;
+};
+
+/* the tree, and the set it must hold */
+struct subject {
+    tree_node *root;
+    rbtree_pool pool, *pool_ptr;
+    unsigned char *present;
+    long size;
+    int use_hints;
+    /* nodes returned by the hinted adds, kept until the next remove */
+    const tree_node *last, *old;
+    unsigned long long hint_seed;
+};
+
+/* Allocation counting */
+
+static long alloc_cnt, free_cnt;
+
+#ifdef COUNT_ALLOCATIONS
+void *__real_malloc(size_t size);
+void __real_free(void *p);
+
+void *__wrap_malloc(size_t size)
+{
+    alloc_cnt++;
+    return __real_malloc(size);
+}
+
+void __wrap_free(void *p)
+{
+    if (p)
+        free_cnt++;
+    __real_free(p);
+}
+#endif
+
+/* Random numbers and keys */
+
+/* a fixed pseudo-random number for every key, for its length and filler */
+static unsigned long long key_hash(unsigned long long x)
+{
+    unsigned long long h = x + 0x9e3779b97f4a7c15ULL;
+
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+static int index_width;
+
+static void make_key(const struct options *o, long idx, char *key)
+{
+    unsigned long long h;
+    int len, i;
+
+    h = key_hash(idx);
+    len = o->min_len + h % (o->max_len - o->min_len + 1);
+    if (o->dist == dist_adversarial)
+        len = o->max_len;
+    if (len < index_width)
+        len = index_width;
+
+    if (o->dist == dist_adversarial) {
+        memset(key, 'x', len - index_width);
+        sprintf(key + len - index_width, "%0*ld", index_width, idx);
+        return;
+    }
+
+    sprintf(key, "%0*ld", index_width, idx);
+    for (i = index_width; i < len; i++) {
+        key[i] = 'a' + h % 26;
+        h = h / 26 ? h / 26 : key_hash(h);
+    }
+    key[len] = '\0';
+}
+
+static double *zipf_cdf;
+
+static void init_zipf(const struct options *o)
+{
+    double sum = 0;
+    long i;
+
+    zipf_cdf = malloc(o->universe * sizeof(*zipf_cdf));
+    for (i = 0; i < o->universe; i++) {
+        sum += 1.0 / pow(i + 1, o->zipf_exp);
+        zipf_cdf[i] = sum;
+    }
+    for (i = 0; i < o->universe; i++)
+        zipf_cdf[i] /= sum;
+}
+
+static long zipf_next(const struct options *o)
+{
+    double u;
+    long lo = 0, hi = o->universe - 1, mid;
+
+    u = (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (zipf_cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    /* multiplying by a prime scatters the popular ranks over the keys */
+    return (long)((lo * 2654435761ULL) % o->universe);
+}
+
+static long next_key_index(const struct options *o, long step)
+{
+    long half;
+
+    switch (o->dist) {
+        case dist_zipf:
+            return zipf_next(o);
+        case dist_sorted:
+            return step % o->universe;
+        case dist_adversarial:
+            step %= o->universe;
+            half = step / 2;
+            return step % 2 ? o->universe - 1 - half : half;
+        default:
+            return rng_next() % o->universe;
+    }
+}
+
+static int next_op(const struct options *o)
+{
+    int r, i;
+
+    r = rng_next() % 100;
+    for (i = 0; i < op_kinds - 1; i++) {
+        if (r < o->mix[i])
+            return i;
+        r -= o->mix[i];
+    }
+
+    return op_kinds - 1;
+}
+
+/* Operations */
+
+/* the hints are drawn from their own numbers, so that the workload of a
+ * seed stays the same with -h */
+static const tree_node *pick_hint(struct subject *t)
+{
+    const tree_node *n;
+    unsigned long long h;
+
+    h = key_hash(t->hint_seed++);
+    switch (h % 5) {
+        case 0:
+            return NULL;
+        case 1:
+            return t->last;
+        case 2:
+            return t->old;
+        case 3:
+            h /= 5;
+            if (h % 3 == 0)
+                return rbtree_first(t->root);
+            return h % 3 == 1 ? rbtree_last(t->root) : t->root;
+        default:
+            /* down a random path, stopping at random */
+            n = t->root;
+            for (h /= 5; n && h % 8; h /= 8) {
+                if ((h / 4 % 2 ? n->left : n->right) == NULL)
+                    break;
+                n = h / 4 % 2 ? n->left : n->right;
+            }
+            return n;
+    }
+}
+
+static int add_with_hint(struct subject *t, long idx, const char *key)
+{
+    const tree_node *hint, *n;
+    int added = -1;
+
+    hint = pick_hint(t);
+    if (t->pool_ptr)
+        n = rbtree_pool_add_element_hint(t->pool_ptr, &t->root, hint, key,
+                NULL, &added);
+    else
+        n = rbtree_add_element_hint(&t->root, hint, key, NULL, &added);
+
+    if (!n || strcmp(n->key, key) != 0 || added != !t->present[idx] ||
+            n != rbtree_get_element(t->root, key))
+        return 0;
+
+    t->last = n;
+    if (t->hint_seed % 64 == 0)
+        t->old = n;
+    t->present[idx] = 1;
+    t->size += added;
+    return 1;
+}
+
+/* does the op, returns 1 if the tree answered as the reference set */
+static int do_op(struct subject *t, int op, long idx, const char *key)
+{
+    int res;
+
+    switch (op) {
+        case op_get:
+            return (rbtree_get_element(t->root, key) != NULL) ==
+                t->present[idx];
+        case op_add:
+            if (t->use_hints)
+                return add_with_hint(t, idx, key);
+            res = rbtree_pool_add_element(t->pool_ptr, &t->root, key, NULL);
+            if (res != !t->present[idx])
+                return 0;
+            t->present[idx] = 1;
+            t->size += res;
+            return 1;
+        default:
+            res = rbtree_pool_remove_element(t->pool_ptr, &t->root, key);
+            if (res != t->present[idx])
+                return 0;
+            t->present[idx] = 0;
+            t->size -= res;
+            /* the nodes may be freed or hold other keys now */
+            if (res)
+                t->last = t->old = NULL;
+            return 1;
+    }
+}
+
+static int tree_height(const tree_node *n)
+{
+    int l, r;
+
+    if (!n)
+        return 0;
+
+    l = tree_height(n->left);
+    r = tree_height(n->right);
+    return (l > r ? l : r) + 1;
+}
+
+/* Checks */
+
+/* the first key index >= idx in the set, the universe if none */
+static long next_present(const struct options *o, const struct subject *t,
+        long idx)
+{
+    while (idx < o->universe && !t->present[idx])
+        idx++;
+    return idx;
+}
+
+/* is n the element of the key index (NULL for the universe) */
+static int is_key_node(const struct options *o, const tree_node *n,
+        long idx)
+{
+    char key[max_key_len];
+
+    if (idx >= o->universe)
+        return n == NULL;
+
+    make_key(o, idx, key);
+    return n && strcmp(n->key, key) == 0;
+}
+
+/* the walks both ways must give the keys of the set in order */
+static int check_iteration(const struct options *o, const struct subject *t)
+{
+    const tree_node *n;
+    long idx;
+
+    n = rbtree_first(t->root);
+    for (idx = next_present(o, t, 0); idx < o->universe;
+            idx = next_present(o, t, idx + 1)) {
+        if (!is_key_node(o, n, idx))
+            return 0;
+        n = rbtree_next(n);
+    }
+    if (n)
+        return 0;
+
+    n = rbtree_last(t->root);
+    for (idx = o->universe - 1; idx >= 0; idx--) {
+        if (!t->present[idx])
+            continue;
+        if (!is_key_node(o, n, idx))
+            return 0;
+        n = rbtree_prev(n);
+    }
+
+    return n == NULL;
+}
+
+struct range_walk {
+    const struct options *o;
+    const struct subject *t;
+    long idx; /* of the element to be visited next */
+    int cnt, ok;
+};
+
+static int visit_in_range(const tree_node *n, void *ctx)
+{
+    struct range_walk *w = ctx;
+
+    if (w->idx >= w->o->universe || !is_key_node(w->o, n, w->idx)) {
+        w->ok = 0;
+        return 1;
+    }
+
+    w->idx = next_present(w->o, w->t, w->idx + 1);
+    w->cnt++;
+    return 0;
+}
+
+/* the bounds of the key from and the keys in [from, to), from -1 and to
+ * the universe stand for NULL, no bound on that side */
+static int check_range(const struct options *o, const struct subject *t,
+        long from, long to)
+{
+    char from_key[max_key_len], to_key[max_key_len];
+    const tree_node *lower, *upper;
+    struct range_walk w;
+    int visited;
+
+    w.o = o;
+    w.t = t;
+    w.idx = next_present(o, t, from < 0 ? 0 : from);
+    w.cnt = 0;
+    w.ok = 1;
+
+    if (from >= 0) {
+        make_key(o, from, from_key);
+        lower = rbtree_lower_bound(t->root, from_key);
+        upper = rbtree_upper_bound(t->root, from_key);
+        if (!is_key_node(o, lower, w.idx) ||
+                !is_key_node(o, upper, next_present(o, t, from + 1)))
+            return 0;
+    }
+    if (to < o->universe)
+        make_key(o, to, to_key);
+
+    visited = rbtree_visit_range(t->root, from >= 0 ? from_key : NULL,
+            to < o->universe ? to_key : NULL, visit_in_range, &w);
+
+    return w.ok && visited == w.cnt && w.idx == next_present(o, t, to);
+}
+
+/* a batch of h % (max_batch + 1) keys in and out of the set, a quarter
+ * of them repeats of earlier ones (the same pointer or a copy), every
+ * answer of rbtree_get_many must be the element rbtree_get_element
+ * finds; the sizes go over several multiples of the group of searches
+ * done at once (8 in rbtree.c) and fall between them */
+static int check_get_many(const struct options *o, const struct subject *t,
+        unsigned long long h)
+{
+    static char keys[max_batch][max_key_len];
+    static const char *batch[max_batch];
+    static const tree_node *out[max_batch];
+    long idx;
+    int n, i;
+
+    n = h % (max_batch + 1);
+    for (i = 0; i < n; i++) {
+        h = key_hash(h);
+        if (i > 0 && h % 4 == 0) {
+            batch[i] = batch[h / 8 % i];
+            if (h % 8 == 4) {
+                strcpy(keys[i], batch[i]);
+                batch[i] = keys[i];
+            }
+            continue;
+        }
+
+        /* half of them the next key in the set, hits unless it is empty */
+        idx = (long)(h / 8 % o->universe);
+        if (h % 2)
+            idx = next_present(o, t, idx) % o->universe;
+        make_key(o, idx, keys[i]);
+        batch[i] = keys[i];
+    }
+
+    rbtree_get_many(t->root, batch, n, out);
+    for (i = 0; i < n; i++) {
+        if (out[i] != rbtree_get_element(t->root, batch[i]))
+            return 0;
+    }
+
+    return 1;
+}
+
+#ifdef RBTREE_ORDER_STATISTICS
+
+static int size_ok(const tree_node *n)
+{
+    size_t left, right;
+
+    if (!n)
+        return 1;
+
+    left = n->left ? n->left->size : 0;
+    right = n->right ? n->right->size : 0;
+    return n->size == left + right + 1;
+}
+
+/* the sizes of n and its children, and so on up to the root */
+static int check_sizes_up(const tree_node *n)
+{
+    for (; n; n = n->parent) {
+        if (!size_ok(n) || !size_ok(n->left) || !size_ok(n->right))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* The rotations of an add are around the path up from the new node. A
+ * remove unlinks the node of the key or, if it had two children, the one
+ * before it (whose key moves up), the rotations are around the path up
+ * from that place: all of them start at one of the two elements before
+ * the key or the one after it. */
+static int check_sizes_around(const tree_node *root, const char *key)
+{
+    const tree_node *next, *prev;
+
+    next = rbtree_lower_bound(root, key);
+    prev = next ? rbtree_prev(next) : rbtree_last(root);
+
+    return check_sizes_up(next) && check_sizes_up(prev) &&
+        check_sizes_up(rbtree_prev(prev));
+}
+
+/* rank, select and count_range at random keys and positions, against the
+ * number of keys of the set below every key index */
+static int check_order_statistics(const struct options *o,
+        const struct subject *t, unsigned long long h)
+{
+    char from_key[max_key_len], to_key[max_key_len];
+    long *below, *members, cnt = 0, from, to, pos, i;
+    int ok;
+
+    below = malloc((o->universe + 1) * sizeof(*below));
+    members = malloc((t->size + 1) * sizeof(*members));
+
+    below[0] = 0;
+    for (i = 0; i < o->universe; i++) {
+        if (t->present[i])
+            members[cnt++] = i;
+        below[i+1] = cnt;
+    }
+
+    ok = cnt == t->size && rbtree_size(t->root) == (size_t)cnt;
+    for (i = 0; ok && i < stats_checks; i++) {
+        h = key_hash(h);
+        from = (long)(h % o->universe);
+        to = from + (long)((h >> 32) % (o->universe - from + 1));
+        pos = (long)((h >> 16) % (cnt + 1));
+
+        make_key(o, from, from_key);
+        if (to < o->universe)
+            make_key(o, to, to_key);
+        ok = rbtree_rank(t->root, from_key) == (size_t)below[from] &&
+            is_key_node(o, rbtree_select(t->root, pos),
+                    pos < cnt ? members[pos] : o->universe);
+
+        /* an open start now and then */
+        if (h % 8 == 0)
+            from = 0;
+        ok = ok && rbtree_count_range(t->root, h % 8 ? from_key : NULL,
+                to < o->universe ? to_key : NULL) ==
+            (size_t)(below[to] - below[from]);
+    }
+
+    free(below);
+    free(members);
+    return ok;
+}
+
+#endif
+
+/* the ranges and batches are drawn from their own numbers, so that the
+ * checks leave the workload of a seed the same */
+static int check_subject(const struct options *o, const struct subject *t)
+{
+    static unsigned long long range_seed, batch_seed;
+    unsigned long long h;
+    long from, to, lo;
+    int i;
+
+    if (!check_tree(t->root) || !check_iteration(o, t))
+        return 0;
+
+    for (i = 0; i < get_many_checks; i++) {
+        if (!check_get_many(o, t, key_hash(~batch_seed++)))
+            return 0;
+    }
+
+#ifdef RBTREE_ORDER_STATISTICS
+    if (!check_order_statistics(o, t, key_hash(~range_seed)))
+        return 0;
+#endif
+
+    for (i = 0; i < range_checks; i++) {
+        h = key_hash(range_seed++);
+        from = (long)(h % (o->universe + 1)) - 1;
+        lo = from < 0 ? 0 : from;
+        to = lo + (long)((h >> 32) % (o->universe - lo + 1));
+        if (!check_range(o, t, from, to))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* Report */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+    return (x > y) - (x < y);
+}
+
+static unsigned int percentile(const unsigned int *sorted, long cnt,
+        double p)
+{
+    long i;
+
+    i = (long)(p * (cnt - 1) + 0.5);
+    return sorted[i];
+}
+
+static void report_latencies(const unsigned int *latencies,
+        const unsigned char *ops, long cnt)
+{
+    unsigned int *sorted;
+    long op_cnt, i;
+    double sum;
+    int op;
+
+    sorted = malloc((cnt ? cnt : 1) * sizeof(*sorted));
+
+    printf("%-8s %10s %8s %8s %8s %8s %8s %8s\n", "op", "count",
+            "mean", "p50", "p90", "p99", "p99.9", "max");
+
+    for (op = 0; op < op_kinds; op++) {
+        op_cnt = 0;
+        sum = 0;
+        for (i = 0; i < cnt; i++) {
+            if (ops[i] == op) {
+                sorted[op_cnt++] = latencies[i];
+                sum += latencies[i];
+            }
+        }
+        if (op_cnt == 0)
+            continue;
+
+        qsort(sorted, op_cnt, sizeof(*sorted), compare_latency);
+        printf("%-8s %10ld %8.0f %8u %8u %8u %8u %8u\n", op_names[op],
+                op_cnt, sum / op_cnt, percentile(sorted, op_cnt, 0.5),
+                percentile(sorted, op_cnt, 0.9),
+                percentile(sorted, op_cnt, 0.99),
+                percentile(sorted, op_cnt, 0.999), sorted[op_cnt-1]);
+    }
+    printf("(latencies in ns, including ~2 clock reads)\n");
+
+    free(sorted);
+}
+
+/* Options */
+
+static int parse_dist(const char *s)
+{
+    int i;
+
+    for (i = 0; i < (int)(sizeof(dist_names) / sizeof(*dist_names)); i++) {
+        if (strcmp(s, dist_names[i]) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+static int parse_options(int argc, char **argv, struct options *o)
+{
+    int c;
+
+    o->ops = 1000000;
+    o->universe = 100000;
+    o->min_len = o->max_len = 16;
+    o->dist = dist_uniform;
+    o->zipf_exp = 0.99;
+    o->mix[op_get] = 50;
+    o->mix[op_add] = 25;
+    o->mix[op_remove] = 25;
+    o->prefill = 50;
+    o->check_every = 100000;
+    o->seed = 1;
+    o->use_pool = 0;
+    o->use_hints = 0;
+
+    while ((c = getopt(argc, argv, "n:u:l:d:z:m:f:c:s:ph")) != -1) {
+        switch (c) {
+            case 'n':
+                o->ops = atol(optarg);
+                break;
+            case 'u':
+                o->universe = atol(optarg);
+                break;
+            case 'l':
+                if (sscanf(optarg, "%d,%d", &o->min_len, &o->max_len) < 2)
+                    o->max_len = o->min_len;
+                break;
+            case 'd':
+                o->dist = parse_dist(optarg);
+                break;
+            case 'z':
+                o->zipf_exp = atof(optarg);
+                break;
+            case 'm':
+                if (sscanf(optarg, "%d,%d,%d", &o->mix[op_get],
+                            &o->mix[op_add], &o->mix[op_remove]) != 3)
+                    return 0;
+                break;
+            case 'f':
+                o->prefill = atoi(optarg);
+                break;
+            case 'c':
+                o->check_every = atol(optarg);
+                break;
+            case 's':
+                o->seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'p':
+                o->use_pool = 1;
+                break;
+            case 'h':
+                o->use_hints = 1;
+                break;
+            default:
+                return 0;
+        }
+    }
+
+    return o->ops >= 0 && o->universe > 0 && o->dist >= 0 &&
+        o->min_len >= 0 && o->max_len >= o->min_len &&
+        o->max_len < max_key_len - 32 && o->mix[op_get] >= 0 &&
+        o->mix[op_add] >= 0 && o->mix[op_remove] >= 0 &&
+        o->mix[op_get] + o->mix[op_add] + o->mix[op_remove] == 100 &&
+        o->prefill >= 0 && o->prefill <= 100 && o->check_every >= 0 &&
+        optind == argc;
+}
+
+int main(int argc, char **argv)
+{
+    struct options o;
+    struct subject t;
+    unsigned int *latencies;
+    unsigned char *ops;
+    char key[max_key_len];
+    double op_start, total;
+    long i, idx, checks = 0;
+    int op, ok = 1;
+
+    if (!parse_options(argc, argv, &o)) {
+        fprintf(stderr, "Usage: %s [-n ops] [-u universe] [-l min[,max]] "
+                "[-d uniform|zipf|sorted|adversarial] [-z exponent] "
+                "[-m get,add,del] [-f prefill%%] [-c interval] [-s seed] "
+                "[-p] [-h]\n", argv[0]);
+        return 1;
+    }
+
+    rng_state = o.seed * 0x9e3779b97f4a7c15ULL + 1;
+    index_width = snprintf(NULL, 0, "%ld", o.universe - 1);
+    if (o.dist == dist_zipf)
+        init_zipf(&o);
+
+    t.root = NULL;
+    t.pool_ptr = o.use_pool ? &t.pool : NULL;
+    if (o.use_pool)
+        rbtree_pool_init(&t.pool);
+    t.present = calloc(o.universe, 1);
+    t.size = 0;
+    t.use_hints = o.use_hints;
+    t.last = t.old = NULL;
+    t.hint_seed = 0;
+
+    latencies = malloc((o.ops ? o.ops : 1) * sizeof(*latencies));
+    ops = malloc(o.ops ? o.ops : 1);
+
+    /* the same keys for any distribution and mix with the same seed */
+    for (i = 0; i < o.universe; i++) {
+        if ((long)(rng_next() % 100) < o.prefill) {
+            make_key(&o, i, key);
+            do_op(&t, op_add, i, key);
+        }
+    }
+
+    printf("%s keys, universe %ld, length %d..%d, mix %d/%d/%d, "
+            "%ld ops, seed %llu%s%s\n", dist_names[o.dist], o.universe,
+            o.min_len, o.max_len, o.mix[op_get], o.mix[op_add],
+            o.mix[op_remove], o.ops, o.seed, o.use_pool ? ", pool" : "",
+            o.use_hints ? ", hints" : "");
+
+    alloc_cnt = free_cnt = 0;
+    total = 0;
+
+    for (i = 0; i < o.ops && ok; i++) {
+        op = next_op(&o);
+        idx = next_key_index(&o, i);
+        make_key(&o, idx, key);
+
+        op_start = now();
+        ok = do_op(&t, op, idx, key);
+        latencies[i] = (unsigned int)((now() - op_start) * 1e9);
+        total += latencies[i];
+        ops[i] = op;
+
+        if (!ok)
+            fprintf(stderr, "wrong answer: %s \"%s\" at op %ld\n",
+                    op_names[op], key, i);
+
+#ifdef RBTREE_ORDER_STATISTICS
+        if (ok && op != op_get && !check_sizes_around(t.root, key)) {
+            ok = 0;
+            fprintf(stderr, "wrong sizes after %s \"%s\" at op %ld\n",
+                    op_names[op], key, i);
+        }
+#endif
+
+        if (ok && o.check_every && (i + 1) % o.check_every == 0) {
+            ok = check_subject(&o, &t);
+            checks++;
+            if (!ok)
+                fprintf(stderr, "invalid tree after op %ld\n", i);
+        }
+    }
+
+    if (ok) {
+        ok = check_subject(&o, &t);
+        checks++;
+        if (!ok)
+            fprintf(stderr, "invalid tree at the end\n");
+    }
+
+    printf("%ld ops, %.0f ops/s (time in the tree only)\n", i,
+            total > 0 ? i / (total * 1e-9) : 0.0);
+    report_latencies(latencies, ops, i);
+    printf("size %ld, height %d (red-black bound %.0f)\n", t.size,
+            tree_height(t.root), 2 * log2(t.size + 1.0));
+#ifdef COUNT_ALLOCATIONS
+    printf("allocations during the run: %ld malloc, %ld free\n",
+            alloc_cnt, free_cnt);
+#else
+    printf("allocations: not counted, build with -DCOUNT_ALLOCATIONS\n");
+#endif
+    printf("%ld checks, %s\n", checks, ok ? "all passed" : "FAILED");
+
+    if (o.use_pool)
+        rbtree_pool_destroy(&t.pool);
+    else
+        rbtree_destroy(t.root);
+    free(t.present);
+    free(latencies);
+    free(ops);
+    free(zipf_cdf);
+
+    return !ok;
+}
@@ -1,5 +1,6 @@
 /* rbtree/test_generation/test_engine.c */
 #include "../rbtree.h"
+#include "tree_check.h"
 #include <stdio.h>
 
 /* uncomment this if you want to be able to run the test engine in full 
@@ -34,72 +35,6 @@ int read_line(char *command, char *key) {
     return getchar() == 10;
 }
 
-/* function for checking the first rbtree property: the root must be black */
-int check_black_root_property(const tree_node *root) 
-{
-    return !root || root->color == black;
-}
-
-/* function for checking the second rbtree property: 
- * all red nodes must have black children */
-int check_red_node_children_property(const tree_node *root)
-{
-    if (!root)
-        return 1;
-
-    if (root->parent && root->color == red && root->parent->color == red)
-        return 0;
-
-    return check_red_node_children_property(root->left) && 
-        check_red_node_children_property(root->right);
-}
-
-/* recursive function for checking leaf depths */
-int check_leaf_depth_property_iteratively(const tree_node *root,
-        int cur_depth, int *req_depth)
-{
-    /* if reached leaf, and required depth already set, then return false if
-     * current leaf depth does not match it, else true.
-     * If req depth was not set, then set it with current leaf depth, and
-     * return true. */
-    if (!root) {
-        if (*req_depth >= 0 && cur_depth != *req_depth)
-            return 0;
-        else if (*req_depth < 0)
-            *req_depth = cur_depth;
-
-        return 1;
-    }
-
-    /* only increase the depth if the node was black */
-    if (root->color == black)
-        cur_depth++;
-
-    /* recursively traverse the whole tree while checking leaves */
-    return check_leaf_depth_property_iteratively(
-            root->left, cur_depth, req_depth) &&
-        check_leaf_depth_property_iteratively(
-                root->right, cur_depth, req_depth);
-}
-
-/* function for checking the third rbtree property: 
- * all paths from the root to the leaves must contain the same number of
- * black nodes */
-int check_leaf_depth_property(const tree_node *root)
-{
-    int req_depth = -1;
-
-    return check_leaf_depth_property_iteratively(root, 0, &req_depth);
-}
-
-/* function checks the given tree for all three properties */
-int check_tree(const tree_node *root) 
-{
-    return check_black_root_property(root) &&
-        check_red_node_children_property(root) &&
-        check_leaf_depth_property(root);
-}
-
 int main() {
     tree_node *root = NULL;
     char command, key[2];
@@ -0,0 +1,19 @@
+/* rbtree/tests/test_rng.h */
+#ifndef TEST_RNG_SENTRY
+#define TEST_RNG_SENTRY
+
+/* The random numbers of the tests and the bench: xorshift64*, so that the
+ * runs do not depend on the libc rand and a seed gives the same run
+ * everywhere. The state must be set to non zero before the first call. */
+
+static unsigned long long rng_state;
+
+static unsigned long long rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+#endif
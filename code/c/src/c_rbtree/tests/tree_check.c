@@ -0,0 +1,141 @@
+/* rbtree/test_generation/tree_check.c */
+#include "tree_check.h"
+#include <string.h>
+
+/* The validity checks shared by the test engine and the stress driver */
+
+/* function for checking the first rbtree property: the root must be black */
+int check_black_root_property(const tree_node *root) 
+{
+    return !root || root->color == black;
+}
+
+/* function for checking the second rbtree property: 
+ * all red nodes must have black children */
+int check_red_node_children_property(const tree_node *root)
+{
+    if (!root)
+        return 1;
+
+    if (root->parent && root->color == red && root->parent->color == red)
+        return 0;
+
+    return check_red_node_children_property(root->left) && 
+        check_red_node_children_property(root->right);
+}
+
+/* recursive function for checking leaf depths */
+static int check_leaf_depth_property_iteratively(const tree_node *root,
+        int cur_depth, int *req_depth)
+{
+    /* if reached leaf, and required depth already set, then return false if
+     * current leaf depth does not match it, else true.
+     * If req depth was not set, then set it with current leaf depth, and
+     * return true. */
+    if (!root) {
+        if (*req_depth >= 0 && cur_depth != *req_depth)
+            return 0;
+        else if (*req_depth < 0)
+            *req_depth = cur_depth;
+
+        return 1;
+    }
+
+    /* only increase the depth if the node was black */
+    if (root->color == black)
+        cur_depth++;
+
+    /* recursively traverse the whole tree while checking leaves */
+    return check_leaf_depth_property_iteratively(
+            root->left, cur_depth, req_depth) &&
+        check_leaf_depth_property_iteratively(
+                root->right, cur_depth, req_depth);
+}
+
+/* function for checking the third rbtree property: 
+ * all paths from the root to the leaves must contain the same number of
+ * black nodes */
+int check_leaf_depth_property(const tree_node *root)
+{
+    int req_depth = -1;
+
+    return check_leaf_depth_property_iteratively(root, 0, &req_depth);
+}
+
+/* function for checking the search tree property: walking the tree with
+ * the iterators must give strictly increasing keys, and walking it
+ * backwards must give the same number of elements */
+int check_order_property(const tree_node *root)
+{
+    const tree_node *n, *prev = NULL;
+    int forward = 0, backward = 0;
+
+    for (n = rbtree_first(root); n; prev = n, n = rbtree_next(n)) {
+        if (prev && strcmp(prev->key, n->key) >= 0)
+            return 0;
+        forward++;
+    }
+
+    for (n = rbtree_last(root); n; n = rbtree_prev(n))
+        backward++;
+
+    return forward == backward;
+}
+
+#ifdef RBTREE_ORDER_STATISTICS
+/* function for checking the subtree sizes, and that select and rank
+ * agree with the in-order position of every element */
+int check_size_property(const tree_node *root)
+{
+    const tree_node *n;
+    size_t i = 0, left, right;
+
+    for (n = rbtree_first(root); n; n = rbtree_next(n), i++) {
+        left = n->left ? n->left->size : 0;
+        right = n->right ? n->right->size : 0;
+        if (n->size != left + right + 1 || rbtree_select(root, i) != n ||
+                rbtree_rank(root, n->key) != i)
+            return 0;
+    }
+
+    return rbtree_size(root) == i && rbtree_select(root, i) == NULL &&
+        rbtree_count_range(root, NULL, NULL) == i;
+}
+#else
+int check_size_property(const tree_node *root)
+{
+    (void)root;
+    return 1;
+}
+#endif
+
+static int check_children_parents(const tree_node *n)
+{
+    if (!n)
+        return 1;
+
+    if ((n->left && n->left->parent != n) ||
+            (n->right && n->right->parent != n))
+        return 0;
+
+    return check_children_parents(n->left) &&
+        check_children_parents(n->right);
+}
+
+/* function for checking the parent pointers the iterators rely on: none
+ * for the root, and every child points back to its node */
+int check_parent_property(const tree_node *root)
+{
+    return (!root || !root->parent) && check_children_parents(root);
+}
+
+/* function checks the given tree for all three properties and the order */
+int check_tree(const tree_node *root) 
+{
+    return check_black_root_property(root) &&
+        check_red_node_children_property(root) &&
+        check_leaf_depth_property(root) &&
+        check_parent_property(root) &&
+        check_order_property(root) &&
+        check_size_property(root);
+}
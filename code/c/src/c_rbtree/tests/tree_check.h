@@ -0,0 +1,19 @@
+/* rbtree/test_generation/tree_check.h */
+#ifndef TREE_CHECK_SENTRY
+#define TREE_CHECK_SENTRY
+
+#include "../rbtree.h"
+
+/* All the checks return 1 if the tree is valid, 0 else */
+
+int check_black_root_property(const tree_node *root);
+int check_red_node_children_property(const tree_node *root);
+int check_leaf_depth_property(const tree_node *root);
+int check_order_property(const tree_node *root);
+int check_size_property(const tree_node *root);
+int check_parent_property(const tree_node *root);
+
+/* all of the above */
+int check_tree(const tree_node *root);
+
+#endif
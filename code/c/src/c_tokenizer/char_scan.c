@@ -0,0 +1,107 @@
+/* c_tokenizer/src/char_scan.c */
+#include "char_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHAR_SCAN_X86
+#include <immintrin.h>
+#endif
+
+static size_t scan_scalar(const struct char_scan_set *set, const char *p,
+        size_t n)
+{
+    size_t i;
+    int j;
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < set->cnt; j++) {
+            if (p[i] == set->chars[j])
+                return i;
+        }
+    }
+
+    return n;
+}
+
+#if defined(CHAR_SCAN_X86) && defined(__SSE2__)
+
+static size_t scan_sse2(const struct char_scan_set *set, const char *p,
+        size_t n)
+{
+    __m128i pattern[char_scan_max_chars], block, hits;
+    size_t i;
+    int j, mask;
+
+    for (j = 0; j < set->cnt; j++)
+        pattern[j] = _mm_set1_epi8(set->chars[j]);
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        block = _mm_loadu_si128((const __m128i *)(p + i));
+        hits = _mm_setzero_si128();
+        for (j = 0; j < set->cnt; j++)
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, pattern[j]));
+
+        mask = _mm_movemask_epi8(hits);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + scan_scalar(set, p + i, n - i);
+}
+
+#endif
+
+#if defined(CHAR_SCAN_X86)
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const struct char_scan_set *set, const char *p,
+        size_t n)
+{
+    __m256i pattern[char_scan_max_chars], block, hits;
+    size_t i;
+    unsigned int mask;
+    int j;
+
+    for (j = 0; j < set->cnt; j++)
+        pattern[j] = _mm256_set1_epi8(set->chars[j]);
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        block = _mm256_loadu_si256((const __m256i *)(p + i));
+        hits = _mm256_setzero_si256();
+        for (j = 0; j < set->cnt; j++)
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, pattern[j]));
+
+        mask = _mm256_movemask_epi8(hits);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + scan_scalar(set, p + i, n - i);
+}
+
+#endif
+
+typedef size_t (*scan_function)(const struct char_scan_set *, const char *,
+        size_t);
+
+#if defined(CHAR_SCAN_X86) && defined(__SSE2__)
+static scan_function scan_impl = scan_sse2;
+#else
+static scan_function scan_impl = scan_scalar;
+#endif
+
+/* picked once before main, so that no thread ever sees it change */
+#if defined(CHAR_SCAN_X86)
+__attribute__((constructor))
+static void select_scan_impl()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        scan_impl = scan_avx2;
+}
+#endif
+
+size_t char_scan_run(const struct char_scan_set *set, const char *p,
+        size_t n)
+{
+    return scan_impl(set, p, n);
+}
@@ -0,0 +1,23 @@
+/* c_tokenizer/src/char_scan.h */
+#ifndef CHAR_SCAN_SENTRY
+#define CHAR_SCAN_SENTRY
+
+#include <stddef.h>
+
+/* Finds the first char of a small set in a buffer, 16 bytes at a time
+ * with SSE2 or 32 with AVX2 (picked at startup by what the cpu has), else
+ * one by one. The tokenizer uses it to skip over runs of plain word
+ * chars up to the next one that changes its state. */
+
+enum { char_scan_max_chars = 8 };
+
+struct char_scan_set {
+    int cnt;
+    char chars[char_scan_max_chars];
+};
+
+/* returns the number of chars at the start of p[0..n) not in the set */
+size_t char_scan_run(const struct char_scan_set *set, const char *p,
+        size_t n);
+
+#endif
@@ -0,0 +1,171 @@
+/* c_tokenizer/src/input_buffer.c */
+#include "input_buffer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static struct input_buffer *input_buffer_create()
+{
+    struct input_buffer *in = malloc(sizeof(struct input_buffer));
+    in->data = NULL;
+    in->len = 0;
+    in->pos = 0;
+    in->fd = -1;
+    in->block = NULL;
+    in->block_size = 0;
+    in->map = NULL;
+    in->map_len = 0;
+    return in;
+}
+
+struct input_buffer *input_buffer_create_memory(const char *data,
+        size_t len)
+{
+    struct input_buffer *in = input_buffer_create();
+    in->data = data;
+    in->len = len;
+    return in;
+}
+
+struct input_buffer *input_buffer_create_fd(int fd, size_t block_size)
+{
+    struct input_buffer *in = input_buffer_create();
+
+    if (block_size == 0)
+        block_size = input_buffer_default_block_size;
+
+    in->fd = fd;
+    in->block_size = block_size;
+    in->block = malloc(block_size);
+    in->data = in->block;
+    return in;
+}
+
+static struct input_buffer *read_whole_fd(int fd);
+
+struct input_buffer *input_buffer_map_file(const char *path)
+{
+    struct input_buffer *in;
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return NULL;
+    }
+
+    /* the size of a pipe or a device tells nothing, nor does that of a
+     * /proc file (0), those are read instead, as is an empty file (mmap
+     * can not map 0 bytes) */
+    if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+        in = read_whole_fd(fd);
+        close(fd);
+        return in;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    in = input_buffer_create();
+    in->map = map;
+    in->map_len = st.st_size;
+    in->data = map;
+    in->len = st.st_size;
+    return in;
+}
+
+/* the whole input into the block, which doubles as it fills up, NULL on
+ * a read error */
+static struct input_buffer *read_whole_fd(int fd)
+{
+    struct input_buffer *in;
+    ssize_t res;
+
+    in = input_buffer_create_fd(fd, 0);
+    in->fd = -1;
+
+    for (;;) {
+        if (in->len == in->block_size) {
+            in->block_size *= 2;
+            in->block = realloc(in->block, in->block_size);
+            in->data = in->block;
+        }
+
+        do
+            res = read(fd, in->block + in->len, in->block_size - in->len);
+        while (res == -1 && errno == EINTR);
+
+        if (res <= 0)
+            break;
+        in->len += res;
+    }
+
+    if (res == -1) {
+        input_buffer_free(in);
+        return NULL;
+    }
+
+    return in;
+}
+
+int input_buffer_refill(struct input_buffer *in)
+{
+    size_t from = in->pos;
+    return input_buffer_refill_keeping(in, &from);
+}
+
+int input_buffer_refill_keeping(struct input_buffer *in, size_t *from)
+{
+    size_t kept;
+    ssize_t res;
+
+    if (in->pos < in->len)
+        return 1;
+    if (in->fd == -1)
+        return 0;
+
+    kept = in->len - *from;
+    if (kept == in->block_size) {
+        in->block_size *= 2;
+        in->block = realloc(in->block, in->block_size);
+    }
+    memmove(in->block, in->block + *from, kept);
+    in->data = in->block;
+    in->len = kept;
+    in->pos = kept;
+    *from = 0;
+
+    do
+        res = read(in->fd, in->block + kept, in->block_size - kept);
+    while (res == -1 && errno == EINTR);
+
+    /* a read error ends the input, as EOF does for getc */
+    if (res <= 0) {
+        in->fd = -1;
+        return 0;
+    }
+
+    in->len += res;
+    return 1;
+}
+
+void input_buffer_free(struct input_buffer *in)
+{
+    if (in->map)
+        munmap(in->map, in->map_len);
+    free(in->block);
+    free(in);
+}
@@ -0,0 +1,44 @@
+/* c_tokenizer/src/input_buffer.h */
+#ifndef INPUT_BUFFER_SENTRY
+#define INPUT_BUFFER_SENTRY
+
+#include <stddef.h>
+
+/* Input for the tokenizer taken in big blocks instead of one getc call
+ * per char: a whole file mapped into memory, a block refilled by read()
+ * calls on a file descriptor, or memory the caller already has.
+ *
+ * The tokenizer reads data[pos..len) directly, and calls
+ * input_buffer_refill when it is all consumed. */
+
+struct input_buffer {
+    const char *data;
+    size_t len, pos;
+    int fd;             /* refilled from it, -1 if all the data is there */
+    char *block;
+    size_t block_size;
+    void *map;
+    size_t map_len;
+};
+
+enum { input_buffer_default_block_size = 1 << 20 };
+
+/* the memory is not copied, it must outlive the buffer */
+struct input_buffer *input_buffer_create_memory(const char *data,
+        size_t len);
+/* block_size 0 means input_buffer_default_block_size, the fd is not
+ * closed on input_buffer_free */
+struct input_buffer *input_buffer_create_fd(int fd, size_t block_size);
+/* returns NULL if the file can not be opened, mapped or read: a file
+ * whose size tells nothing (a pipe, a device, a /proc file, which has 0)
+ * is read whole into memory instead */
+struct input_buffer *input_buffer_map_file(const char *path);
+
+/* returns 0 at the end of input, non-0 if there is more data */
+int input_buffer_refill(struct input_buffer *in);
+/* the same, but data[*from..pos) stays in the buffer, and *from is set
+ * to where it is now (the block grows if that is all of it) */
+int input_buffer_refill_keeping(struct input_buffer *in, size_t *from);
+void input_buffer_free(struct input_buffer *in);
+
+#endif
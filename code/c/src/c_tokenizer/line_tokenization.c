@@ -1,102 +1,418 @@
 /* c_tokenizer/src/line_tokenization.c */
 #include "line_tokenization.h"
+#include "char_scan.h"
 
-enum line_traverse_mode { regular, in_quotes };
-
-struct tokenization_options {
-    int use_spec_chars;
-};
+#include <pthread.h>
+#include <stdlib.h>
 
+/* dfa_state as in tokenizer_dfa.h */
 struct line_traverse_state {
     int cur_c;
-    enum line_traverse_mode mode;
-    int in_word, ignore_spec;
+    int dfa_state;
+    const struct tokenizer_dfa *dfa;
 };
 
-static struct tokenization_options cur_options = { 1 };
+struct tokenizer {
+    struct tokenizer_dfa dfa;
+    struct token_line line;
+    struct linear_allocator alloc;
+};
 
-void set_tokenization_options(enum tokenizer_option use_spec_chars)
-{
-    cur_options.use_spec_chars = use_spec_chars;
-}
+struct tokenizer_stream {
+    struct tokenizer_dfa dfa;
+    struct line_traverse_state state;
+    struct token_line line;
+    token_line_visitor visit;
+    void *ctx;
+    int stopped;    /* what the visitor returned, if non-0 */
+};
+
+static enum tokenizer_option cur_use_spec_chars = tokenizer_opt_on;
 
-static void init_state(struct line_traverse_state *state)
+/* the tables of the two option sets, built on first use */
+static struct tokenizer_dfa default_dfa, plain_dfa;
+static pthread_once_t builtin_dfas_once = PTHREAD_ONCE_INIT;
+
+static void build_builtin_dfas()
 {
-    state->mode = regular;
-    state->in_word = 0;
-    state->ignore_spec = 0;
+    tokenizer_dfa_build(&default_dfa, &tokenizer_default_dialect);
+    tokenizer_dfa_build(&plain_dfa, &tokenizer_plain_dialect);
 }
 
-static int char_is_eol(int c)
+static const struct tokenizer_dfa *builtin_dfa(
+        enum tokenizer_option use_spec_chars)
 {
-    return c == '\n' || c == '\r' || c == EOF;
+    pthread_once(&builtin_dfas_once, build_builtin_dfas);
+    return use_spec_chars ? &default_dfa : &plain_dfa;
 }
 
-static int cur_char_is_special(const struct line_traverse_state *state)
+void set_tokenization_options(enum tokenizer_option use_spec_chars)
 {
-    return cur_options.use_spec_chars && !state->ignore_spec && 
-        (state->cur_c == '"' || state->cur_c == '\\');
+    cur_use_spec_chars = use_spec_chars;
 }
 
-static int cur_char_is_in_word(const struct line_traverse_state *state)
+static void init_state(struct line_traverse_state *state,
+        const struct tokenizer_dfa *dfa)
 {
-    return state->mode == in_quotes ||
-        (state->cur_c != ' ' && state->cur_c != '\t');
+    state->dfa = dfa;
+    state->dfa_state = 0;
 }
 
-static void switch_traverse_mode(struct line_traverse_state *state)
+/* what a char does to the words of the line */
+enum char_action {
+    char_starts_word = 1,
+    char_goes_to_word = 2,
+    char_ends_line = 4
+};
+
+/* moves the state past the current char (not EOF), returns its
+ * char_action bits, the same whatever the words are made into */
+static int traverse_char(struct line_traverse_state *state)
 {
-    state->mode = state->mode == regular ? in_quotes : regular;
+    unsigned char t = state->dfa->next[state->dfa_state][state->cur_c];
+
+    state->dfa_state = t & dfa_state_mask;
+    return t >> dfa_action_shift;
 }
 
-static void process_spec_char(struct line_traverse_state *state,
+static int process_char(struct line_traverse_state *state,
         struct word_list *words)
 {
-    if (state->cur_c == '"') {
-        switch_traverse_mode(state);
+    int actions = traverse_char(state);
 
-        if (!state->in_word && state->mode == in_quotes) {
-            word_list_add_item(words);
-            state->in_word = 1;
-        }
-    } else if (state->cur_c == '\\')
-        state->ignore_spec = 1;
+    if (actions & char_starts_word)
+        word_list_add_item(words);
+    if (actions & char_goes_to_word)
+        word_list_add_letter_to_last(words, state->cur_c);
+
+    return actions;
 }
 
+/* returns 0 for a complete line, 1 if it ended in quotes or right after
+ * an escape */
+static int finish_line(const struct line_traverse_state *state,
+        int *eol_char)
+{
+    if (state->dfa_state & (dfa_mode_mask | dfa_escaped))
+        return 1;
+
+    *eol_char = state->cur_c;
+    return 0;
+}
 
 int tokenize_input_line_to_word_list(FILE *f, 
         struct word_list **out_words, int *eol_char)
 {
-    int status = 0;
     struct line_traverse_state state;
+    int status;
 
     *out_words = word_list_create();
 
-    init_state(&state);
+    init_state(&state, builtin_dfa(cur_use_spec_chars));
 
-    while (!char_is_eol((state.cur_c = getc(f)))) {
-        if (cur_char_is_special(&state))
-            process_spec_char(&state, *out_words);
-        else {
-            if (!state.in_word && cur_char_is_in_word(&state))
-                 word_list_add_item(*out_words);
+    while ((state.cur_c = getc(f)) != EOF) {
+        if (process_char(&state, *out_words) & char_ends_line)
+            break;
+    }
 
-            state.in_word = cur_char_is_in_word(&state);
+    status = finish_line(&state, eol_char);
+    if (status != 0)
+        word_list_free(*out_words);
 
-            if (state.in_word)
-                word_list_add_letter_to_last(*out_words, state.cur_c);
+    return status;
+}
 
-            state.ignore_spec = 0;
-        }
+static int buffer_getc(struct input_buffer *in)
+{
+    if (in->pos == in->len && !input_buffer_refill(in))
+        return EOF;
+    return (unsigned char)in->data[in->pos++];
+}
+
+/* In a word (not right after an escape), the plain word chars at the
+ * start of p[0..n), following the current char, up to the next char that
+ * can change the state: these can all be added at once. */
+static size_t word_run_length(const struct line_traverse_state *state,
+        const char *p, size_t n)
+{
+    const struct char_scan_set *stops;
+
+    if ((state->dfa_state & (dfa_in_word | dfa_escaped)) != dfa_in_word)
+        return 0;
+
+    stops = &state->dfa->run_stops[state->dfa_state & dfa_mode_mask];
+    if (stops->cnt == 0)
+        return 0;
+
+    return char_scan_run(stops, p, n);
+}
+
+static void add_word_run(const struct line_traverse_state *state,
+        struct input_buffer *in, struct word_list *words)
+{
+    size_t n = word_run_length(state, in->data + in->pos, in->len - in->pos);
+
+    if (n > 0) {
+        word_list_add_letters_to_last(words, in->data + in->pos, n);
+        in->pos += n;
     }
+}
+
+static int buffer_line_to_word_list(const struct tokenizer_dfa *dfa,
+        struct input_buffer *in, struct word_list **out_words, int *eol_char)
+{
+    struct line_traverse_state state;
+    int status;
 
-    if (state.mode != regular || state.ignore_spec)
-        status = 1;
+    init_state(&state, dfa);
 
-    if (status == 0)
-        *eol_char = state.cur_c;
-    else
+    while ((state.cur_c = buffer_getc(in)) != EOF) {
+        if (process_char(&state, *out_words) & char_ends_line)
+            break;
+
+        add_word_run(&state, in, *out_words);
+    }
+
+    status = finish_line(&state, eol_char);
+    if (status != 0)
         word_list_free(*out_words);
 
     return status;
 }
+
+int tokenize_buffer_line_to_word_list(struct input_buffer *in,
+        struct word_list **out_words, int *eol_char)
+{
+    *out_words = word_list_create();
+    return buffer_line_to_word_list(builtin_dfa(cur_use_spec_chars), in,
+            out_words, eol_char);
+}
+
+int tokenize_buffer_line_to_word_list_in(struct linear_allocator *a,
+        struct input_buffer *in, struct word_list **out_words, int *eol_char)
+{
+    *out_words = word_list_create_in(a);
+    return buffer_line_to_word_list(builtin_dfa(cur_use_spec_chars), in,
+            out_words, eol_char);
+}
+
+/* as buffer_getc, but the data of the line stays in the buffer */
+static int span_getc(struct input_buffer *in, size_t *line_start,
+        struct token_line *line)
+{
+    if (in->pos == in->len) {
+        int more = input_buffer_refill_keeping(in, line_start);
+        line->source = in->data + *line_start;
+        if (!more)
+            return EOF;
+    }
+    return (unsigned char)in->data[in->pos++];
+}
+
+static void add_span_run(const struct line_traverse_state *state,
+        struct input_buffer *in, size_t line_start, struct token_line *line)
+{
+    size_t n = word_run_length(state, in->data + in->pos, in->len - in->pos);
+
+    if (n > 0) {
+        token_line_add_chars_to_last(line, in->pos - line_start, n);
+        in->pos += n;
+    }
+}
+
+static int buffer_line_to_spans(const struct tokenizer_dfa *dfa,
+        struct input_buffer *in, struct token_line *line, int *eol_char)
+{
+    struct line_traverse_state state;
+    size_t line_start = in->pos;
+    int actions, status;
+
+    token_line_clear(line);
+    line->source = in->data + line_start;
+
+    init_state(&state, dfa);
+
+    while ((state.cur_c = span_getc(in, &line_start, line)) != EOF) {
+        actions = traverse_char(&state);
+
+        if (actions & char_ends_line)
+            break;
+        if (actions & char_starts_word)
+            token_line_add_span(line);
+        if (actions & char_goes_to_word)
+            token_line_add_chars_to_last(line, in->pos - 1 - line_start, 1);
+
+        add_span_run(&state, in, line_start, line);
+    }
+
+    status = finish_line(&state, eol_char);
+    if (status != 0)
+        token_line_clear(line);
+
+    return status;
+}
+
+int tokenize_buffer_line_to_spans(struct input_buffer *in,
+        struct token_line *line, int *eol_char)
+{
+    return buffer_line_to_spans(builtin_dfa(cur_use_spec_chars), in, line,
+            eol_char);
+}
+
+/* Tokenizer context */
+
+struct tokenizer *tokenizer_create(enum tokenizer_option use_spec_chars)
+{
+    struct tokenizer *tk = malloc(sizeof(struct tokenizer));
+    tk->dfa = *builtin_dfa(use_spec_chars);
+    token_line_init(&tk->line);
+    linear_allocator_init(&tk->alloc, 0);
+    return tk;
+}
+
+struct tokenizer *tokenizer_create_dialect(const struct tokenizer_dialect *d)
+{
+    struct tokenizer *tk = tokenizer_create(tokenizer_opt_on);
+
+    if (!tokenizer_dfa_build(&tk->dfa, d)) {
+        tokenizer_free(tk);
+        return NULL;
+    }
+
+    return tk;
+}
+
+void tokenizer_set_options(struct tokenizer *tk,
+        enum tokenizer_option use_spec_chars)
+{
+    tk->dfa = *builtin_dfa(use_spec_chars);
+}
+
+void tokenizer_free(struct tokenizer *tk)
+{
+    token_line_free(&tk->line);
+    linear_allocator_destroy(&tk->alloc);
+    free(tk);
+}
+
+int tokenizer_next_words(struct tokenizer *tk, struct input_buffer *in,
+        struct word_list **out_words, int *eol_char)
+{
+    linear_allocator_reset(&tk->alloc);
+    *out_words = word_list_create_in(&tk->alloc);
+    return buffer_line_to_word_list(&tk->dfa, in, out_words, eol_char);
+}
+
+int tokenizer_next_spans(struct tokenizer *tk, struct input_buffer *in,
+        const struct token_line **line, int *eol_char)
+{
+    *line = &tk->line;
+    return buffer_line_to_spans(&tk->dfa, in, &tk->line, eol_char);
+}
+
+/* Push tokenizer */
+
+struct tokenizer_stream *tokenizer_stream_create(
+        enum tokenizer_option use_spec_chars,
+        token_line_visitor visit, void *ctx)
+{
+    struct tokenizer_stream *st = malloc(sizeof(struct tokenizer_stream));
+    st->dfa = *builtin_dfa(use_spec_chars);
+    init_state(&st->state, &st->dfa);
+    token_line_init(&st->line);
+    st->visit = visit;
+    st->ctx = ctx;
+    st->stopped = 0;
+    return st;
+}
+
+struct tokenizer_stream *tokenizer_stream_create_dialect(
+        const struct tokenizer_dialect *d,
+        token_line_visitor visit, void *ctx)
+{
+    struct tokenizer_stream *st;
+
+    st = tokenizer_stream_create(tokenizer_opt_on, visit, ctx);
+    if (!tokenizer_dfa_build(&st->dfa, d)) {
+        tokenizer_stream_free(st);
+        return NULL;
+    }
+
+    return st;
+}
+
+void tokenizer_stream_free(struct tokenizer_stream *st)
+{
+    token_line_free(&st->line);
+    free(st);
+}
+
+static int end_stream_line(struct tokenizer_stream *st)
+{
+    int status, eol_char;
+
+    status = finish_line(&st->state, &eol_char);
+    if (status != 0) {
+        token_line_clear(&st->line);
+        eol_char = st->state.cur_c;
+    }
+
+    st->stopped = st->visit(&st->line, status, eol_char, st->ctx);
+
+    token_line_clear(&st->line);
+    init_state(&st->state, &st->dfa);
+    return st->stopped;
+}
+
+/* The offsets of the line are from base in data, the start of the line,
+ * or of the data for a line going on from the last feed: its words are
+ * all in the arena by now. */
+int tokenizer_stream_feed(struct tokenizer_stream *st, const char *data,
+        size_t len)
+{
+    struct line_traverse_state *state = &st->state;
+    size_t pos = 0, base = 0, n;
+    int actions;
+
+    if (st->stopped)
+        return st->stopped;
+
+    st->line.source = data;
+
+    while (pos < len) {
+        state->cur_c = (unsigned char)data[pos++];
+        actions = traverse_char(state);
+
+        if (actions & char_ends_line) {
+            if (end_stream_line(st) != 0)
+                return st->stopped;
+            base = pos;
+            st->line.source = data + base;
+            continue;
+        }
+
+        if (actions & char_starts_word)
+            token_line_add_span(&st->line);
+        if (actions & char_goes_to_word)
+            token_line_add_chars_to_last(&st->line, pos - 1 - base, 1);
+
+        n = word_run_length(state, data + pos, len - pos);
+        if (n > 0) {
+            token_line_add_chars_to_last(&st->line, pos - base, n);
+            pos += n;
+        }
+    }
+
+    /* the data is the caller's, gone after the return */
+    token_line_detach(&st->line);
+    return 0;
+}
+
+int tokenizer_stream_finish(struct tokenizer_stream *st)
+{
+    if (st->stopped)
+        return st->stopped;
+
+    st->state.cur_c = EOF;
+    return end_stream_line(st);
+}
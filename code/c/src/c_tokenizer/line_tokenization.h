@@ -3,13 +3,80 @@
 #define LINE_TOKENIZATION_SENTRY
 
 #include "word_list.h"
+#include "input_buffer.h"
+#include "token_line.h"
+#include "tokenizer_dfa.h"
 
 #include <stdio.h>
 
 enum tokenizer_option { tokenizer_opt_off = 0, tokenizer_opt_on = 1 };
 
+struct tokenizer;
+struct tokenizer_stream;
+
+/* status and eol_char as from tokenize_buffer_line_to_spans, the line
+ * is valid until the visitor returns, non-0 from it stops the
+ * tokenization */
+typedef int (*token_line_visitor)(const struct token_line *line,
+        int status, int eol_char, void *ctx);
+
+/* the options of the tokenize_ functions, shared by all of them and all
+ * the threads, see the tokenizer context below for its own ones */
 void set_tokenization_options(enum tokenizer_option use_spec_chars);
 int tokenize_input_line_to_word_list(FILE *f, 
         struct word_list **out_words, int *eol_char);
+/* the same, reading the line from the buffer (the end of the input is
+ * EOF), it is left at the start of the next line */
+int tokenize_buffer_line_to_word_list(struct input_buffer *in,
+        struct word_list **out_words, int *eol_char);
+/* the same, with the words taken from a, see word_list_create_in */
+int tokenize_buffer_line_to_word_list_in(struct linear_allocator *a,
+        struct input_buffer *in, struct word_list **out_words, int *eol_char);
+/* the same, into spans of the line in the buffer (see token_line.h), the
+ * line is cleared first, so one can be reused for all the lines */
+int tokenize_buffer_line_to_spans(struct input_buffer *in,
+        struct token_line *line, int *eol_char);
+
+/* A tokenizer context has its own options, and keeps the output storage
+ * from line to line, so once it has grown big enough for the lines a
+ * tokenizer allocates nothing. Contexts share no state, each thread can
+ * run its own one (on its own input). */
+struct tokenizer *tokenizer_create(enum tokenizer_option use_spec_chars);
+/* with the rules of the dialect instead of the options, returns NULL if
+ * it has too many quote chars, see tokenizer_dfa.h */
+struct tokenizer *tokenizer_create_dialect(const struct tokenizer_dialect *d);
+void tokenizer_set_options(struct tokenizer *tk,
+        enum tokenizer_option use_spec_chars);
+void tokenizer_free(struct tokenizer *tk);
+
+/* as tokenize_buffer_line_to_word_list and ..._to_spans, the output
+ * belongs to the context and is valid until its next call, the word
+ * list needs no word_list_free */
+int tokenizer_next_words(struct tokenizer *tk, struct input_buffer *in,
+        struct word_list **out_words, int *eol_char);
+int tokenizer_next_spans(struct tokenizer *tk, struct input_buffer *in,
+        const struct token_line **line, int *eol_char);
+
+/* A push tokenizer, for input coming in pieces (from a socket, a pipe):
+ * each piece is fed as it comes, of any size, cut anywhere, even inside
+ * quotes or right after a backslash, and the visitor is called on every
+ * line as soon as its end is fed. The words of a line from one piece
+ * point into it, the ones that were in several pieces are copied, so
+ * pieces need not outlive their feed call. */
+struct tokenizer_stream *tokenizer_stream_create(
+        enum tokenizer_option use_spec_chars,
+        token_line_visitor visit, void *ctx);
+struct tokenizer_stream *tokenizer_stream_create_dialect(
+        const struct tokenizer_dialect *d,
+        token_line_visitor visit, void *ctx);
+void tokenizer_stream_free(struct tokenizer_stream *st);
+
+/* both return 0, or what the visitor returned to stop, then the stream
+ * ignores all the input that follows */
+int tokenizer_stream_feed(struct tokenizer_stream *st, const char *data,
+        size_t len);
+/* the end of the input, that ends the last line as EOF does, the stream
+ * can then be fed a new input */
+int tokenizer_stream_finish(struct tokenizer_stream *st);
 
 #endif
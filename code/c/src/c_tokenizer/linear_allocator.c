@@ -0,0 +1,105 @@
+/* c_tokenizer/src/linear_allocator.c */
+#include "linear_allocator.h"
+
+#include <stdlib.h>
+
+/* the header of a malloc'd block, these are chained to be freed on reset,
+ * the union keeps the block after it aligned for anything */
+struct linear_allocator_block {
+    union {
+        struct {
+            struct linear_allocator_block *prev, *next;
+        } link;
+        long double align;
+    } u;
+};
+
+enum { block_align = sizeof(struct linear_allocator_block) };
+
+void linear_allocator_init(struct linear_allocator *a, size_t cap)
+{
+    if (cap == 0)
+        cap = linear_allocator_default_cap;
+
+    a->arena = malloc(cap);
+    a->head = a->arena;
+    a->cap = cap;
+    a->heap_blocks = NULL;
+}
+
+static void *heap_block_alloc(struct linear_allocator *a, size_t n)
+{
+    struct linear_allocator_block *b = malloc(sizeof(*b) + n);
+
+    b->u.link.prev = NULL;
+    b->u.link.next = a->heap_blocks;
+    if (a->heap_blocks)
+        a->heap_blocks->u.link.prev = b;
+    a->heap_blocks = b;
+
+    return b + 1;
+}
+
+static void heap_block_free(struct linear_allocator *a, void *p)
+{
+    struct linear_allocator_block *b = (struct linear_allocator_block *)p - 1;
+
+    if (b->u.link.prev)
+        b->u.link.prev->u.link.next = b->u.link.next;
+    else
+        a->heap_blocks = b->u.link.next;
+    if (b->u.link.next)
+        b->u.link.next->u.link.prev = b->u.link.prev;
+
+    free(b);
+}
+
+void *linear_allocator_alloc(struct linear_allocator *a, size_t n)
+{
+    void *p;
+
+    if (!a)
+        return malloc(n);
+
+    n = (n + block_align - 1) / block_align * block_align;
+    if (n > a->cap - (a->head - a->arena))
+        return heap_block_alloc(a, n);
+
+    p = a->head;
+    a->head += n;
+    return p;
+}
+
+static int in_arena(const struct linear_allocator *a, const void *p)
+{
+    return (const char *)p >= a->arena && (const char *)p < a->arena + a->cap;
+}
+
+void linear_allocator_free(struct linear_allocator *a, void *p)
+{
+    if (!a)
+        free(p);
+    else if (p && !in_arena(a, p))
+        heap_block_free(a, p);
+}
+
+void linear_allocator_reset(struct linear_allocator *a)
+{
+    struct linear_allocator_block *b, *next;
+
+    for (b = a->heap_blocks; b; b = next) {
+        next = b->u.link.next;
+        free(b);
+    }
+
+    a->heap_blocks = NULL;
+    a->head = a->arena;
+}
+
+void linear_allocator_destroy(struct linear_allocator *a)
+{
+    linear_allocator_reset(a);
+    free(a->arena);
+    a->arena = a->head = NULL;
+    a->cap = 0;
+}
@@ -0,0 +1,31 @@
+/* c_tokenizer/src/linear_allocator.h */
+#ifndef LINEAR_ALLOCATOR_SENTRY
+#define LINEAR_ALLOCATOR_SENTRY
+
+#include <stddef.h>
+
+/* The C take on LinearAllocator from cpp/allocators: the blocks are cut
+ * one after another from a fixed arena, freeing one does nothing, and
+ * reset frees them all at once. When the arena is full the blocks come
+ * from malloc, these are freed one by one, and by reset too.
+ *
+ * Everything taking an allocator treats NULL as plain malloc/free. */
+
+struct linear_allocator_block;
+
+struct linear_allocator {
+    char *arena, *head;
+    size_t cap;
+    struct linear_allocator_block *heap_blocks;
+};
+
+enum { linear_allocator_default_cap = 1 << 16 };
+
+/* cap 0 means linear_allocator_default_cap */
+void linear_allocator_init(struct linear_allocator *a, size_t cap);
+void *linear_allocator_alloc(struct linear_allocator *a, size_t n);
+void linear_allocator_free(struct linear_allocator *a, void *p);
+void linear_allocator_reset(struct linear_allocator *a);
+void linear_allocator_destroy(struct linear_allocator *a);
+
+#endif
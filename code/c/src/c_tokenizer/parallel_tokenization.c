@@ -0,0 +1,310 @@
+/* c_tokenizer/src/parallel_tokenization.c */
+#include "parallel_tokenization.h"
+#include "char_scan.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+    chunk_size = 4 << 20,
+    /* chunks tokenized ahead of the visitor, per thread */
+    chunks_in_flight = 2
+};
+
+struct chunk_line {
+    const char *source;
+    size_t first_span;
+    int cnt, status, eol_char;
+};
+
+/* the lines of a chunk, all their spans in one array and all the
+ * rewritten words in one arena */
+struct chunk {
+    size_t start, end;
+    int done;
+    struct chunk_line *lines;
+    size_t lines_cnt, lines_cap;
+    struct token_span *spans;
+    size_t spans_cnt, spans_cap;
+    char *arena;
+    size_t arena_len, arena_cap;
+};
+
+struct parallel_job {
+    const char *data;
+    enum tokenizer_option use_spec_chars;
+    struct chunk *chunks;
+    size_t chunks_cnt;
+    size_t next_chunk;  /* to be taken by a worker */
+    size_t visited;     /* chunks done with, the window starts there */
+    size_t window;
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t chunk_done, window_moved;
+};
+
+static const struct char_scan_set eol_chars = { 2, { '\n', '\r' } };
+
+/* API Impl and forward declarations */
+
+static void split_into_chunks(struct parallel_job *job, size_t len);
+static void *worker(void *arg);
+static size_t visit_chunk(const struct chunk *c, token_line_visitor visit,
+        void *ctx, int *stopped);
+static void free_chunk(struct chunk *c);
+
+static int cpu_count()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+}
+
+size_t tokenize_parallel(const char *data, size_t len,
+        enum tokenizer_option use_spec_chars, int threads,
+        token_line_visitor visit, void *ctx)
+{
+    struct parallel_job job;
+    pthread_t *workers;
+    size_t lines = 0, i;
+    int stopped = 0, t;
+
+    if (threads <= 0)
+        threads = cpu_count();
+
+    job.data = data;
+    job.use_spec_chars = use_spec_chars;
+    job.next_chunk = 0;
+    job.visited = 0;
+    job.window = (size_t)threads * chunks_in_flight;
+    job.stop = 0;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.chunk_done, NULL);
+    pthread_cond_init(&job.window_moved, NULL);
+    split_into_chunks(&job, len);
+
+    workers = malloc(sizeof(*workers) * threads);
+    for (t = 0; t < threads; t++)
+        pthread_create(&workers[t], NULL, worker, &job);
+
+    for (i = 0; i < job.chunks_cnt && !stopped; i++) {
+        pthread_mutex_lock(&job.lock);
+        while (!job.chunks[i].done)
+            pthread_cond_wait(&job.chunk_done, &job.lock);
+        pthread_mutex_unlock(&job.lock);
+
+        lines += visit_chunk(&job.chunks[i], visit, ctx, &stopped);
+        free_chunk(&job.chunks[i]);
+
+        pthread_mutex_lock(&job.lock);
+        job.visited = i + 1;
+        job.stop = stopped;
+        pthread_cond_broadcast(&job.window_moved);
+        pthread_mutex_unlock(&job.lock);
+    }
+
+    for (t = 0; t < threads; t++)
+        pthread_join(workers[t], NULL);
+
+    /* the ones done after a stop */
+    for (; i < job.chunks_cnt; i++)
+        free_chunk(&job.chunks[i]);
+
+    free(workers);
+    free(job.chunks);
+    pthread_cond_destroy(&job.window_moved);
+    pthread_cond_destroy(&job.chunk_done);
+    pthread_mutex_destroy(&job.lock);
+
+    return lines;
+}
+
+size_t tokenize_file_parallel(const char *path,
+        enum tokenizer_option use_spec_chars, int threads,
+        token_line_visitor visit, void *ctx)
+{
+    struct input_buffer *in;
+    size_t lines;
+
+    in = input_buffer_map_file(path);
+    if (!in)
+        return (size_t)-1;
+
+    lines = tokenize_parallel(in->data, in->len, use_spec_chars, threads,
+            visit, ctx);
+
+    input_buffer_free(in);
+    return lines;
+}
+
+/* Chunks */
+
+/* cuts right after the first end of line from about every chunk_size
+ * bytes, the last chunk runs to the end of the data */
+static void split_into_chunks(struct parallel_job *job, size_t len)
+{
+    size_t cap, start = 0, end;
+    struct chunk *c;
+
+    cap = len / chunk_size + 1;
+    job->chunks = malloc(sizeof(*job->chunks) * cap);
+    job->chunks_cnt = 0;
+
+    do {
+        end = len;
+        if (len - start > chunk_size) {
+            end = start + chunk_size;
+            end += char_scan_run(&eol_chars, job->data + end, len - end);
+            if (end < len)
+                end++;
+        }
+
+        c = &job->chunks[job->chunks_cnt++];
+        memset(c, 0, sizeof(*c));
+        c->start = start;
+        c->end = end;
+
+        start = end;
+    } while (start < len);
+}
+
+static void free_chunk(struct chunk *c)
+{
+    free(c->lines);
+    free(c->spans);
+    free(c->arena);
+    c->lines = NULL;
+    c->spans = NULL;
+    c->arena = NULL;
+}
+
+static void *grow(void *p, size_t *cap, size_t need, size_t elem_size)
+{
+    if (need <= *cap)
+        return p;
+
+    if (!*cap)
+        *cap = 16;
+    while (*cap < need)
+        *cap *= 2;
+    return realloc(p, *cap * elem_size);
+}
+
+/* the spans are moved into the chunk as they are, the rewritten ones get
+ * the offset of the line arena in the chunk arena */
+static void add_line(struct chunk *c, const struct token_line *line,
+        int status, int eol_char)
+{
+    struct chunk_line *cl;
+    struct token_span *sp;
+    int i;
+
+    c->lines = grow(c->lines, &c->lines_cap, c->lines_cnt + 1,
+            sizeof(*c->lines));
+    c->spans = grow(c->spans, &c->spans_cap, c->spans_cnt + line->cnt,
+            sizeof(*c->spans));
+    c->arena = grow(c->arena, &c->arena_cap, c->arena_len + line->arena_len,
+            1);
+
+    cl = &c->lines[c->lines_cnt++];
+    cl->source = line->source;
+    cl->first_span = c->spans_cnt;
+    cl->cnt = line->cnt;
+    cl->status = status;
+    cl->eol_char = eol_char;
+
+    for (i = 0; i < line->cnt; i++) {
+        sp = &c->spans[c->spans_cnt++];
+        *sp = line->spans[i];
+        if (sp->rewritten)
+            sp->offset += c->arena_len;
+    }
+
+    if (line->arena_len > 0)
+        memcpy(c->arena + c->arena_len, line->arena, line->arena_len);
+    c->arena_len += line->arena_len;
+}
+
+/* every chunk but the last ends with an end of line, so its lines are
+ * done at its end, the last one ends with EOF as any input does */
+static void tokenize_chunk(struct tokenizer *tk, struct chunk *c,
+        const char *data, int is_last)
+{
+    const struct token_line *line;
+    struct input_buffer *in;
+    int status, eol_char = 0;
+
+    in = input_buffer_create_memory(data + c->start, c->end - c->start);
+
+    while (is_last ? eol_char != EOF : in->pos < in->len) {
+        status = tokenizer_next_spans(tk, in, &line, &eol_char);
+        add_line(c, line, status, eol_char);
+    }
+
+    input_buffer_free(in);
+}
+
+static void *worker(void *arg)
+{
+    struct parallel_job *job = arg;
+    struct tokenizer *tk;
+    size_t i;
+
+    tk = tokenizer_create(job->use_spec_chars);
+
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        while (!job->stop && job->next_chunk < job->chunks_cnt &&
+                job->next_chunk >= job->visited + job->window)
+        {
+            pthread_cond_wait(&job->window_moved, &job->lock);
+        }
+        if (job->stop || job->next_chunk >= job->chunks_cnt) {
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        i = job->next_chunk++;
+        pthread_mutex_unlock(&job->lock);
+
+        tokenize_chunk(tk, &job->chunks[i], job->data,
+                i == job->chunks_cnt - 1);
+
+        pthread_mutex_lock(&job->lock);
+        job->chunks[i].done = 1;
+        pthread_cond_broadcast(&job->chunk_done);
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    tokenizer_free(tk);
+    return NULL;
+}
+
+/* Visiting */
+
+static size_t visit_chunk(const struct chunk *c, token_line_visitor visit,
+        void *ctx, int *stopped)
+{
+    const struct chunk_line *cl;
+    struct token_line line;
+    size_t i;
+
+    for (i = 0; i < c->lines_cnt; i++) {
+        cl = &c->lines[i];
+
+        line.source = cl->source;
+        line.spans = c->spans + cl->first_span;
+        line.cnt = cl->cnt;
+        line.cap = cl->cnt;
+        line.arena = c->arena;
+        line.arena_len = c->arena_len;
+        line.arena_cap = c->arena_cap;
+
+        if (visit(&line, cl->status, cl->eol_char, ctx) != 0) {
+            *stopped = 1;
+            return i + 1;
+        }
+    }
+
+    return c->lines_cnt;
+}
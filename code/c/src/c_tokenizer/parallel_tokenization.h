@@ -0,0 +1,30 @@
+/* c_tokenizer/src/parallel_tokenization.h */
+#ifndef PARALLEL_TOKENIZATION_SENTRY
+#define PARALLEL_TOKENIZATION_SENTRY
+
+#include "line_tokenization.h"
+
+#include <stddef.h>
+
+/* Tokenizing a big input on several threads: it is cut into chunks of
+ * whole lines, the chunks are tokenized into spans by a pool of worker
+ * threads, and the lines are handed to the visitor on the calling thread
+ * in the input order.
+ *
+ * A chunk can start right after any '\n' or '\r': these always end the
+ * line, even in quotes (the line is then an error, as for the other
+ * tokenize_ functions), so no quote or escape state is ever carried from
+ * one line to the next, and every chunk can be tokenized on its own.
+ * Only a few chunks per thread are kept in memory at once. */
+
+/* threads 0 means one per cpu, returns the number of lines visited */
+size_t tokenize_parallel(const char *data, size_t len,
+        enum tokenizer_option use_spec_chars, int threads,
+        token_line_visitor visit, void *ctx);
+/* the same for a file, mapped into memory, returns (size_t)-1 if it can
+ * not be */
+size_t tokenize_file_parallel(const char *path,
+        enum tokenizer_option use_spec_chars, int threads,
+        token_line_visitor visit, void *ctx);
+
+#endif
@@ -0,0 +1,406 @@
+/* c_tokenizer/tests/bench.c */
+#include "../parallel_tokenization.h"
+#include "../token_dict.h"
+#include "../../c_rbtree/tests/perf_counter.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* This program tokenizes the same file through every input path and
+ * prints the throughput of each in MB/s. All the paths must give the
+ * same words, so the word and char counts are checked against the getc
+ * path. The arena path takes the words from a linear_allocator, reset
+ * after each line, the /sp paths make spans (token_line.h) instead of
+ * word lists, par/sp on a thread per cpu. The push path feeds the file
+ * to a tokenizer_stream in 64K pieces, the intern path makes the spans
+ * into ids with a token_dict, and counts the chars from it (nearly every
+ * word of the made up file is new, the worst case for it). Without a
+ * file argument it makes up a file of random lines with some quoted and
+ * escaped words in them, and then a second one of the same size whose
+ * words are taken from a few thousand, each seen many times, for the
+ * intern path again (reintern), the usual case of real text.
+ * Where the cpu counters can be read (perf_event_open, not in most vms)
+ * the branch misses per KB of input are printed too, the tokenizer
+ * should have about none outside of the word runs since it went table
+ * driven (tokenizer_dfa.h), otherwise they show as "-".
+ *
+ * Build (optimized, or the numbers are meaningless):
+ *   gcc -O2 bench.c ../word.c ../word_list.c ../linear_allocator.c \
+ *       ../input_buffer.c ../char_scan.c ../token_line.c \
+ *       ../tokenizer_dfa.c ../line_tokenization.c \
+ *       ../parallel_tokenization.c ../token_dict.c -lpthread -o bench.out
+ *
+ * Usage: ./bench.out [file], or ./bench.out -m <MB> to set the size of
+ * the made up file (64 by default). */
+
+enum {
+    default_size_mb = 64,
+    max_words_per_line = 12,
+    max_word_size = 16,
+    /* distinct words of the file for the repeated intern case */
+    vocab_size = 4096,
+    stream_piece_size = 64 << 10
+};
+
+struct totals {
+    long lines, words, chars, errors;
+};
+
+/* a word as written in the input, '\0'-terminated */
+static void rand_word(char *w)
+{
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz0123456789_.,";
+    int len = 1 + rand() % 10, i, kind = rand() % 16;
+
+    if (kind == 0)
+        *w++ = '"';
+    for (i = 0; i < len; i++) {
+        if (kind == 0 && i == len / 2)
+            *w++ = ' ';
+        else if (kind == 1 && i == len / 2) {
+            *w++ = '\\';
+            *w++ = '"';
+        } else
+            *w++ = letters[rand() % (sizeof(letters) - 1)];
+    }
+    if (kind == 0)
+        *w++ = '"';
+    *w = '\0';
+}
+
+/* every word made up anew, or with vocab_cnt not 0, taken from that
+ * many made up first */
+static void make_file(const char *path, long size, int vocab_cnt)
+{
+    FILE *f = fopen(path, "w");
+    char (*vocab)[max_word_size] = NULL, w[max_word_size];
+    int i, cnt;
+
+    srand(1);
+    if (vocab_cnt) {
+        vocab = malloc(vocab_cnt * sizeof(*vocab));
+        for (i = 0; i < vocab_cnt; i++)
+            rand_word(vocab[i]);
+    }
+
+    while (ftell(f) < size) {
+        cnt = rand() % (max_words_per_line + 1);
+        for (i = 0; i < cnt; i++) {
+            if (i > 0)
+                putc(rand() % 4 ? ' ' : '\t', f);
+            if (vocab)
+                fputs(vocab[rand() % vocab_cnt], f);
+            else {
+                rand_word(w);
+                fputs(w, f);
+            }
+        }
+        putc('\n', f);
+    }
+
+    free(vocab);
+    fclose(f);
+}
+
+static void count_words(struct word_list *words, struct totals *t)
+{
+    struct word *w;
+
+    while ((w = word_list_pop_first(words)) != NULL) {
+        t->words++;
+        t->chars += word_length(w);
+        word_free(w);
+    }
+    word_list_free(words);
+}
+
+/* no frees, the reset of the allocator drops them all */
+static void count_arena_words(struct word_list *words, struct totals *t)
+{
+    struct word *w;
+
+    while ((w = word_list_pop_first(words)) != NULL) {
+        t->words++;
+        t->chars += word_length(w);
+    }
+}
+
+static void run_getc(const char *path, struct totals *t)
+{
+    struct word_list *words;
+    FILE *f = fopen(path, "r");
+    int eol_char = 0;
+
+    while (eol_char != EOF) {
+        if (tokenize_input_line_to_word_list(f, &words, &eol_char) != 0) {
+            t->errors++;
+            continue;
+        }
+        t->lines++;
+        count_words(words, t);
+    }
+    fclose(f);
+}
+
+static void run_buffer(struct input_buffer *in, struct totals *t)
+{
+    struct word_list *words;
+    int eol_char = 0;
+
+    while (eol_char != EOF) {
+        if (tokenize_buffer_line_to_word_list(in, &words, &eol_char) != 0) {
+            t->errors++;
+            continue;
+        }
+        t->lines++;
+        count_words(words, t);
+    }
+}
+
+static void run_arena(const char *path, struct totals *t)
+{
+    struct input_buffer *in = input_buffer_map_file(path);
+    struct linear_allocator a;
+    struct word_list *words;
+    int eol_char = 0;
+
+    linear_allocator_init(&a, 0);
+    while (eol_char != EOF) {
+        if (tokenize_buffer_line_to_word_list_in(&a, in, &words, &eol_char))
+            t->errors++;
+        else {
+            t->lines++;
+            count_arena_words(words, t);
+        }
+        linear_allocator_reset(&a);
+    }
+    linear_allocator_destroy(&a);
+    input_buffer_free(in);
+}
+
+static void run_read(const char *path, struct totals *t)
+{
+    int fd = open(path, O_RDONLY);
+    struct input_buffer *in = input_buffer_create_fd(fd, 0);
+
+    run_buffer(in, t);
+    input_buffer_free(in);
+    close(fd);
+}
+
+static void run_mmap(const char *path, struct totals *t)
+{
+    struct input_buffer *in = input_buffer_map_file(path);
+
+    run_buffer(in, t);
+    input_buffer_free(in);
+}
+
+static void run_spans(struct input_buffer *in, struct totals *t)
+{
+    struct token_line line;
+    int eol_char = 0, i;
+
+    token_line_init(&line);
+    while (eol_char != EOF) {
+        if (tokenize_buffer_line_to_spans(in, &line, &eol_char) != 0) {
+            t->errors++;
+            continue;
+        }
+        t->lines++;
+        t->words += line.cnt;
+        for (i = 0; i < line.cnt; i++)
+            t->chars += line.spans[i].len;
+    }
+    token_line_free(&line);
+}
+
+static void run_read_spans(const char *path, struct totals *t)
+{
+    int fd = open(path, O_RDONLY);
+    struct input_buffer *in = input_buffer_create_fd(fd, 0);
+
+    run_spans(in, t);
+    input_buffer_free(in);
+    close(fd);
+}
+
+static void run_mmap_spans(const char *path, struct totals *t)
+{
+    struct input_buffer *in = input_buffer_map_file(path);
+
+    run_spans(in, t);
+    input_buffer_free(in);
+}
+
+static void run_intern(const char *path, struct totals *t)
+{
+    struct input_buffer *in = input_buffer_map_file(path);
+    struct token_line line;
+    struct token_id_line ids;
+    struct token_dict d;
+    int eol_char = 0, i;
+
+    token_line_init(&line);
+    token_id_line_init(&ids);
+    token_dict_init(&d);
+    while (eol_char != EOF) {
+        if (tokenize_buffer_line_to_spans(in, &line, &eol_char) != 0) {
+            t->errors++;
+            continue;
+        }
+        token_dict_intern_line(&d, &line, &ids);
+        t->lines++;
+        t->words += ids.cnt;
+        for (i = 0; i < ids.cnt; i++)
+            t->chars += token_dict_word_length(&d, ids.ids[i]);
+    }
+    token_dict_free(&d);
+    token_id_line_free(&ids);
+    token_line_free(&line);
+    input_buffer_free(in);
+}
+
+static int count_line(const struct token_line *line, int status,
+        int eol_char, void *ctx)
+{
+    struct totals *t = ctx;
+    int i;
+
+    (void)eol_char;
+
+    if (status != 0) {
+        t->errors++;
+        return 0;
+    }
+
+    t->lines++;
+    t->words += line->cnt;
+    for (i = 0; i < line->cnt; i++)
+        t->chars += line->spans[i].len;
+    return 0;
+}
+
+static void run_parallel(const char *path, struct totals *t)
+{
+    tokenize_file_parallel(path, tokenizer_opt_on, 0, count_line, t);
+}
+
+static void run_stream(const char *path, struct totals *t)
+{
+    struct tokenizer_stream *st;
+    static char piece[stream_piece_size];
+    int fd = open(path, O_RDONLY);
+    ssize_t n;
+
+    st = tokenizer_stream_create(tokenizer_opt_on, count_line, t);
+    while ((n = read(fd, piece, sizeof(piece))) > 0)
+        tokenizer_stream_feed(st, piece, n);
+    tokenizer_stream_finish(st);
+
+    tokenizer_stream_free(st);
+    close(fd);
+}
+
+static int branch_misses_fd = -1;
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int bench(const char *name, void (*run)(const char *, struct totals *),
+        const char *path, double mb, const struct totals *expected)
+{
+    struct totals t = { 0, 0, 0, 0 };
+    double start, sec;
+    long long misses;
+
+    perf_counter_start(branch_misses_fd);
+    start = now_sec();
+    run(path, &t);
+    sec = now_sec() - start;
+    misses = perf_counter_stop(branch_misses_fd);
+
+    printf("%-8s %9.1f MB/s %10ld lines %11ld words",
+            name, mb / sec, t.lines, t.words);
+    if (misses >= 0)
+        printf(" %9.2f br-miss/KB\n", misses / (mb * 1024));
+    else
+        printf("         - br-miss/KB\n");
+
+    if (expected && memcmp(&t, expected, sizeof(t)) != 0) {
+        printf("%s: the words differ from the getc ones\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    char tmp_path[] = "/tmp/tokenizer_benchXXXXXX";
+    char vocab_path[] = "/tmp/tokenizer_benchXXXXXX";
+    const char *path = NULL;
+    long size = default_size_mb * (1L << 20);
+    struct totals expected = { 0, 0, 0, 0 }, vocab_expected = { 0, 0, 0, 0 };
+    double mb;
+    FILE *f;
+    int ok = 1, fd;
+
+    if (argc == 3 && strcmp(argv[1], "-m") == 0)
+        size = atol(argv[2]) * (1L << 20);
+    else if (argc == 2)
+        path = argv[1];
+
+    if (!path) {
+        fd = mkstemp(tmp_path);
+        close(fd);
+        make_file(tmp_path, size, 0);
+        path = tmp_path;
+
+        fd = mkstemp(vocab_path);
+        close(fd);
+        make_file(vocab_path, size, vocab_size);
+        run_getc(vocab_path, &vocab_expected);
+    }
+
+    f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    mb = ftell(f) / (double)(1 << 20);
+    fclose(f);
+
+    /* once to warm the page cache, and to get the counts to check */
+    run_getc(path, &expected);
+    branch_misses_fd = perf_counter_open(PERF_COUNT_HW_BRANCH_MISSES);
+
+    ok = bench("getc", run_getc, path, mb, &expected) && ok;
+    ok = bench("read", run_read, path, mb, &expected) && ok;
+    ok = bench("mmap", run_mmap, path, mb, &expected) && ok;
+    ok = bench("arena", run_arena, path, mb, &expected) && ok;
+    ok = bench("read/sp", run_read_spans, path, mb, &expected) && ok;
+    ok = bench("mmap/sp", run_mmap_spans, path, mb, &expected) && ok;
+    ok = bench("par/sp", run_parallel, path, mb, &expected) && ok;
+    ok = bench("push", run_stream, path, mb, &expected) && ok;
+    ok = bench("intern", run_intern, path, mb, &expected) && ok;
+    if (path == tmp_path)
+        ok = bench("reintern", run_intern, vocab_path, mb, &vocab_expected) &&
+            ok;
+
+    if (branch_misses_fd >= 0)
+        close(branch_misses_fd);
+    if (path == tmp_path) {
+        unlink(tmp_path);
+        unlink(vocab_path);
+    }
+
+    return ok ? 0 : 1;
+}
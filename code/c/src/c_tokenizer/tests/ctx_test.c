@@ -0,0 +1,193 @@
+/* c_tokenizer/tests/ctx_test.c */
+#include "../line_tokenization.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This program runs tokenizer contexts on several threads at once, half
+ * of them with the special chars on and half with them off, each on its
+ * own buffer over the same made up input, meant to be built with
+ * -fsanitize=thread: contexts share no state, so it must report nothing.
+ *
+ * Each thread goes over the input a few times, by words and by spans in
+ * turn, and digests every line (its status, end char and words), and the
+ * digests must be those of the getc tokenizer on the same input, run
+ * before the threads with the shared options set the same way.
+ *
+ * Build:
+ *   gcc -O1 -g -fsanitize=thread ctx_test.c ../word.c ../word_list.c \
+ *       ../linear_allocator.c ../input_buffer.c ../char_scan.c \
+ *       ../token_line.c ../tokenizer_dfa.c ../line_tokenization.c \
+ *       -lpthread -o ctx_test.out
+ *
+ * Usage: ./ctx_test.out [threads] [seed], returns 0 if every thread got
+ * the words of the getc tokenizer, 1 else. */
+
+enum {
+    input_size = 200000,
+    max_threads = 16,
+    passes = 6
+};
+
+struct thread_arg {
+    enum tokenizer_option opt;
+    int ok;
+};
+
+static char input[input_size];
+/* by the option */
+static unsigned long ref_digests[2];
+static long ref_lines[2];
+
+static unsigned long digest_word(unsigned long h, const char *s, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        h = h * 1000003 ^ (unsigned char)s[i];
+    return h * 31 + n;
+}
+
+static unsigned long digest_line_end(unsigned long h, int status,
+        int eol_char)
+{
+    return h * 7 + status * 3 + eol_char;
+}
+
+static void make_input(unsigned seed)
+{
+    static const char chars[] = "abcdefgh  \t\"\\\n\r";
+    size_t i;
+
+    srand(seed);
+    for (i = 0; i < input_size; i++)
+        input[i] = chars[rand() % (sizeof(chars) - 1)];
+}
+
+/* Reference */
+
+static void run_getc(enum tokenizer_option opt)
+{
+    FILE *f = fmemopen(input, input_size, "r");
+    struct word_list *words;
+    struct word *w;
+    unsigned long h = 0;
+    int eol_char = 0, status;
+    long lines = 0;
+
+    set_tokenization_options(opt);
+    while (eol_char != EOF) {
+        status = tokenize_input_line_to_word_list(f, &words, &eol_char);
+        if (status == 0) {
+            while ((w = word_list_pop_first(words))) {
+                h = digest_word(h, word_content(w), word_length(w));
+                word_free(w);
+            }
+            word_list_free(words);
+        }
+        h = digest_line_end(h, status, status ? 0 : eol_char);
+        lines++;
+    }
+
+    fclose(f);
+    ref_digests[opt] = h;
+    ref_lines[opt] = lines;
+}
+
+/* Threads */
+
+static unsigned long words_pass(struct tokenizer *tk, long *lines)
+{
+    struct input_buffer *in = input_buffer_create_memory(input, input_size);
+    struct word_list *words;
+    struct word *w;
+    unsigned long h = 0;
+    int eol_char = 0, status;
+
+    for (*lines = 0; eol_char != EOF; ++*lines) {
+        status = tokenizer_next_words(tk, in, &words, &eol_char);
+        if (status == 0) {
+            while ((w = word_list_pop_first(words)))
+                h = digest_word(h, word_content(w), word_length(w));
+        }
+        h = digest_line_end(h, status, status ? 0 : eol_char);
+    }
+
+    input_buffer_free(in);
+    return h;
+}
+
+static unsigned long spans_pass(struct tokenizer *tk, long *lines)
+{
+    struct input_buffer *in = input_buffer_create_memory(input, input_size);
+    const struct token_line *line;
+    unsigned long h = 0;
+    int eol_char = 0, status, i;
+
+    for (*lines = 0; eol_char != EOF; ++*lines) {
+        status = tokenizer_next_spans(tk, in, &line, &eol_char);
+        if (status == 0) {
+            for (i = 0; i < line->cnt; i++) {
+                h = digest_word(h, token_line_text(line, i),
+                        line->spans[i].len);
+            }
+        }
+        h = digest_line_end(h, status, status ? 0 : eol_char);
+    }
+
+    input_buffer_free(in);
+    return h;
+}
+
+static void *tokenize_all(void *arg)
+{
+    struct thread_arg *a = arg;
+    struct tokenizer *tk = tokenizer_create(a->opt);
+    unsigned long h;
+    long lines;
+    int pass;
+
+    a->ok = 1;
+    for (pass = 0; pass < passes; pass++) {
+        h = pass % 2 ? spans_pass(tk, &lines) : words_pass(tk, &lines);
+        if (h != ref_digests[a->opt] || lines != ref_lines[a->opt])
+            a->ok = 0;
+    }
+
+    tokenizer_free(tk);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct thread_arg args[max_threads];
+    pthread_t threads[max_threads];
+    int thread_cnt = 8, ok = 1, i;
+
+    if (argc > 1)
+        thread_cnt = atoi(argv[1]);
+    if (thread_cnt < 1 || thread_cnt > max_threads)
+        thread_cnt = 8;
+
+    make_input(argc > 2 ? strtoul(argv[2], NULL, 10) : 1);
+    run_getc(tokenizer_opt_off);
+    run_getc(tokenizer_opt_on);
+
+    for (i = 0; i < thread_cnt; i++) {
+        args[i].opt = i % 2 ? tokenizer_opt_on : tokenizer_opt_off;
+        pthread_create(&threads[i], NULL, tokenize_all, &args[i]);
+    }
+    for (i = 0; i < thread_cnt; i++) {
+        pthread_join(threads[i], NULL);
+        if (!args[i].ok) {
+            printf("failed: thread %d (options %s)\n", i,
+                    args[i].opt ? "on" : "off");
+            ok = 0;
+        }
+    }
+
+    if (ok)
+        printf("ok, %ld and %ld lines\n", ref_lines[0], ref_lines[1]);
+    return !ok;
+}
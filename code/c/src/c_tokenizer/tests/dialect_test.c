@@ -0,0 +1,437 @@
+/* c_tokenizer/tests/dialect_test.c */
+#include "../line_tokenization.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This program checks the table driven tokenizer (tokenizer_dfa.h)
+ * against two references written char by char, on random inputs, by
+ * words and by spans.
+ *
+ * The options on and off, and the default and plain dialects they stand
+ * for, must give the lines of the state machine the tokenizer had before
+ * it went table driven, kept here as it was (old_ below).
+ *
+ * Random custom dialects, with up to two quote chars, several escapes and
+ * delimiters, and chars in more than one set, must give the lines of a
+ * plain reading of the rules in tokenizer_dfa.h (rules_ below). A dialect
+ * with too many quote chars must be refused.
+ *
+ * Build:
+ *   gcc -O2 dialect_test.c ../word.c ../word_list.c \
+ *       ../linear_allocator.c ../input_buffer.c ../char_scan.c \
+ *       ../token_line.c ../tokenizer_dfa.c ../line_tokenization.c \
+ *       -lpthread -o dialect_test.out
+ *
+ * Usage: ./dialect_test.out [inputs] [seed], returns 0 if all the lines
+ * matched, 1 else. */
+
+enum {
+    max_input_len = 300,
+    /* lines written as text, see add_word */
+    max_out_len = 16 * max_input_len,
+    inputs_per_dialect = 4
+};
+
+/* the chars of the inputs, and of the sets of the custom dialects */
+static const char input_chars[] = "abcxy ,;\t\"'\\^\n\r";
+static const char set_chars[] = " ,;\t\"'\\^a";
+
+/* The lines as text: a word is its length and bytes, a line ends with
+ * its end char, or is just "error". */
+
+struct out {
+    char text[max_out_len];
+    size_t len;
+};
+
+static void add_text(struct out *o, const char *s, size_t n)
+{
+    memcpy(o->text + o->len, s, n);
+    o->len += n;
+}
+
+static void add_word(struct out *o, const char *s, size_t n)
+{
+    char len_text[16];
+
+    add_text(o, len_text, sprintf(len_text, "%d:", (int)n));
+    add_text(o, s, n);
+}
+
+/* the end char of a line in error is not set by the tokenizer */
+static void add_line_end(struct out *o, int status, int eol_char)
+{
+    char end_text[16];
+
+    if (status)
+        add_text(o, "error;", 6);
+    else
+        add_text(o, end_text, sprintf(end_text, "<%d>;", eol_char));
+}
+
+/* Old state machine */
+
+enum old_mode { old_regular, old_in_quotes };
+
+struct old_state {
+    int cur_c;
+    enum old_mode mode;
+    int in_word, ignore_spec, use_spec_chars;
+};
+
+static int old_cur_char_is_special(const struct old_state *state)
+{
+    return state->use_spec_chars && !state->ignore_spec &&
+        (state->cur_c == '"' || state->cur_c == '\\');
+}
+
+static int old_cur_char_is_in_word(const struct old_state *state)
+{
+    return state->mode == old_in_quotes ||
+        (state->cur_c != ' ' && state->cur_c != '\t');
+}
+
+/* starts a word: 1, goes to it: 2 */
+static int old_traverse_char(struct old_state *state)
+{
+    int actions = 0;
+
+    if (old_cur_char_is_special(state)) {
+        if (state->cur_c == '\\') {
+            state->ignore_spec = 1;
+            return 0;
+        }
+
+        state->mode = state->mode == old_regular ? old_in_quotes :
+            old_regular;
+        if (!state->in_word && state->mode == old_in_quotes) {
+            state->in_word = 1;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!state->in_word && old_cur_char_is_in_word(state))
+        actions = 1;
+
+    state->in_word = old_cur_char_is_in_word(state);
+    if (state->in_word)
+        actions |= 2;
+
+    state->ignore_spec = 0;
+    return actions;
+}
+
+/* the line at *pos, the words into a scratch out, as the getc
+ * tokenizer reads it (a '\0' never got into a word string) */
+static int old_line(const char *data, size_t len, size_t *pos,
+        int use_spec_chars, struct out *words, int *eol_char)
+{
+    struct old_state state;
+    char word[max_input_len];
+    size_t word_len = 0;
+    int actions, in_any = 0;
+
+    state.mode = old_regular;
+    state.in_word = state.ignore_spec = 0;
+    state.use_spec_chars = use_spec_chars;
+
+    for (;;) {
+        state.cur_c = *pos < len ? (unsigned char)data[(*pos)++] : EOF;
+        if (state.cur_c == '\n' || state.cur_c == '\r' || state.cur_c == EOF)
+            break;
+
+        actions = old_traverse_char(&state);
+        if (actions & 1) {
+            if (in_any)
+                add_word(words, word, word_len);
+            word_len = 0;
+            in_any = 1;
+        }
+        if ((actions & 2) && state.cur_c != '\0')
+            word[word_len++] = state.cur_c;
+    }
+
+    if (in_any)
+        add_word(words, word, word_len);
+
+    if (state.mode != old_regular || state.ignore_spec)
+        return 1;
+
+    *eol_char = state.cur_c;
+    return 0;
+}
+
+/* Rules of tokenizer_dfa.h */
+
+static int in_set(const char *set, int c)
+{
+    return c != '\0' && strchr(set, c) != NULL;
+}
+
+static int rules_line(const char *data, size_t len, size_t *pos,
+        const struct tokenizer_dialect *d, struct out *words, int *eol_char)
+{
+    char word[max_input_len];
+    size_t word_len = 0;
+    int c, quote = 0, escaped = 0, in_word = 0, in_any = 0;
+
+    for (;;) {
+        c = *pos < len ? (unsigned char)data[(*pos)++] : EOF;
+        if (c == '\n' || c == '\r' || c == EOF)
+            break;
+
+        if (!escaped && in_set(d->escapes, c)) {
+            escaped = 1;
+            continue;
+        }
+
+        if (!escaped && in_set(d->quotes, c) && (!quote || c == quote)) {
+            quote = quote ? 0 : c;
+        } else if (!quote && in_set(d->delimiters, c)) {
+            in_word = 0;
+            escaped = 0;
+            continue;
+        } else if (c != '\0' && in_word) {
+            word[word_len++] = c;
+            escaped = 0;
+            continue;
+        }
+
+        /* an opening quote or a plain char */
+        if (!in_word) {
+            if (in_any)
+                add_word(words, word, word_len);
+            word_len = 0;
+            in_any = in_word = 1;
+            if (c != '\0' && c != quote)
+                word[word_len++] = c;
+        }
+        escaped = 0;
+    }
+
+    if (in_any)
+        add_word(words, word, word_len);
+
+    if (quote || escaped)
+        return 1;
+
+    *eol_char = c;
+    return 0;
+}
+
+/* Whole inputs */
+
+/* a NULL dialect is the old state machine with the options use_spec */
+static void reference(const char *data, size_t len,
+        const struct tokenizer_dialect *d, int use_spec, struct out *o)
+{
+    struct out words;
+    size_t pos = 0;
+    int eol_char = 0, status;
+
+    o->len = 0;
+    while (eol_char != EOF) {
+        words.len = 0;
+        status = d ? rules_line(data, len, &pos, d, &words, &eol_char) :
+            old_line(data, len, &pos, use_spec, &words, &eol_char);
+        if (status == 0)
+            add_text(o, words.text, words.len);
+        add_line_end(o, status, eol_char);
+    }
+}
+
+static void by_words(struct tokenizer *tk, const char *data, size_t len,
+        struct out *o)
+{
+    struct input_buffer *in = input_buffer_create_memory(data, len);
+    struct word_list *words;
+    struct word *w;
+    int eol_char = 0, status;
+
+    o->len = 0;
+    while (eol_char != EOF) {
+        status = tokenizer_next_words(tk, in, &words, &eol_char);
+        if (status == 0) {
+            while ((w = word_list_pop_first(words)))
+                add_word(o, word_content(w), word_length(w));
+        }
+        add_line_end(o, status, eol_char);
+    }
+
+    input_buffer_free(in);
+}
+
+static void by_spans(struct tokenizer *tk, const char *data, size_t len,
+        struct out *o)
+{
+    struct input_buffer *in = input_buffer_create_memory(data, len);
+    const struct token_line *line;
+    int eol_char = 0, status, i;
+
+    o->len = 0;
+    while (eol_char != EOF) {
+        status = tokenizer_next_spans(tk, in, &line, &eol_char);
+        if (status == 0) {
+            for (i = 0; i < line->cnt; i++)
+                add_word(o, token_line_text(line, i), line->spans[i].len);
+        }
+        add_line_end(o, status, eol_char);
+    }
+
+    input_buffer_free(in);
+}
+
+static int same(const struct out *a, const struct out *b)
+{
+    return a->len == b->len && memcmp(a->text, b->text, a->len) == 0;
+}
+
+/* both ways, with the tokenizer */
+static int check_tokenizer(struct tokenizer *tk, const char *data,
+        size_t len, const struct out *ref)
+{
+    static struct out got;
+
+    by_words(tk, data, len, &got);
+    if (!same(&got, ref))
+        return 0;
+
+    by_spans(tk, data, len, &got);
+    return same(&got, ref);
+}
+
+/* Random inputs and dialects */
+
+static void make_input(char *data, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (rand() % 64 == 0)
+            data[i] = '\0';
+        else
+            data[i] = input_chars[rand() % (sizeof(input_chars) - 1)];
+    }
+}
+
+/* up to max distinct chars of set_chars */
+static void make_set(char *set, int max)
+{
+    int cnt = rand() % (max + 1), n = 0, c;
+
+    while (n < cnt) {
+        c = set_chars[rand() % (sizeof(set_chars) - 1)];
+        if (!strchr(set, c)) {
+            set[n++] = c;
+            set[n] = '\0';
+        }
+    }
+}
+
+static void make_dialect(struct tokenizer_dialect *d, char *sets)
+{
+    memset(sets, 0, 3 * 8);
+    make_set(sets, 4);
+    make_set(sets + 8, tokenizer_dialect_max_quotes);
+    make_set(sets + 16, 2);
+    d->delimiters = sets;
+    d->quotes = sets + 8;
+    d->escapes = sets + 16;
+}
+
+/* by the options, and by the dialects they stand for */
+static struct tokenizer *by_opt[2], *by_dialect[2];
+
+static int check_builtin(const char *data, size_t len)
+{
+    static struct out ref;
+    int use_spec;
+
+    for (use_spec = 0; use_spec <= 1; use_spec++) {
+        reference(data, len, NULL, use_spec, &ref);
+        if (!check_tokenizer(by_opt[use_spec], data, len, &ref) ||
+                !check_tokenizer(by_dialect[use_spec], data, len, &ref))
+            return 0;
+    }
+
+    return 1;
+}
+
+static int check_custom(struct tokenizer *tk,
+        const struct tokenizer_dialect *d, const char *data, size_t len)
+{
+    static struct out ref;
+
+    reference(data, len, d, 0, &ref);
+    if (check_tokenizer(tk, data, len, &ref))
+        return 1;
+
+    printf("dialect: delimiters \"%s\", quotes \"%s\", escapes \"%s\"\n",
+            d->delimiters, d->quotes, d->escapes);
+    return 0;
+}
+
+static int check_refused(void)
+{
+    static const struct tokenizer_dialect too_many = { " ", "\"'`", "" };
+
+    return !tokenizer_create_dialect(&too_many) &&
+        !tokenizer_stream_create_dialect(&too_many, NULL, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    struct tokenizer_dialect d;
+    struct tokenizer *custom = NULL;
+    char data[max_input_len], sets[3 * 8];
+    long inputs = 100000, it;
+    int ok = 1;
+    size_t len;
+
+    if (argc > 1)
+        inputs = atol(argv[1]);
+    srand(argc > 2 ? strtoul(argv[2], NULL, 10) : 1);
+
+    if (!check_refused()) {
+        printf("failed: a dialect with too many quotes was taken\n");
+        return 1;
+    }
+
+    by_opt[0] = tokenizer_create(tokenizer_opt_off);
+    by_opt[1] = tokenizer_create(tokenizer_opt_on);
+    by_dialect[0] = tokenizer_create_dialect(&tokenizer_plain_dialect);
+    by_dialect[1] = tokenizer_create_dialect(&tokenizer_default_dialect);
+
+    for (it = 0; it < inputs && ok; it++) {
+        if (it % inputs_per_dialect == 0) {
+            if (custom)
+                tokenizer_free(custom);
+            make_dialect(&d, sets);
+            custom = tokenizer_create_dialect(&d);
+        }
+
+        len = rand() % (max_input_len + 1);
+        make_input(data, len);
+
+        if (!check_builtin(data, len)) {
+            printf("failed: input %ld, built-in options\n", it);
+            ok = 0;
+        } else if (!check_custom(custom, &d, data, len)) {
+            printf("failed: input %ld, custom dialect\n", it);
+            ok = 0;
+        }
+    }
+
+    if (custom)
+        tokenizer_free(custom);
+    tokenizer_free(by_opt[0]);
+    tokenizer_free(by_opt[1]);
+    tokenizer_free(by_dialect[0]);
+    tokenizer_free(by_dialect[1]);
+
+    if (ok)
+        printf("ok\n");
+    return !ok;
+}
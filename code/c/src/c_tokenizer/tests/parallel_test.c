@@ -0,0 +1,147 @@
+/* c_tokenizer/tests/parallel_test.c */
+#include "../parallel_tokenization.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This program checks tokenize_parallel against the sequential spans
+ * tokenizer: the same made up input must give the same lines in the same
+ * order (status, end char and words, digested), with 1 to 5 threads and
+ * the special chars on and off.
+ *
+ * The inputs span several chunks (4MB each in parallel_tokenization.c):
+ * the whole one, an empty one, one with a "\r\n" split by the end of
+ * the first chunk, and one cut inside the last line, which then ends in
+ * quotes. A visitor that stops half way must stop the tokenization there
+ * and get the number of lines it saw back.
+ *
+ * Build:
+ *   gcc -O2 parallel_test.c ../word.c ../word_list.c \
+ *       ../linear_allocator.c ../input_buffer.c ../char_scan.c \
+ *       ../token_line.c ../tokenizer_dfa.c ../line_tokenization.c \
+ *       ../parallel_tokenization.c -lpthread -o parallel_test.out
+ *
+ * Usage: ./parallel_test.out [seed], returns 0 if all the lines matched,
+ * 1 else. */
+
+enum {
+    input_size = 11 << 20,
+    chunk_size = 4 << 20,
+    max_threads = 5
+};
+
+struct digest {
+    unsigned long h;
+    size_t lines, stop_at;
+};
+
+static unsigned long digest_word(unsigned long h, const char *s, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        h = h * 1000003 ^ (unsigned char)s[i];
+    return h * 31 + n;
+}
+
+static int digest_line(const struct token_line *line, int status,
+        int eol_char, void *ctx)
+{
+    struct digest *d = ctx;
+    int i;
+
+    /* the end char of a line in error is not set by the sequential
+     * one, it is left from the line before */
+    d->lines++;
+    d->h = d->h * 7 + status * 3 + (status ? 0 : eol_char);
+    if (status == 0) {
+        for (i = 0; i < line->cnt; i++) {
+            d->h = digest_word(d->h, token_line_text(line, i),
+                    line->spans[i].len);
+        }
+    }
+
+    return d->stop_at && d->lines == d->stop_at;
+}
+
+static void sequential(const char *data, size_t len,
+        enum tokenizer_option opt, struct digest *d)
+{
+    struct input_buffer *in = input_buffer_create_memory(data, len);
+    struct tokenizer *tk = tokenizer_create(opt);
+    const struct token_line *line;
+    int eol_char = 0, status;
+
+    while (eol_char != EOF) {
+        status = tokenizer_next_spans(tk, in, &line, &eol_char);
+        digest_line(line, status, eol_char, d);
+    }
+
+    tokenizer_free(tk);
+    input_buffer_free(in);
+}
+
+static int check_input(const char *data, size_t len, const char *name)
+{
+    struct digest seq, par;
+    enum tokenizer_option opt;
+    size_t res;
+    int threads;
+
+    for (opt = tokenizer_opt_off; opt <= tokenizer_opt_on; opt++) {
+        memset(&seq, 0, sizeof(seq));
+        sequential(data, len, opt, &seq);
+
+        for (threads = 1; threads <= max_threads; threads++) {
+            memset(&par, 0, sizeof(par));
+            res = tokenize_parallel(data, len, opt, threads, digest_line,
+                    &par);
+            if (par.h != seq.h || par.lines != seq.lines || res != seq.lines) {
+                printf("failed: %s, options %s, %d threads\n", name,
+                        opt ? "on" : "off", threads);
+                return 0;
+            }
+        }
+
+        memset(&par, 0, sizeof(par));
+        par.stop_at = seq.lines / 2 + 1;
+        res = tokenize_parallel(data, len, opt, 3, digest_line, &par);
+        if (res != par.stop_at || par.lines != par.stop_at) {
+            printf("failed: %s, options %s, stopped at %lu of %lu\n", name,
+                    opt ? "on" : "off", (unsigned long)res,
+                    (unsigned long)par.stop_at);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    static const char chars[] = "abcdefgh  \t\"\\\n\r";
+    char *data = malloc(input_size);
+    size_t i;
+    int ok;
+
+    srand(argc > 1 ? strtoul(argv[1], NULL, 10) : 1);
+    for (i = 0; i < input_size; i++)
+        data[i] = chars[rand() % (sizeof(chars) - 1)];
+
+    ok = check_input(data, input_size, "whole input") &&
+        check_input(data, 0, "empty input");
+
+    /* the first chunk ends at the '\r', the second is the '\n' */
+    data[chunk_size] = '\r';
+    data[chunk_size + 1] = '\n';
+    ok = ok && check_input(data, chunk_size + 2, "eol at a chunk end");
+
+    /* a last line with no end, here in quotes if not already */
+    data[input_size - 2] = '"';
+    ok = ok && check_input(data, input_size - 1, "cut input");
+
+    free(data);
+    if (ok)
+        printf("ok\n");
+    return !ok;
+}
@@ -0,0 +1,227 @@
+/* c_tokenizer/tests/stream_test.c */
+#include "../line_tokenization.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This program checks the push tokenizer against the getc one: random
+ * short inputs (quotes, escapes, both line ends and '\0' bytes in them)
+ * are fed to a tokenizer_stream in pieces cut at random, empty ones
+ * among them, and the lines it visits must be those the getc tokenizer
+ * reads from the whole input (status, end char and words). Every piece
+ * is overwritten and freed right after its feed, the words must not point
+ * into it any more.
+ *
+ * The one difference allowed: a last line ending in quotes or after an
+ * escape is an error in both, the getc one then reads an empty line at
+ * EOF after it, the stream has nothing left for one.
+ *
+ * The same stream is used for all the inputs, as one can be after
+ * tokenizer_stream_finish, and every so often the visitor stops it at
+ * some line, no later line may then be visited.
+ *
+ * Build:
+ *   gcc -O2 stream_test.c ../word.c ../word_list.c \
+ *       ../linear_allocator.c ../input_buffer.c ../char_scan.c \
+ *       ../token_line.c ../tokenizer_dfa.c ../line_tokenization.c \
+ *       -lpthread -o stream_test.out
+ *
+ * Usage: ./stream_test.out [inputs] [seed], returns 0 if all the lines
+ * matched, 1 else. */
+
+enum {
+    max_input_len = 300,
+    max_piece_len = 20,
+    max_lines = max_input_len + 2,
+    stop_code = 7
+};
+
+/* a digest per line */
+struct lines {
+    unsigned long digests[max_lines];
+    int cnt, stop_at;
+};
+
+static unsigned long digest_word(unsigned long h, const char *s, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        h = h * 1000003 ^ (unsigned char)s[i];
+    return h * 31 + n;
+}
+
+/* the end char of a line in error is not set by the getc one */
+static void add_line(struct lines *l, unsigned long h, int status,
+        int eol_char)
+{
+    l->digests[l->cnt++] = h * 7 + status * 3 + (status ? 0 : eol_char);
+}
+
+static void make_input(char *data, int len)
+{
+    static const char chars[] = "abcxyz  \t\"\\\n\r";
+    int i;
+
+    for (i = 0; i < len; i++) {
+        if (rand() % 64 == 0)
+            data[i] = '\0';
+        else
+            data[i] = chars[rand() % (sizeof(chars) - 1)];
+    }
+}
+
+/* Reference */
+
+static void getc_lines(const char *data, int len, struct lines *l)
+{
+    struct word_list *words;
+    struct word *w;
+    unsigned long h;
+    int eol_char = 0, status;
+    FILE *f;
+
+    /* an empty buffer is not taken by every libc */
+    f = len > 0 ? fmemopen((void *)data, len, "r") : fopen("/dev/null", "r");
+
+    l->cnt = 0;
+    while (eol_char != EOF) {
+        status = tokenize_input_line_to_word_list(f, &words, &eol_char);
+        h = 0;
+        if (status == 0) {
+            while ((w = word_list_pop_first(words))) {
+                h = digest_word(h, word_content(w), word_length(w));
+                word_free(w);
+            }
+            word_list_free(words);
+        }
+        add_line(l, h, status, eol_char);
+
+        /* not the empty line after it */
+        if (status != 0 && feof(f))
+            break;
+    }
+
+    fclose(f);
+}
+
+/* Stream */
+
+static int visit_line(const struct token_line *line, int status,
+        int eol_char, void *ctx)
+{
+    struct lines *l = ctx;
+    unsigned long h = 0;
+    int i;
+
+    if (l->cnt == max_lines)
+        return stop_code;
+
+    if (status == 0) {
+        for (i = 0; i < line->cnt; i++) {
+            h = digest_word(h, token_line_text(line, i),
+                    line->spans[i].len);
+        }
+    }
+    add_line(l, h, status, eol_char);
+
+    return l->cnt == l->stop_at ? stop_code : 0;
+}
+
+/* returns what the stream returned last */
+static int feed_in_pieces(struct tokenizer_stream *st, const char *data,
+        int len)
+{
+    char *piece;
+    int pos = 0, n, res = 0;
+
+    while (pos < len) {
+        n = rand() % (max_piece_len + 1);
+        if (n > len - pos)
+            n = len - pos;
+
+        piece = malloc(n + 1);
+        memcpy(piece, data + pos, n);
+        res = tokenizer_stream_feed(st, piece, n);
+        memset(piece, '#', n);
+        free(piece);
+
+        pos += n;
+    }
+
+    return res;
+}
+
+/* stopped streams take no more input, so one that may be stopped is
+ * made for the input alone, the rest go to the shared one */
+static int check_input(struct tokenizer_stream *shared,
+        enum tokenizer_option opt, const char *data, int len,
+        const struct lines *ref, struct lines *got)
+{
+    struct tokenizer_stream *st = shared;
+    int res, i;
+
+    got->cnt = 0;
+    got->stop_at = 0;
+    if (rand() % 8 == 0) {
+        got->stop_at = 1 + rand() % ref->cnt;
+        st = tokenizer_stream_create(opt, visit_line, got);
+    }
+
+    res = feed_in_pieces(st, data, len);
+    if (res == 0)
+        res = tokenizer_stream_finish(st);
+    if (st != shared)
+        tokenizer_stream_free(st);
+
+    if (got->stop_at) {
+        if (res != stop_code || got->cnt != got->stop_at)
+            return 0;
+    } else if (res != 0 || got->cnt != ref->cnt)
+        return 0;
+
+    for (i = 0; i < got->cnt; i++) {
+        if (got->digests[i] != ref->digests[i])
+            return 0;
+    }
+
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    static struct lines ref, got;
+    struct tokenizer_stream *streams[2];
+    char data[max_input_len];
+    long inputs = 200000, it;
+    int len, opt;
+
+    if (argc > 1)
+        inputs = atol(argv[1]);
+    srand(argc > 2 ? strtoul(argv[2], NULL, 10) : 1);
+
+    streams[tokenizer_opt_off] = tokenizer_stream_create(tokenizer_opt_off,
+            visit_line, &got);
+    streams[tokenizer_opt_on] = tokenizer_stream_create(tokenizer_opt_on,
+            visit_line, &got);
+
+    for (it = 0; it < inputs; it++) {
+        opt = it % 2 ? tokenizer_opt_on : tokenizer_opt_off;
+        len = rand() % (max_input_len + 1);
+        make_input(data, len);
+
+        set_tokenization_options(opt);
+        getc_lines(data, len, &ref);
+
+        if (!check_input(streams[opt], opt, data, len, &ref, &got)) {
+            printf("failed: input %ld\n", it);
+            return 1;
+        }
+    }
+
+    tokenizer_stream_free(streams[0]);
+    tokenizer_stream_free(streams[1]);
+
+    printf("ok\n");
+    return 0;
+}
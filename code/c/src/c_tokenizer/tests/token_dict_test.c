@@ -0,0 +1,325 @@
+/* c_tokenizer/tests/token_dict_test.c */
+#include "../token_dict.c"
+#include "../../c_rbtree/tests/test_rng.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* This program checks the token dict against a reference: a fixed set of
+ * words, each with the id it must have once interned. Random interns and
+ * finds are done on both, a new word must get the next id, a known one
+ * its old id, and a find of a word never interned TOKEN_DICT_NO_ID.
+ * Whole lines of random words go through token_dict_intern_line too.
+ *
+ * Every so often, and whenever the table, the entries or the arena grew,
+ * every word interned so far is checked: found under its id, and
+ * token_dict_word and token_dict_word_length giving back its bytes and a
+ * '\0' after them, so the ids stay what they were across the growth.
+ *
+ * The words: short and long ones (past the 8 bytes of a hash step), ones
+ * differing only in their last byte, the empty word, words with '\0'
+ * bytes in them ("ab", "ab\0", "ab\0\0" are all different), and pairs of
+ * words found to have the same 32-bit hash, so the words are compared
+ * after the hashes match.
+ *
+ * At the end the full dict: with the ids made to look used up, a new
+ * word must fail with TOKEN_DICT_NO_ID and leave the dict as it was,
+ * and the entries must never grow past the ids there can be.
+ *
+ * Build:
+ *   gcc -O2 token_dict_test.c ../token_line.c -o token_dict_test.out
+ *
+ * Usage: ./token_dict_test.out [ops] [seed], returns 0 if all the answers
+ * and checks were right, 1 else. */
+
+enum {
+    word_cnt = 20000,
+    max_word_len = 64,
+    /* words hashed looking for the same 32-bit hash */
+    collision_tries = 300000,
+    max_collisions = 16,
+    max_line_words = 12,
+    check_every = 5000
+};
+
+struct ref_word {
+    char bytes[max_word_len];
+    size_t len;
+    uint32_t id;        /* TOKEN_DICT_NO_ID until interned */
+};
+
+static struct ref_word words[word_cnt];
+static uint32_t next_id;
+static long collision_cnt;
+
+/* Words */
+
+struct hashed {
+    uint32_t hash;
+    long i;
+};
+
+static int compare_hashed(const void *a, const void *b)
+{
+    const struct hashed *x = a, *y = b;
+
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    return (x->i > y->i) - (x->i < y->i);
+}
+
+static void set_word(long k, const char *bytes, size_t len)
+{
+    memcpy(words[k].bytes, bytes, len);
+    words[k].len = len;
+    words[k].id = TOKEN_DICT_NO_ID;
+}
+
+/* pairs of words with the same hash into words[from..), returns how many
+ * words were put there */
+static long find_collisions(long from)
+{
+    struct hashed *h = malloc(collision_tries * sizeof(*h));
+    char buf[max_word_len];
+    long i, k = from;
+
+    for (i = 0; i < collision_tries; i++) {
+        sprintf(buf, "collide%ld", i);
+        h[i].hash = (uint32_t)hash_bytes(buf, strlen(buf));
+        h[i].i = i;
+    }
+    qsort(h, collision_tries, sizeof(*h), compare_hashed);
+
+    for (i = 1; i < collision_tries && k - from < 2 * max_collisions; i++) {
+        if (h[i].hash != h[i-1].hash)
+            continue;
+        sprintf(buf, "collide%ld", h[i-1].i);
+        set_word(k++, buf, strlen(buf));
+        sprintf(buf, "collide%ld", h[i].i);
+        set_word(k++, buf, strlen(buf));
+    }
+
+    free(h);
+    return k - from;
+}
+
+static void make_words(void)
+{
+    static const char *const with_nul[] = { "ab", "ab\0", "ab\0\0", "\0",
+        "\0\0", "\0ab", "a\0b", "a\0c" };
+    static const size_t with_nul_len[] = { 2, 3, 4, 1, 2, 3, 3, 3 };
+    char buf[max_word_len];
+    long k = 0, i;
+    int len;
+
+    set_word(k++, "", 0);
+    for (i = 0; i < 8; i++)
+        set_word(k++, with_nul[i], with_nul_len[i]);
+
+    collision_cnt = find_collisions(k);
+    k += collision_cnt;
+
+    for (i = 0; k < word_cnt; i++, k++) {
+        switch (i % 4) {
+            case 0:
+                len = sprintf(buf, "w%ld", i);
+                break;
+            case 1:
+                len = sprintf(buf, "a-common-prefix-longer-than-8-%ld", i);
+                break;
+            case 2:
+                /* a '\0' in the middle, the rest tells them apart */
+                len = sprintf(buf, "nul?%ld", i);
+                buf[3] = '\0';
+                break;
+            default:
+                len = sprintf(buf, "%ld", i);
+                break;
+        }
+        set_word(k, buf, len);
+    }
+}
+
+/* Checks */
+
+static int check_word(const struct token_dict *d, const struct ref_word *w)
+{
+    const char *s;
+
+    if (w->id == TOKEN_DICT_NO_ID)
+        return token_dict_find(d, w->bytes, w->len) == TOKEN_DICT_NO_ID;
+
+    if (token_dict_find(d, w->bytes, w->len) != w->id ||
+            token_dict_word_length(d, w->id) != w->len)
+        return 0;
+
+    s = token_dict_word(d, w->id);
+    return memcmp(s, w->bytes, w->len) == 0 && s[w->len] == '\0';
+}
+
+static int check_all(const struct token_dict *d)
+{
+    long k;
+
+    if (d->cnt != next_id)
+        return 0;
+
+    for (k = 0; k < word_cnt; k++) {
+        if (!check_word(d, &words[k]))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* Operations */
+
+static int intern(struct token_dict *d, struct ref_word *w)
+{
+    uint32_t id;
+
+    id = token_dict_intern(d, w->bytes, w->len);
+    if (w->id == TOKEN_DICT_NO_ID)
+        w->id = next_id++;
+
+    return id == w->id;
+}
+
+/* the words are put one after another into the source, some copied into
+ * the arena as the tokenizer does for rewritten ones */
+static int intern_line(struct token_dict *d, struct token_id_line *ids)
+{
+    static char source[max_line_words * max_word_len];
+    struct token_line line;
+    struct ref_word *w[max_line_words];
+    size_t pos = 0;
+    int cnt, i, ok;
+
+    token_line_init(&line);
+    line.source = source;
+
+    cnt = rng_next() % (max_line_words + 1);
+    for (i = 0; i < cnt; i++) {
+        w[i] = &words[rng_next() % (word_cnt - 1)];
+        memcpy(source + pos, w[i]->bytes, w[i]->len);
+        token_line_add_span(&line);
+        token_line_add_chars_to_last(&line, pos, w[i]->len);
+        pos += w[i]->len;
+    }
+    if (rng_next() % 2)
+        token_line_detach(&line);
+
+    token_dict_intern_line(d, &line, ids);
+    token_line_free(&line);
+
+    ok = ids->cnt == cnt;
+    for (i = 0; ok && i < cnt; i++) {
+        if (w[i]->id == TOKEN_DICT_NO_ID)
+            w[i]->id = next_id++;
+        ok = ids->ids[i] == w[i]->id;
+    }
+
+    return ok;
+}
+
+static int random_op(struct token_dict *d, struct token_id_line *ids)
+{
+    struct ref_word *w;
+
+    /* most ops on a few hundred words, so many are known */
+    if (rng_next() % 2)
+        w = &words[rng_next() % 500];
+    else
+        w = &words[rng_next() % (word_cnt - 1)];
+
+    switch (rng_next() % 8) {
+        case 0:
+            return intern_line(d, ids);
+        case 1:
+        case 2:
+        case 3:
+            return check_word(d, w);
+        default:
+            return intern(d, w);
+    }
+}
+
+/* Full dict */
+
+/* the last word is kept out of the random ops for this */
+static int check_full(struct token_dict *d)
+{
+    struct ref_word *fresh = &words[word_cnt - 1], *known = &words[0];
+    uint32_t cnt, entries_cap;
+    size_t arena_len;
+    int ok;
+
+    if (next_entries_cap(0) != base_entries_cap ||
+            next_entries_cap(0x7fffffffu) != 0xfffffffeu ||
+            next_entries_cap(0x80000000u) != TOKEN_DICT_NO_ID ||
+            next_entries_cap(TOKEN_DICT_NO_ID) != 0)
+        return 0;
+
+    if (!intern(d, known))
+        return 0;
+    cnt = d->cnt;
+    entries_cap = d->entries_cap;
+    arena_len = d->arena_len;
+
+    /* the last id given, the entries as big as they can be */
+    d->cnt = d->entries_cap = TOKEN_DICT_NO_ID;
+    ok = token_dict_intern(d, fresh->bytes, fresh->len) == TOKEN_DICT_NO_ID &&
+        token_dict_intern(d, known->bytes, known->len) == known->id &&
+        d->arena_len == arena_len;
+    d->cnt = cnt;
+    d->entries_cap = entries_cap;
+
+    return ok && check_all(d);
+}
+
+int main(int argc, char **argv)
+{
+    struct token_dict d;
+    struct token_id_line ids;
+    size_t cap, entries_cap, arena_cap;
+    long ops = 500000, i;
+
+    if (argc > 1)
+        ops = atol(argv[1]);
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    if (!rng_state)
+        rng_state = 1;
+
+    make_words();
+    token_dict_init(&d);
+    token_id_line_init(&ids);
+
+    for (i = 0; i < ops; i++) {
+        cap = d.cap;
+        entries_cap = d.entries_cap;
+        arena_cap = d.arena_cap;
+
+        if (!random_op(&d, &ids)) {
+            printf("failed: wrong answer at op %ld\n", i);
+            return 1;
+        }
+
+        if ((i % check_every == 0 || d.cap != cap ||
+                    d.entries_cap != entries_cap ||
+                    d.arena_cap != arena_cap) && !check_all(&d)) {
+            printf("failed: check at op %ld\n", i);
+            return 1;
+        }
+    }
+
+    if (!check_all(&d) || !check_full(&d)) {
+        printf("failed: full dict\n");
+        return 1;
+    }
+
+    token_id_line_free(&ids);
+    token_dict_free(&d);
+
+    printf("%u words interned, %ld of them in pairs with the same hash\n"
+            "ok\n", (unsigned)next_id, collision_cnt);
+    return 0;
+}
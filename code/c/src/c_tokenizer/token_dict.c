@@ -0,0 +1,229 @@
+/* c_tokenizer/src/token_dict.c */
+#include "token_dict.h"
+#include "../c_hashtable/hash_bytes.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Linear probing over 8 byte slots, kept at most 3/4 full, the table is
+ * only ever grown (words are never removed) and regrown from the slots
+ * alone, the stored hash is all it needs. The full 32-bit hash is
+ * compared before the word, so the arena is only read for a likely
+ * match. The hash is that of the hash table (hash_bytes.h), cut to 32
+ * bits. */
+
+enum {
+    base_cap = 256,
+    base_entries_cap = 64,
+    base_arena_cap = 4096
+};
+
+struct token_dict_slot {
+    uint32_t hash;
+    uint32_t id;        /* TOKEN_DICT_NO_ID if empty */
+};
+
+struct token_dict_entry {
+    size_t offset, len;
+};
+
+/* API Impl and forward declarations */
+
+static struct token_dict_slot *find_slot(const struct token_dict *d,
+        const char *s, size_t n, uint32_t hash);
+static void grow_slots(struct token_dict *d);
+static uint32_t add_word(struct token_dict *d, const char *s, size_t n);
+
+void token_dict_init(struct token_dict *d)
+{
+    memset(d, 0, sizeof(*d));
+}
+
+void token_dict_free(struct token_dict *d)
+{
+    free(d->slots);
+    free(d->entries);
+    free(d->arena);
+    token_dict_init(d);
+}
+
+uint32_t token_dict_intern(struct token_dict *d, const char *s, size_t n)
+{
+    struct token_dict_slot *slot;
+    uint32_t hash, id;
+
+    if (((size_t)d->cnt + 1) * 4 > d->cap * 3)
+        grow_slots(d);
+
+    hash = (uint32_t)hash_bytes(s, n);
+    slot = find_slot(d, s, n, hash);
+    if (slot->id != TOKEN_DICT_NO_ID)
+        return slot->id;
+
+    id = add_word(d, s, n);
+    if (id != TOKEN_DICT_NO_ID) {
+        slot->hash = hash;
+        slot->id = id;
+    }
+
+    return id;
+}
+
+uint32_t token_dict_find(const struct token_dict *d, const char *s, size_t n)
+{
+    if (!d->cap)
+        return TOKEN_DICT_NO_ID;
+
+    return find_slot(d, s, n, (uint32_t)hash_bytes(s, n))->id;
+}
+
+const char *token_dict_word(const struct token_dict *d, uint32_t id)
+{
+    return d->arena + d->entries[id].offset;
+}
+
+size_t token_dict_word_length(const struct token_dict *d, uint32_t id)
+{
+    return d->entries[id].len;
+}
+
+void token_id_line_init(struct token_id_line *ids)
+{
+    ids->ids = NULL;
+    ids->cnt = 0;
+    ids->cap = 0;
+}
+
+void token_id_line_free(struct token_id_line *ids)
+{
+    free(ids->ids);
+    token_id_line_init(ids);
+}
+
+void token_dict_intern_line(struct token_dict *d,
+        const struct token_line *line, struct token_id_line *ids)
+{
+    int i;
+
+    if (line->cnt > ids->cap) {
+        ids->cap = line->cnt;
+        ids->ids = realloc(ids->ids, sizeof(*ids->ids) * ids->cap);
+    }
+
+    for (i = 0; i < line->cnt; i++) {
+        ids->ids[i] = token_dict_intern(d, token_line_text(line, i),
+                line->spans[i].len);
+    }
+    ids->cnt = line->cnt;
+}
+
+/* Table */
+
+/* the slot of the word, or the empty one it would go to */
+static struct token_dict_slot *find_slot(const struct token_dict *d,
+        const char *s, size_t n, uint32_t hash)
+{
+    const struct token_dict_entry *e;
+    struct token_dict_slot *slot;
+    size_t pos;
+
+    for (pos = hash & (d->cap - 1);; pos = (pos + 1) & (d->cap - 1)) {
+        slot = &d->slots[pos];
+        if (slot->id == TOKEN_DICT_NO_ID)
+            return slot;
+        if (slot->hash != hash)
+            continue;
+
+        e = &d->entries[slot->id];
+        if (e->len == n && (n == 0 ||
+                    memcmp(d->arena + e->offset, s, n) == 0))
+            return slot;
+    }
+}
+
+static void grow_slots(struct token_dict *d)
+{
+    struct token_dict_slot *old = d->slots, *slot;
+    size_t old_cap = d->cap, i, pos;
+
+    d->cap = old_cap ? old_cap * 2 : base_cap;
+    d->slots = malloc(sizeof(*d->slots) * d->cap);
+    for (i = 0; i < d->cap; i++)
+        d->slots[i].id = TOKEN_DICT_NO_ID;
+
+    for (i = 0; i < old_cap; i++) {
+        if (old[i].id == TOKEN_DICT_NO_ID)
+            continue;
+
+        pos = old[i].hash & (d->cap - 1);
+        for (slot = &d->slots[pos]; slot->id != TOKEN_DICT_NO_ID;
+                slot = &d->slots[pos])
+        {
+            pos = (pos + 1) & (d->cap - 1);
+        }
+        *slot = old[i];
+    }
+
+    free(old);
+}
+
+/* Words */
+
+/* the entries for the next ids, 0 if there can be no more: the ids stop
+ * at TOKEN_DICT_NO_ID - 1, so there are at most TOKEN_DICT_NO_ID */
+static uint32_t next_entries_cap(uint32_t cap)
+{
+    if (!cap)
+        return base_entries_cap;
+    if (cap == TOKEN_DICT_NO_ID)
+        return 0;
+
+    return cap > TOKEN_DICT_NO_ID / 2 ? TOKEN_DICT_NO_ID : cap * 2;
+}
+
+/* the id of the new word, TOKEN_DICT_NO_ID if the dict can take no more
+ * (out of ids or memory), then it is left as it was */
+static uint32_t add_word(struct token_dict *d, const char *s, size_t n)
+{
+    struct token_dict_entry *e;
+    uint32_t entries_cap;
+    size_t arena_cap;
+    char *arena;
+
+    if (n >= SIZE_MAX - d->arena_len)
+        return TOKEN_DICT_NO_ID;
+
+    if (d->cnt == d->entries_cap) {
+        entries_cap = next_entries_cap(d->entries_cap);
+        e = entries_cap ? realloc(d->entries, sizeof(*e) * entries_cap) :
+            NULL;
+        if (!e)
+            return TOKEN_DICT_NO_ID;
+        d->entries = e;
+        d->entries_cap = entries_cap;
+    }
+
+    if (d->arena_len + n + 1 > d->arena_cap) {
+        arena_cap = d->arena_cap ? d->arena_cap : base_arena_cap;
+        while (d->arena_len + n + 1 > arena_cap) {
+            arena_cap = arena_cap > SIZE_MAX / 2 ?
+                d->arena_len + n + 1 : arena_cap * 2;
+        }
+        arena = realloc(d->arena, arena_cap);
+        if (!arena)
+            return TOKEN_DICT_NO_ID;
+        d->arena = arena;
+        d->arena_cap = arena_cap;
+    }
+
+    e = &d->entries[d->cnt];
+    e->offset = d->arena_len;
+    e->len = n;
+    if (n > 0)
+        memcpy(d->arena + d->arena_len, s, n);
+    d->arena[d->arena_len + n] = '\0';
+    d->arena_len += n + 1;
+
+    return d->cnt++;
+}
@@ -0,0 +1,59 @@
+/* c_tokenizer/src/token_dict.h */
+#ifndef TOKEN_DICT_SENTRY
+#define TOKEN_DICT_SENTRY
+
+#include "token_line.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Interning of the words the tokenizer makes: every distinct word gets a
+ * 32-bit id, counting up from 0 in the order the words are first seen,
+ * and keeps it for the life of the dict. Each word is stored once, all
+ * of them in one arena, and found by an open addressing table of (hash,
+ * id) slots, so a line can be turned into a compact array of ids, and
+ * the words compared as ids from then on. */
+
+struct token_dict_slot;
+struct token_dict_entry;
+
+struct token_dict {
+    struct token_dict_slot *slots;
+    size_t cap;         /* slots, a power of 2, 0 when not allocated */
+    struct token_dict_entry *entries;   /* by id */
+    uint32_t cnt, entries_cap;
+    char *arena;
+    size_t arena_len, arena_cap;
+};
+
+/* the ids of the words of a line, in the line order */
+struct token_id_line {
+    uint32_t *ids;
+    int cnt, cap;
+};
+
+#define TOKEN_DICT_NO_ID 0xffffffffu
+
+void token_dict_init(struct token_dict *d);
+void token_dict_free(struct token_dict *d);
+
+/* the id of the n chars at s, adds them if new, TOKEN_DICT_NO_ID if the
+ * dict is full (the last id is TOKEN_DICT_NO_ID - 1) */
+uint32_t token_dict_intern(struct token_dict *d, const char *s, size_t n);
+/* TOKEN_DICT_NO_ID if not in the dict */
+uint32_t token_dict_find(const struct token_dict *d, const char *s, size_t n);
+
+/* the word is '\0'-terminated (the length counts any '\0' in it), it is
+ * valid until the next word added, the arena may move then */
+const char *token_dict_word(const struct token_dict *d, uint32_t id);
+size_t token_dict_word_length(const struct token_dict *d, uint32_t id);
+
+void token_id_line_init(struct token_id_line *ids);
+void token_id_line_free(struct token_id_line *ids);
+
+/* replaces the ids with those of the words of the line, interning them
+ * (TOKEN_DICT_NO_ID for the words a full dict could not take) */
+void token_dict_intern_line(struct token_dict *d,
+        const struct token_line *line, struct token_id_line *ids);
+
+#endif
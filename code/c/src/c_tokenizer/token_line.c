@@ -0,0 +1,133 @@
+/* c_tokenizer/src/token_line.c */
+#include "token_line.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    base_spans_cap = 16,
+    base_arena_cap = 256
+};
+
+void token_line_init(struct token_line *line)
+{
+    line->source = NULL;
+    line->spans = NULL;
+    line->cnt = 0;
+    line->cap = 0;
+    line->arena = NULL;
+    line->arena_len = 0;
+    line->arena_cap = 0;
+}
+
+void token_line_clear(struct token_line *line)
+{
+    line->source = NULL;
+    line->cnt = 0;
+    line->arena_len = 0;
+}
+
+void token_line_free(struct token_line *line)
+{
+    free(line->spans);
+    free(line->arena);
+    token_line_init(line);
+}
+
+void token_line_add_span(struct token_line *line)
+{
+    struct token_span *sp;
+
+    if (line->cnt == line->cap) {
+        line->cap = line->cap ? line->cap * 2 : base_spans_cap;
+        line->spans = realloc(line->spans, sizeof(*sp) * line->cap);
+    }
+
+    sp = &line->spans[line->cnt++];
+    sp->offset = 0;
+    sp->len = 0;
+    sp->rewritten = 0;
+}
+
+/* NULL s just makes room for n chars at the end */
+static void arena_add(struct token_line *line, const char *s, size_t n)
+{
+    if (line->arena_len + n > line->arena_cap) {
+        if (!line->arena_cap)
+            line->arena_cap = base_arena_cap;
+        while (line->arena_len + n > line->arena_cap)
+            line->arena_cap *= 2;
+        line->arena = realloc(line->arena, line->arena_cap);
+    }
+
+    if (s && n > 0)
+        memcpy(line->arena + line->arena_len, s, n);
+    line->arena_len += n;
+}
+
+/* the span goes on in the source while its chars follow each other
+ * there, and is moved to the arena on the first gap */
+void token_line_add_chars_to_last(struct token_line *line, size_t offset,
+        size_t n)
+{
+    struct token_span *sp = &line->spans[line->cnt-1];
+
+    if (!sp->rewritten) {
+        if (sp->len == 0)
+            sp->offset = offset;
+        if (sp->offset + sp->len == offset) {
+            sp->len += n;
+            return;
+        }
+
+        /* the span is the last thing in the arena, so it stays there */
+        arena_add(line, line->source + sp->offset, sp->len);
+        sp->offset = line->arena_len - sp->len;
+        sp->rewritten = 1;
+    }
+
+    arena_add(line, line->source + offset, n);
+    sp->len += n;
+}
+
+/* the last span is moved to the end of the arena, as it may go on */
+void token_line_detach(struct token_line *line)
+{
+    struct token_span *sp;
+    size_t len;
+    int i;
+
+    for (i = 0; i < line->cnt - 1; i++) {
+        sp = &line->spans[i];
+        if (!sp->rewritten) {
+            arena_add(line, line->source + sp->offset, sp->len);
+            sp->offset = line->arena_len - sp->len;
+            sp->rewritten = 1;
+        }
+    }
+
+    if (line->cnt == 0)
+        return;
+
+    sp = &line->spans[line->cnt-1];
+    len = sp->len;
+    if (!sp->rewritten)
+        arena_add(line, line->source + sp->offset, len);
+    else if (sp->offset + len != line->arena_len) {
+        /* the copy may move the arena, so the span is copied from its
+         * offset after that */
+        arena_add(line, NULL, len);
+        memcpy(line->arena + line->arena_len - len,
+                line->arena + sp->offset, len);
+    } else
+        return;
+
+    sp->offset = line->arena_len - len;
+    sp->rewritten = 1;
+}
+
+const char *token_line_text(const struct token_line *line, int i)
+{
+    const struct token_span *sp = &line->spans[i];
+    return (sp->rewritten ? line->arena : line->source) + sp->offset;
+}
@@ -0,0 +1,46 @@
+/* c_tokenizer/src/token_line.h */
+#ifndef TOKEN_LINE_SENTRY
+#define TOKEN_LINE_SENTRY
+
+#include <stddef.h>
+
+/* The words of a line as one flat array of spans, instead of a list of
+ * heap strings. A word written as is in the input is just its offset and
+ * length in the line source; only a word that had quotes, escapes or
+ * '\0' bytes dropped from the middle of it is copied, into the arena of
+ * the line.
+ * So the usual line costs no allocations at all, once the arrays of a
+ * reused token_line are big enough.
+ *
+ * The source points into the input, it is valid until the next read
+ * from it. The words are not '\0'-terminated. */
+
+struct token_span {
+    size_t offset, len;
+    int rewritten;      /* in the arena, else in the source */
+};
+
+struct token_line {
+    const char *source;
+    struct token_span *spans;
+    int cnt, cap;
+    char *arena;
+    size_t arena_len, arena_cap;
+};
+
+void token_line_init(struct token_line *line);
+void token_line_clear(struct token_line *line);
+void token_line_free(struct token_line *line);
+
+void token_line_add_span(struct token_line *line);
+/* adds n chars at offset in the source to the last span */
+void token_line_add_chars_to_last(struct token_line *line, size_t offset,
+        size_t n);
+
+/* copies the words still in the source into the arena, so the line no
+ * longer needs it */
+void token_line_detach(struct token_line *line);
+
+const char *token_line_text(const struct token_line *line, int i);
+
+#endif
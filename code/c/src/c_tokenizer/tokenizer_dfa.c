@@ -0,0 +1,138 @@
+/* c_tokenizer/src/tokenizer_dfa.c */
+#include "tokenizer_dfa.h"
+
+#include <string.h>
+
+/* the same as char_action in line_tokenization.c */
+enum {
+    dfa_starts_word = 1,
+    dfa_goes_to_word = 2,
+    dfa_ends_line = 4
+};
+
+const struct tokenizer_dialect tokenizer_default_dialect =
+    { " \t", "\"", "\\" };
+const struct tokenizer_dialect tokenizer_plain_dialect =
+    { " \t", "", "" };
+
+static int char_in(const char *set, int c)
+{
+    return set && c != '\0' && strchr(set, c) != NULL;
+}
+
+static int char_is_eol(int c)
+{
+    return c == '\n' || c == '\r';
+}
+
+/* the index of c in the quotes, -1 if not a quote */
+static int quote_index(const struct tokenizer_dialect *d, int c)
+{
+    const char *q;
+
+    if (!char_in(d->quotes, c))
+        return -1;
+
+    q = strchr(d->quotes, c);
+    return q - d->quotes;
+}
+
+/* the state machine, one state and char at a time, for the table */
+static int transition(const struct tokenizer_dialect *d, int state, int c)
+{
+    int mode = state & dfa_mode_mask, in_word = state & dfa_in_word;
+    int escaped = state & dfa_escaped, quote, actions = 0;
+
+    if (char_is_eol(c))
+        return state | dfa_ends_line << dfa_action_shift;
+
+    if (!escaped && char_in(d->escapes, c))
+        return state | dfa_escaped;
+
+    quote = quote_index(d, c);
+    if (!escaped && quote >= 0 && (mode == 0 || mode == quote + 1)) {
+        if (mode == 0) {
+            mode = quote + 1;
+            if (!in_word) {
+                actions = dfa_starts_word;
+                in_word = dfa_in_word;
+            }
+        } else
+            mode = 0;
+
+        return mode | in_word | actions << dfa_action_shift;
+    }
+
+    /* a plain char */
+    if (mode == 0 && char_in(d->delimiters, c))
+        return mode;
+
+    if (!in_word)
+        actions = dfa_starts_word;
+    if (c != '\0')
+        actions |= dfa_goes_to_word;
+    return mode | dfa_in_word | actions << dfa_action_shift;
+}
+
+static void add_stop(struct char_scan_set *set, int c)
+{
+    if (set->cnt < 0)
+        return;
+    if (set->cnt == char_scan_max_chars) {
+        set->cnt = -1;
+        return;
+    }
+    set->chars[set->cnt++] = c;
+}
+
+static void add_stops(struct char_scan_set *set, const char *chars)
+{
+    for (; chars && *chars; chars++)
+        add_stop(set, *chars);
+}
+
+/* '\0' too, as it never goes to a word */
+static void build_run_stops(struct tokenizer_dfa *dfa,
+        const struct tokenizer_dialect *d, int quotes_cnt)
+{
+    struct char_scan_set *set;
+    int mode;
+
+    for (mode = 0; mode <= tokenizer_dialect_max_quotes; mode++) {
+        set = &dfa->run_stops[mode];
+        set->cnt = 0;
+        if (mode > quotes_cnt)
+            continue;
+
+        add_stop(set, '\n');
+        add_stop(set, '\r');
+        add_stop(set, '\0');
+        add_stops(set, d->escapes);
+        if (mode == 0) {
+            add_stops(set, d->quotes);
+            add_stops(set, d->delimiters);
+        } else
+            add_stop(set, d->quotes[mode-1]);
+
+        if (set->cnt < 0)
+            set->cnt = 0;
+    }
+}
+
+int tokenizer_dfa_build(struct tokenizer_dfa *dfa,
+        const struct tokenizer_dialect *d)
+{
+    int quotes_cnt, state, c;
+
+    quotes_cnt = d->quotes ? strlen(d->quotes) : 0;
+    if (quotes_cnt > tokenizer_dialect_max_quotes)
+        return 0;
+
+    for (state = 0; state < dfa_state_cnt; state++) {
+        for (c = 0; c < 256; c++)
+            dfa->next[state][c] = transition(d, state, c);
+    }
+
+    build_run_stops(dfa, d, quotes_cnt);
+    return 1;
+}
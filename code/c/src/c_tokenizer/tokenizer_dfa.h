@@ -0,0 +1,67 @@
+/* c_tokenizer/src/tokenizer_dfa.h */
+#ifndef TOKENIZER_DFA_SENTRY
+#define TOKENIZER_DFA_SENTRY
+
+#include "char_scan.h"
+
+/* The tokenizer state machine as a table: a dialect says which chars
+ * split words, quote and escape, and is made into a transition table
+ * with an entry for every state and every byte. So a char costs one
+ * table lookup, giving the next state and what the char does to the
+ * words, whatever the dialect.
+ *
+ * The rules, for all dialects:
+ *  - '\n' and '\r' end the line, always, it is an error to end it in
+ *    quotes or right after an escape;
+ *  - a run of delimiters outside of quotes is between words, it is not
+ *    a part of any;
+ *  - a quote char starts quotes, up to the same char, a word can have
+ *    several quoted parts, other quote chars are plain in quotes, and
+ *    quotes make a word even if empty;
+ *  - an escape char makes the next char plain, quote or escape, it
+ *    does not make a delimiter a part of a word though;
+ *  - '\0' is a plain char that is dropped: it starts a word where
+ *    another would, but is not a part of it (the word strings of the
+ *    word lists end at it, the spans keep the same words).
+ * A char in several of the sets is an end of line first, then an escape,
+ * then a quote. */
+
+enum { tokenizer_dialect_max_quotes = 2 };
+
+struct tokenizer_dialect {
+    const char *delimiters;
+    const char *quotes;
+    const char *escapes;
+};
+
+/* the original rules: words split by spaces and tabs, '"' quotes, '\\'
+ * escapes, and the same without quotes and escapes, as when special
+ * chars are off */
+extern const struct tokenizer_dialect tokenizer_default_dialect;
+extern const struct tokenizer_dialect tokenizer_plain_dialect;
+
+/* A state is the quotes it is in (0 if none, else 1 + the index of the
+ * quote char), if in a word, and if right after an escape. An entry of
+ * the table is the next state and the action bits of the char
+ * (char_action in line_tokenization.c) above it. */
+enum {
+    dfa_mode_mask = 3,
+    dfa_in_word = 4,
+    dfa_escaped = 8,
+    dfa_state_mask = 15,
+    dfa_state_cnt = 16,
+    dfa_action_shift = 4
+};
+
+struct tokenizer_dfa {
+    unsigned char next[dfa_state_cnt][256];
+    /* the chars that may end a run of word chars, outside of quotes and
+     * in each of them, a cnt of 0 if there are too many to scan for */
+    struct char_scan_set run_stops[tokenizer_dialect_max_quotes + 1];
+};
+
+/* returns 0 if the dialect has more quote chars than it can take */
+int tokenizer_dfa_build(struct tokenizer_dfa *dfa,
+        const struct tokenizer_dialect *d);
+
+#endif
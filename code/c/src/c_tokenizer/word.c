@@ -2,6 +2,7 @@
 #include "word.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 enum {
     base_word_cap = 32,
@@ -10,43 +11,70 @@ enum {
 
 struct word {
     char *content;
-    int cap;
+    int len, cap;
+    struct linear_allocator *alloc;
 };
 
 struct word *word_create()
+{
+    return word_create_in(NULL);
+}
+
+struct word *word_create_in(struct linear_allocator *a)
 {
     struct word *w;
 
-    w = malloc(sizeof(struct word));
+    w = linear_allocator_alloc(a, sizeof(struct word));
+    w->alloc = a;
+    w->len = 0;
     w->cap = base_word_cap;
-    w->content = malloc(sizeof(char) * w->cap);
+    w->content = linear_allocator_alloc(a, sizeof(char) * w->cap);
     *w->content = '\0';
 
     return w;
 }
 
-static int str_len(const char *word)
+/* grows the content to hold at least need chars and the '\0' */
+static void resize_word(struct word *w, int need)
 {
-    const char *wp;
-    for (wp = word; *wp; wp++)
-        {}
-    return wp - word;
+    char *content;
+
+    while (w->cap < need + 1)
+        w->cap *= word_cap_modifier;
+
+    if (!w->alloc) {
+        w->content = realloc(w->content, sizeof(char) * w->cap);
+        return;
+    }
+
+    content = linear_allocator_alloc(w->alloc, sizeof(char) * w->cap);
+    memcpy(content, w->content, w->len + 1);
+    linear_allocator_free(w->alloc, w->content);
+    w->content = content;
 }
 
-static void resize_word(struct word *w)
+struct word *word_add_char(struct word *w, char c)
 {
-    w->cap *= 2;
-    w->content = realloc(w->content, sizeof(char) * w->cap);
+    /* it would end the content string, so it never got in */
+    if (c == '\0')
+        return w;
+
+    if (w->len >= w->cap - 1)
+        resize_word(w, w->len + 1);
+
+    w->content[w->len++] = c;
+    w->content[w->len] = '\0';
+    return w;
 }
 
-struct word *word_add_char(struct word *w, char c)
+struct word *word_add_chars(struct word *w, const char *s, int n)
 {
-    int w_len = str_len(w->content);
-    if (w_len >= w->cap - 1)
-        resize_word(w);
+    if (w->len + n >= w->cap)
+        resize_word(w, w->len + n);
 
-    w->content[w_len] = c;
-    w->content[w_len+1] = '\0';
+    memcpy(w->content + w->len, s, n);
+    w->len += n;
+    w->content[w->len] = '\0';
     return w;
 }
 
@@ -57,11 +85,16 @@ int word_put(FILE *f, struct word *w)
 
 void word_free(struct word *w)
 {
-    free(w->content);
-    free(w);
+    linear_allocator_free(w->alloc, w->content);
+    linear_allocator_free(w->alloc, w);
 }
 
 const char *word_content(struct word *w)
 {
     return w->content;
 }
+
+int word_length(struct word *w)
+{
+    return w->len;
+}
@@ -2,15 +2,22 @@
 #ifndef WORD_SENTRY
 #define WORD_SENTRY
 
+#include "linear_allocator.h"
+
 #include <stdio.h>
 
 struct word;
 
 struct word *word_create();
+/* the word and its content are taken from a */
+struct word *word_create_in(struct linear_allocator *a);
 struct word *word_add_char(struct word *w, char c);
+/* s must have no '\0' in its n chars */
+struct word *word_add_chars(struct word *w, const char *s, int n);
 int word_put(FILE *f, struct word *w);
 void word_free(struct word *w);
 
 const char *word_content(struct word *w);
+int word_length(struct word *w);
 
 #endif
@@ -10,13 +10,22 @@ struct word_item {
 
 struct word_list {
     struct word_item *first, *last;
+    struct linear_allocator *alloc;
 };
 
 struct word_list *word_list_create()
 {
-    struct word_list *lst = malloc(sizeof(struct word_list));
+    return word_list_create_in(NULL);
+}
+
+struct word_list *word_list_create_in(struct linear_allocator *a)
+{
+    struct word_list *lst;
+
+    lst = linear_allocator_alloc(a, sizeof(struct word_list));
     lst->first = NULL;
     lst->last = NULL;
+    lst->alloc = a;
     return lst;
 }
 
@@ -27,8 +36,10 @@ static int word_list_is_empty(struct word_list *lst)
 
 void word_list_add_item(struct word_list *lst)
 {
-    struct word_item *tmp = malloc(sizeof(struct word_item));
-    tmp->wrd = word_create();
+    struct word_item *tmp;
+
+    tmp = linear_allocator_alloc(lst->alloc, sizeof(struct word_item));
+    tmp->wrd = word_create_in(lst->alloc);
     tmp->next = NULL;
 
     if (word_list_is_empty(lst))
@@ -48,10 +59,20 @@ int word_list_add_letter_to_last(struct word_list *lst, char c)
     return 1;
 }
 
-static void free_word_item(struct word_item *wi)
+int word_list_add_letters_to_last(struct word_list *lst,
+        const char *s, int n)
+{
+    if (lst->last == NULL)
+        return 0;
+
+    lst->last->wrd = word_add_chars(lst->last->wrd, s, n);
+    return 1;
+}
+
+static void free_word_item(struct word_list *lst, struct word_item *wi)
 {
     word_free(wi->wrd);
-    free(wi);
+    linear_allocator_free(lst->alloc, wi);
 }
 
 struct word *word_list_pop_first(struct word_list *lst)
@@ -67,7 +88,7 @@ struct word *word_list_pop_first(struct word_list *lst)
         lst->last = NULL;
     lst->first = lst->first->next;
     ret = tmp->wrd;
-    free(tmp);
+    linear_allocator_free(lst->alloc, tmp);
     return ret;
 }
 
@@ -78,10 +99,10 @@ void word_list_free(struct word_list *lst)
     while (lst->first) {
         tmp = lst->first;
         lst->first = lst->first->next;
-        free_word_item(tmp);
+        free_word_item(lst, tmp);
     }
 
-    free(lst);
+    linear_allocator_free(lst->alloc, lst);
 }
 
 void word_list_print(struct word_list *lst)
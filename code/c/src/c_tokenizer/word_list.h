@@ -8,8 +8,13 @@ struct word_item;
 struct word_list;
 
 struct word_list *word_list_create();
+/* the list and all its words are taken from a, a reset of it frees them
+ * all, word_list_free is not needed then */
+struct word_list *word_list_create_in(struct linear_allocator *a);
 void word_list_add_item(struct word_list *lst);
 int word_list_add_letter_to_last(struct word_list *lst, char c);
+int word_list_add_letters_to_last(struct word_list *lst,
+        const char *s, int n);
 struct word *word_list_pop_first(struct word_list *lst);
 void word_list_free(struct word_list *lst);
 